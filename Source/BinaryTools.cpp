@@ -47,9 +47,13 @@ struct Tool
 extern int Help( int argc, char** argv );
 extern int Data( int argc, char** argv );
 extern int Join( int argc, char** argv );
+extern int LZ( int argc, char** argv );
 extern int Pad( int argc, char** argv );
 extern int RLE( int argc, char** argv );
 extern int SMSChk( int argc, char** argv );
+extern int Text( int argc, char** argv );
+extern int UnRLE( int argc, char** argv );
+extern int Z80Bench( int argc, char** argv );
 extern int ZXTap( int argc, char** argv );
 
 // ... register the tools
@@ -104,35 +108,153 @@ static Tool gTools[] =
 	},
 
 	{
-		"join", Join, "Join multiple files into a separate output.", "<file> [<file> ...] <output>",
-		"  <file>    An input file to read. Multiple files can be specified.\n\n"
-		"  <output>  The output. Contains all input files in the order given.\n"
-		"            Caution: The output will be overwritten without confirmation.\n"
+		"join", Join, "Join multiple files into a separate output.", "[<file> ...] <output> [-layout <file>] [-parallel]\n\t[-incremental] [-include <file>]",
+		"  <file>      An input file to read. Multiple files can be specified, or\n"
+		"              listed in a layout file instead.\n\n"
+		"  <output>    The output. Contains all input files in the order given.\n"
+		"              Caution: The output will be overwritten without confirmation.\n\n"
+		"  -parallel   Copy the inputs on every CPU core at once. Faster on SSDs,\n"
+		"              slower on spinning disks.\n\n"
+		"  -incremental\n"
+		"              Only rewrite the inputs that changed since the last run,\n"
+		"              using a manifest kept in \"<output>.join\".\n\n"
+		"  -layout F   Read the inputs from a layout file instead, which can also\n"
+		"              place each input at an alignment or offset, set a fill byte\n"
+		"              for the gaps, and set the size or maximum size of the output.\n\n"
+		"  -include F  Write the offset and size of each input as assembler equates,\n"
+		"              or as #defines if F ends in .h, .hpp, .c or .cpp.\n"
 	},
 
 	{
-		"pad", Pad, "Pad a file to a given size.", "<file> size [fill]",
-		"  <file>   A binary file to pad. Caution: The file will be padded in-place.\n"
-		"           If the file doesn't exist, it will be created.\n\n"
-		"  size     The size to pad the file to. Supports the following suffixes: KB, MB\n"
-		"           or MBIT. If no suffix is specified, the size will be in bytes.\n"
-		"           Specify in hexadecimal using either 0x, & or $ prefix or h suffix.\n\n"
-		"  [fill]   Use this to specify a different byte value. Default is 0x00.\n"
+		"lz", LZ, "LZ compress a file for decompression on 8-bit machines.", "<file> <output> [-append]",
+		"  <file>    An input file to read.\n\n"
+		"  <output>  The compressed output. Decompress on Z80 machines with\n"
+		"            Extras/lz_decompress.z80.\n\n"
+		"  -append   Append to the output file, rather than overwriting it.\n"
 	},
 
 	{
-		"rle", RLE, "Compress a file using run-length encoding.", "<file> <output> [-append] [-planes N]",
+		"pad", Pad, "Pad a file to a given size.", "<file> size [fill]\n\t| <file> [<file> ...] -size N|-align N|-pow2 [-fill N]",
+		"  <file>     A binary file to pad. Caution: The file will be padded in-place.\n"
+		"             If the file doesn't exist, it will be created.\n\n"
+		"  size       The size to pad the file to. Supports the following suffixes: KB,\n"
+		"             MB or MBIT. If no suffix is specified, the size will be in bytes.\n"
+		"             Specify in hexadecimal using either 0x, & or $ prefix or h suffix.\n\n"
+		"  [fill]     Use this to specify a different byte value. Default is 0x00.\n\n"
+		"  To pad many files at once, in parallel, give one of these instead:\n\n"
+		"  -size N    Pad every file to N bytes, as 'size' above.\n\n"
+		"  -align N   Pad each file up to a multiple of N bytes.\n\n"
+		"  -pow2      Pad each file up to a power of two, such as a ROM size.\n\n"
+		"  -fill N    The byte value to pad with. Default is 0x00.\n"
+	},
+
+	{
+		"rle", RLE, "Compress a file using run-length encoding.", "<file> <output> [-append] [-planes N]\n\t[-filter delta|xor-row:<pitch>] [-scan S] [-width N] [-index N] [-auto]\n\t[-max-size N|-max-cycles N] [-stats] [-stats-json <file>]\n\t[-emit-decoder <file>] [-nibble] [-inplace <file> [-inplace-min]]\n\t-archive <file> [<file> ...] <output> [-include <file>]",
 		"  <file>      The input file.\n\n"
 		"  <output>    The RLE encoded/compressed output.\n\n"
 		"  -append     Append to the output file, rather than overwriting it.\n\n"
 		"  -planes N   Specify the number of interleaved planes in the input.\n"
-		"              Default is 1 plane.\n"
+		"              Default is 1 plane.\n\n"
+		"  -filter F   Filter each plane before encoding. 'delta' stores the difference\n"
+		"              from the previous byte. 'xor-row:<pitch>' stores each byte XOR\n"
+		"              the byte <pitch> bytes earlier in the same plane.\n\n"
+		"  -scan S     Reorder each plane before encoding. 'column:<w>x<h>' reads each\n"
+		"              w x h page top to bottom. 'tile:<tw>x<th>' reads one tile at a\n"
+		"              time. 'zigzag' reverses every other row. The options are\n"
+		"              written to \"<output>.params\".\n\n"
+		"  -width N    Bytes per row of a plane, needed by tile and zigzag scans.\n\n"
+		"  -index N    Write an indexed container with a seek table entry every N\n"
+		"              bytes of each plane, so unrle can decode any part of it.\n\n"
+		"  -auto       Try every plane count from 1 to 16 with each filter and keep the\n"
+		"              smallest output. The chosen options are written to\n"
+		"              \"<output>.params\".\n\n"
+		"  -max-size N    Choose the blocks that decode fastest on a Z80 while\n"
+		"                 keeping the RLE data within N bytes.\n\n"
+		"  -max-cycles N  Choose the smallest blocks that decode within N T-states\n"
+		"                 on a Z80. The estimated decode time is reported.\n\n"
+		"  -stats      Print block counts, a histogram of block lengths, bytes lost\n"
+		"              to the 127 byte limit and the size of each plane.\n\n"
+		"  -stats-json F  Write the same statistics to a JSON file.\n\n"
+		"  -emit-decoder F  Write a Z80 routine (vasm 'oldstyle') that decodes this\n"
+		"                   output straight into its original interleaved, unfiltered\n"
+		"                   form. It is specialised for these options and this data.\n\n"
+		"  -nibble     Encode runs of 4-bit values rather than bytes, for 2bpp and\n"
+		"              4bpp graphics. Decode with 'unrle -nibble'.\n\n"
+		"  -inplace F  Work out how many bytes past the end of the output buffer are\n"
+		"              needed to load the data at the end of it and decode in place\n"
+		"              with RLEDecompress. Writes the sizes and margin to F, as\n"
+		"              assembler equates, or #defines if F ends in .h or .c.\n\n"
+		"  -inplace-min  Also try the smallest blocks, and keep whichever encoding\n"
+		"                needs the smaller margin.\n\n"
+		"  -archive    Encode many files into one archive, with a directory of each\n"
+		"              entry's offset, size, planes and filter. Files are encoded in\n"
+		"              parallel. Works with -planes, -filter and -auto (per file).\n\n"
+		"  -include F  With -archive, write each entry's offset, size and planes as\n"
+		"              assembler equates, or #defines if F ends in .h or .c.\n"
 	},
 
 	{
-		"smschk", SMSChk, "Sign a Master System ROM with a valid checksum.", "<rom-file>",
+		"smschk", SMSChk, "Sign a Master System ROM with a valid checksum.", "<rom-file>\n\t| -verify <rom-file|dir> [<rom-file|dir> ...] [-json <file>]",
 		"  <rom-file>   A ROM file to sign with a valid checksum. Caution: The file will\n"
-		"               be modified in-place.\n"
+		"               be modified in-place.\n\n"
+		"  -verify      Check ROM files, and the .sms files in any directories, in\n"
+		"               parallel. Nothing is modified.\n\n"
+		"  -json <file> Also write the ROMs that failed to a JSON report.\n"
+	},
+
+	{
+		"text", Text, "Byte pair compress text for decompression on 8-bit machines.", "<file> <output> [-max-pairs N] [-append]",
+		"  <file>         An input file to read. It must not contain 00 bytes.\n\n"
+		"  <output>       The compressed output, with its pair dictionary. Decompress\n"
+		"                 on Z80 machines with Extras/text_decompress.z80.\n\n"
+		"  -max-pairs N   Use at most N pair codes. Default is as many as the longest\n"
+		"                 run of unused byte values allows, up to 255.\n\n"
+		"  -append        Append to the output file, rather than overwriting it.\n"
+	},
+
+	{
+		"unrle", UnRLE, "Decompress a file made by the rle tool.", "<file> <output> [-planes N]\n\t[-filter delta|xor-row:<pitch>] [-scan S] [-width N] [-params <file>]\n\t[-offset N] [-length N] [-entry N] [-nibble] [-raw]",
+		"  <file>      The RLE encoded/compressed input.\n\n"
+		"  <output>    The decoded output.\n\n"
+		"  -planes N   The number of planes the input was encoded with. Default is 1.\n\n"
+		"  -filter F   The filter the input was encoded with, if any.\n\n"
+		"  -scan S     The scan order the input was encoded with, if any.\n\n"
+		"  -width N    The row width given with -scan.\n\n"
+		"  -params F   Read the options above from a file, such as the \".params\" file\n"
+		"              written by 'rle -auto' or 'rle -scan'.\n\n"
+		"  -offset N   Decode from this byte onwards. Needs an input made with\n"
+		"              'rle -index', which also supplies the options above.\n\n"
+		"  -length N   Decode this many bytes. Default is to the end.\n\n"
+		"  -entry N    Decode entry N (from 0) of an archive made with 'rle -archive',\n"
+		"              which also supplies the options above.\n\n"
+		"  -nibble     The input was encoded with 'rle -nibble'.\n\n"
+		"  -raw        Decode the input as a plain stream, even if it starts like an\n"
+		"              indexed file or an archive.\n"
+	},
+
+	{
+		"z80bench", Z80Bench, "Time a Z80 RLE, LZ or text decompressor on an emulator.", "<file> [<file> ...] -asm <source> [-asm <source> ...]\n\t[-entry label] [-planes N] [-filter delta|xor-row:<pitch>] [-whole] [-lz]\n\t[-text] [-inplace]",
+		"  <file>      A file to compress with rle (or lz, text), then decompress on\n"
+		"              the emulator. Multiple files can be specified.\n\n"
+		"  -asm F      Z80 source to assemble, in vasm 'oldstyle' syntax. Repeat for\n"
+		"              more files, e.g. Extras/rle_decompress.z80 and\n"
+		"              Extras/rle_unfilter.z80.\n\n"
+		"  -entry L    Label of the decompressor. Default is RLEDecompress, or\n"
+		"              LZDecompress with -lz, or TextDecompress with -text. It's\n"
+		"              called once per plane with HL = data and DE = output.\n\n"
+		"  -planes N   Encode and decode N interleaved planes.\n\n"
+		"  -filter F   Encode with a filter, then undo it on the emulator with\n"
+		"              RLEUnfilterDelta or RLEUnfilterXorRow.\n\n"
+		"  -whole      Call the entry once to decode every plane and undo any filter,\n"
+		"              as routines written by 'rle -emit-decoder' do.\n\n"
+		"  -lz         Compress with lz instead, and decode with one call, e.g. with\n"
+		"              Extras/lz_decompress.z80.\n\n"
+		"  -text       Compress with text instead, and decode with one call, e.g. with\n"
+		"              Extras/text_decompress.z80.\n\n"
+		"  -inplace    Load the data at the end of the output buffer, with the margin\n"
+		"              'rle -inplace' reports, and decode over it.\n\n"
+		"  Each output is checked against the input, and the T-states are reported\n"
+		"  next to the estimate used by 'rle -max-size' and 'rle -max-cycles'.\n"
 	},
 
 	{
@@ -232,7 +354,7 @@ void PrintHelp( const char* pName )
 	}
 }
 
-static int Help( int argc, char** argv )
+int Help( int argc, char** argv )
 {
 	if ( argc <= 2 )
 	{
@@ -0,0 +1,952 @@
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+#endif
+
+#include "utils.h"
+#include "fileio.h"
+
+//------------------------------------------------------------------------------
+// MapFile
+//------------------------------------------------------------------------------
+bool MapFile( MappedFile* pMap, const char* pName )
+{
+	pMap->pData = nullptr;
+	pMap->iSize = 0;
+
+#ifdef _WIN32
+
+	HANDLE hFile = CreateFileA( pName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if ( GetFileSizeEx( hFile, &size ) == FALSE )
+	{
+		CloseHandle( hFile );
+		return false;
+	}
+
+	// Can't map an empty file.
+	if ( size.QuadPart == 0 )
+	{
+		CloseHandle( hFile );
+		return true;
+	}
+
+	HANDLE hMapping = CreateFileMappingA( hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+	CloseHandle( hFile );
+
+	if ( hMapping == NULL )
+	{
+		return false;
+	}
+
+	// The view keeps the mapping alive after the handle is closed.
+	void* pView = MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, 0 );
+	CloseHandle( hMapping );
+
+	if ( pView == NULL )
+	{
+		return false;
+	}
+
+	pMap->pData = static_cast<const uint8_t*>( pView );
+	pMap->iSize = size.QuadPart;
+
+#else
+
+	int fd = open( pName, O_RDONLY );
+	if ( fd < 0 )
+	{
+		return false;
+	}
+
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 )
+	{
+		close( fd );
+		return false;
+	}
+
+	// Can't map an empty file.
+	if ( st.st_size == 0 )
+	{
+		close( fd );
+		return true;
+	}
+
+	void* pView = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+
+	if ( pView == MAP_FAILED )
+	{
+		return false;
+	}
+
+	pMap->pData = static_cast<const uint8_t*>( pView );
+	pMap->iSize = st.st_size;
+
+#endif
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// UnmapFile
+//------------------------------------------------------------------------------
+void UnmapFile( MappedFile* pMap )
+{
+	if ( pMap->pData )
+	{
+#ifdef _WIN32
+		UnmapViewOfFile( pMap->pData );
+#else
+		munmap( const_cast<uint8_t*>( pMap->pData ), pMap->iSize );
+#endif
+	}
+
+	pMap->pData = nullptr;
+	pMap->iSize = 0;
+}
+
+//------------------------------------------------------------------------------
+// IsDirectory
+//------------------------------------------------------------------------------
+bool IsDirectory( const char* pName )
+{
+#ifdef _WIN32
+
+	const DWORD attributes = GetFileAttributesA( pName );
+
+	return attributes != INVALID_FILE_ATTRIBUTES && ( attributes & FILE_ATTRIBUTE_DIRECTORY ) != 0;
+
+#else
+
+	struct stat st;
+
+	return stat( pName, &st ) == 0 && S_ISDIR( st.st_mode );
+
+#endif
+}
+
+//------------------------------------------------------------------------------
+// ListFiles
+//------------------------------------------------------------------------------
+
+// True if a name ends with an extension, in any case.
+static bool HasExtension( const char* pName, const char* pExtension )
+{
+	const size_t iName = strlen( pName );
+	const size_t iExt = strlen( pExtension );
+
+	return iName >= iExt && _stricmp( pName + iName - iExt, pExtension ) == 0;
+}
+
+static bool ListFilesIn( std::vector< std::string >& files, const std::string& directory, const char* pExtension )
+{
+#ifdef _WIN32
+
+	WIN32_FIND_DATAA data;
+	HANDLE hFind = FindFirstFileA( ( directory + "\\*" ).c_str(), &data );
+	if ( hFind == INVALID_HANDLE_VALUE )
+	{
+		return false;
+	}
+
+	do
+	{
+		const char* pName = data.cFileName;
+		if ( strcmp( pName, "." ) == 0 || strcmp( pName, ".." ) == 0 )
+		{
+			continue;
+		}
+
+		const std::string path = directory + "\\" + pName;
+
+		// ... links and junctions to directories aren't followed, as they can loop.
+		if ( data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+		{
+			if ( ( data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT ) == 0 )
+			{
+				ListFilesIn( files, path, pExtension );
+			}
+		}
+		else if ( HasExtension( pName, pExtension ) )
+		{
+			files.push_back( path );
+		}
+	}
+	while ( FindNextFileA( hFind, &data ) );
+
+	FindClose( hFind );
+
+#else
+
+	DIR* pDir = opendir( directory.c_str() );
+	if ( pDir == nullptr )
+	{
+		return false;
+	}
+
+	while ( struct dirent* pEntry = readdir( pDir ) )
+	{
+		const char* pName = pEntry->d_name;
+		if ( strcmp( pName, "." ) == 0 || strcmp( pName, ".." ) == 0 )
+		{
+			continue;
+		}
+
+		const std::string path = directory + "/" + pName;
+
+		struct stat st;
+		if ( lstat( path.c_str(), &st ) != 0 )
+		{
+			continue;
+		}
+
+		// ... links to directories aren't followed, as they can loop.
+		if ( S_ISDIR( st.st_mode ) )
+		{
+			ListFilesIn( files, path, pExtension );
+		}
+		else if ( S_ISLNK( st.st_mode ) && IsDirectory( path.c_str() ) )
+		{
+			continue;
+		}
+		else if ( HasExtension( pName, pExtension ) )
+		{
+			files.push_back( path );
+		}
+	}
+
+	closedir( pDir );
+
+#endif
+
+	return true;
+}
+
+bool ListFiles( std::vector< std::string >& files, const char* pDirectory, const char* pExtension )
+{
+	const size_t iFirst = files.size();
+
+	if ( ListFilesIn( files, pDirectory, pExtension ) == false )
+	{
+		return false;
+	}
+
+	std::sort( files.begin() + iFirst, files.end() );
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// StatFileSize
+//------------------------------------------------------------------------------
+bool StatFileSize( const char* pName, int64_t* pSize )
+{
+#ifdef _WIN32
+
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if ( GetFileAttributesExA( pName, GetFileExInfoStandard, &data ) == FALSE )
+	{
+		return false;
+	}
+
+	*pSize = ( static_cast<int64_t>( data.nFileSizeHigh ) << 32 ) | data.nFileSizeLow;
+
+#else
+
+	struct stat st;
+	if ( stat( pName, &st ) != 0 )
+	{
+		return false;
+	}
+
+	*pSize = st.st_size;
+
+#endif
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// StatFileTime
+//------------------------------------------------------------------------------
+bool StatFileTime( const char* pName, int64_t* pTime )
+{
+#ifdef _WIN32
+
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if ( GetFileAttributesExA( pName, GetFileExInfoStandard, &data ) == FALSE )
+	{
+		return false;
+	}
+
+	// ... 100ns ticks.
+	*pTime = ( static_cast<int64_t>( data.ftLastWriteTime.dwHighDateTime ) << 32 ) | data.ftLastWriteTime.dwLowDateTime;
+
+#else
+
+	struct stat st;
+	if ( stat( pName, &st ) != 0 )
+	{
+		return false;
+	}
+
+	// ... nanoseconds.
+#ifdef __APPLE__
+	*pTime = static_cast<int64_t>( st.st_mtimespec.tv_sec ) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	*pTime = static_cast<int64_t>( st.st_mtim.tv_sec ) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+
+#endif
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// OpenInputFile
+//------------------------------------------------------------------------------
+bool OpenInputFile( RawFile* pFile, const char* pName )
+{
+	pFile->iSize = 0;
+
+#ifdef _WIN32
+
+	pFile->iSparse = 0;
+
+	HANDLE hFile = CreateFileA( pName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+	{
+		pFile->hFile = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if ( GetFileSizeEx( hFile, &size ) == FALSE )
+	{
+		CloseHandle( hFile );
+		pFile->hFile = nullptr;
+		return false;
+	}
+
+	pFile->hFile = hFile;
+	pFile->iSize = size.QuadPart;
+
+#else
+
+	pFile->fd = open( pName, O_RDONLY );
+	if ( pFile->fd < 0 )
+	{
+		return false;
+	}
+
+	struct stat st;
+	if ( fstat( pFile->fd, &st ) != 0 )
+	{
+		CloseRawFile( pFile );
+		return false;
+	}
+
+	pFile->iSize = st.st_size;
+
+#endif
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// OpenOutputFile
+//------------------------------------------------------------------------------
+bool OpenOutputFile( RawFile* pFile, const char* pName, bool bCreate )
+{
+	pFile->iSize = 0;
+
+#ifdef _WIN32
+
+	pFile->iSparse = 0;
+
+	HANDLE hFile = CreateFileA( pName, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+								bCreate ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+	{
+		pFile->hFile = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if ( GetFileSizeEx( hFile, &size ) == FALSE )
+	{
+		CloseHandle( hFile );
+		pFile->hFile = nullptr;
+		return false;
+	}
+
+	pFile->hFile = hFile;
+	pFile->iSize = size.QuadPart;
+
+#else
+
+	pFile->fd = open( pName, bCreate ? ( O_WRONLY | O_CREAT ) : O_WRONLY, 0666 );
+	if ( pFile->fd < 0 )
+	{
+		return false;
+	}
+
+	struct stat st;
+	if ( fstat( pFile->fd, &st ) != 0 )
+	{
+		CloseRawFile( pFile );
+		return false;
+	}
+
+	pFile->iSize = st.st_size;
+
+#endif
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// CreateOutputFile
+//------------------------------------------------------------------------------
+bool CreateOutputFile( RawFile* pFile, const char* pName, int64_t iSize )
+{
+	pFile->iSize = iSize;
+
+#ifdef _WIN32
+
+	pFile->iSparse = 0;
+
+	HANDLE hFile = CreateFileA( pName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( hFile == INVALID_HANDLE_VALUE )
+	{
+		pFile->hFile = nullptr;
+		return false;
+	}
+
+	pFile->hFile = hFile;
+
+#else
+
+	pFile->fd = open( pName, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+	if ( pFile->fd < 0 )
+	{
+		return false;
+	}
+
+#endif
+
+	if ( SetFileSize( pFile, iSize ) == false )
+	{
+		CloseRawFile( pFile );
+		return false;
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// SetFileSize
+//------------------------------------------------------------------------------
+bool SetFileSize( RawFile* pFile, int64_t iSize )
+{
+#ifdef _WIN32
+
+	LARGE_INTEGER size;
+	size.QuadPart = iSize;
+	if ( SetFilePointerEx( pFile->hFile, size, NULL, FILE_BEGIN ) == FALSE || SetEndOfFile( pFile->hFile ) == FALSE )
+	{
+		return false;
+	}
+
+#else
+
+	if ( ftruncate( pFile->fd, iSize ) != 0 )
+	{
+		return false;
+	}
+
+#endif
+
+	pFile->iSize = iSize;
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// CloseRawFile
+//------------------------------------------------------------------------------
+void CloseRawFile( RawFile* pFile )
+{
+#ifdef _WIN32
+	if ( pFile->hFile )
+	{
+		CloseHandle( pFile->hFile );
+		pFile->hFile = nullptr;
+	}
+#else
+	if ( pFile->fd >= 0 )
+	{
+		close( pFile->fd );
+		pFile->fd = -1;
+	}
+#endif
+}
+
+//------------------------------------------------------------------------------
+// WriteFileData
+//------------------------------------------------------------------------------
+bool WriteFileData( RawFile* pOut, int64_t iOffset, const uint8_t* pData, int64_t iSize )
+{
+	while ( iSize > 0 )
+	{
+#ifdef _WIN32
+
+		OVERLAPPED at = {};
+		at.Offset = static_cast<DWORD>( iOffset );
+		at.OffsetHigh = static_cast<DWORD>( iOffset >> 32 );
+
+		const DWORD iWant = static_cast<DWORD>( ( iSize < ( 1 << 30 ) ) ? iSize : ( 1 << 30 ) );
+		DWORD iWritten = 0;
+		if ( WriteFile( pOut->hFile, pData, iWant, &iWritten, &at ) == FALSE || iWritten == 0 )
+		{
+			return false;
+		}
+
+#else
+
+		const ssize_t iWritten = pwrite( pOut->fd, pData, static_cast<size_t>( iSize ), iOffset );
+		if ( iWritten <= 0 )
+		{
+			return false;
+		}
+
+#endif
+
+		pData += iWritten;
+		iOffset += iWritten;
+		iSize -= iWritten;
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// FillFileData
+//------------------------------------------------------------------------------
+bool FillFileData( RawFile* pOut, int64_t iOffset, int64_t iSize, uint8_t fill )
+{
+	const int64_t kBufferSize = 1 << 20;
+	const std::vector< uint8_t > buffer( static_cast<size_t>( ( iSize < kBufferSize ) ? iSize : kBufferSize ), fill );
+
+	while ( iSize > 0 )
+	{
+		const int64_t iWant = ( iSize < kBufferSize ) ? iSize : kBufferSize;
+
+		if ( WriteFileData( pOut, iOffset, buffer.data(), iWant ) == false )
+		{
+			return false;
+		}
+
+		iOffset += iWant;
+		iSize -= iWant;
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// ZeroFileData
+//------------------------------------------------------------------------------
+bool ZeroFileData( RawFile* pOut, int64_t iOffset, int64_t iSize )
+{
+	if ( iSize <= 0 )
+	{
+		return true;
+	}
+
+#ifdef _WIN32
+
+	// ... a sparse file frees space in aligned 64KB units, so only a range
+	// that covers one is worth marking the file for. Smaller ones are written.
+	const int64_t kSparseUnit = 64 * 1024;
+	const int64_t iFirstUnit = ( iOffset + kSparseUnit - 1 ) & ~( kSparseUnit - 1 );
+
+	if ( iFirstUnit + kSparseUnit <= iOffset + iSize && pOut->iSparse >= 0 )
+	{
+		DWORD iBytes;
+
+		// ... once per file.
+		if ( pOut->iSparse == 0 )
+		{
+			pOut->iSparse = DeviceIoControl( pOut->hFile, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &iBytes, NULL ) ? 1 : -1;
+		}
+
+		FILE_ZERO_DATA_INFORMATION zero;
+		zero.FileOffset.QuadPart = iOffset;
+		zero.BeyondFinalZero.QuadPart = iOffset + iSize;
+
+		if ( pOut->iSparse > 0 &&
+			 DeviceIoControl( pOut->hFile, FSCTL_SET_ZERO_DATA, &zero, sizeof( zero ), NULL, 0, &iBytes, NULL ) )
+		{
+			return true;
+		}
+	}
+
+#elif defined( __linux__ )
+
+	if ( fallocate( pOut->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, iOffset, iSize ) == 0 )
+	{
+		return true;
+	}
+
+#endif
+
+	return FillFileData( pOut, iOffset, iSize, 0 );
+}
+
+//------------------------------------------------------------------------------
+// CopyFileData
+//------------------------------------------------------------------------------
+
+// Largest amount handed to the system in one call.
+static const int64_t kCopyChunk = 1 << 30;
+
+// Zero blocks of this size are written as holes by the buffered copy.
+static const int kZeroBlockSize = 4096;
+
+static bool IsZero( const uint8_t* pData, int64_t iSize )
+{
+	return pData[ 0 ] == 0 && memcmp( pData, pData + 1, static_cast<size_t>( iSize - 1 ) ) == 0;
+}
+
+// Copy through a buffer in user space, the fallback for every system. Runs of
+// zero blocks are left as holes in the output.
+static bool CopyBuffered( RawFile* pOut, int64_t iOutOffset, RawFile* pIn, int64_t iInOffset, int64_t iSize )
+{
+	const int64_t kBufferSize = 1 << 20;
+	std::vector< uint8_t > buffer( static_cast<size_t>( ( iSize < kBufferSize ) ? iSize : kBufferSize ) );
+
+	while ( iSize > 0 )
+	{
+		const int64_t iWant = ( iSize < kBufferSize ) ? iSize : kBufferSize;
+
+#ifdef _WIN32
+
+		OVERLAPPED at = {};
+		at.Offset = static_cast<DWORD>( iInOffset );
+		at.OffsetHigh = static_cast<DWORD>( iInOffset >> 32 );
+
+		DWORD iRead = 0;
+		if ( ReadFile( pIn->hFile, buffer.data(), static_cast<DWORD>( iWant ), &iRead, &at ) == FALSE || iRead == 0 )
+		{
+			return false;
+		}
+
+#else
+
+		const ssize_t iRead = pread( pIn->fd, buffer.data(), static_cast<size_t>( iWant ), iInOffset );
+		if ( iRead <= 0 )
+		{
+			return false;
+		}
+
+#endif
+
+		// ... split into runs of zero blocks and runs of data.
+		for ( int64_t iPos = 0; iPos < iRead; )
+		{
+			int64_t iEnd = iPos + ( ( iRead - iPos < kZeroBlockSize ) ? iRead - iPos : kZeroBlockSize );
+			const bool bZero = IsZero( buffer.data() + iPos, iEnd - iPos );
+
+			while ( iEnd < iRead )
+			{
+				const int64_t iNext = iEnd + ( ( iRead - iEnd < kZeroBlockSize ) ? iRead - iEnd : kZeroBlockSize );
+				if ( IsZero( buffer.data() + iEnd, iNext - iEnd ) != bZero )
+				{
+					break;
+				}
+
+				iEnd = iNext;
+			}
+
+			const bool bOK = bZero ? ZeroFileData( pOut, iOutOffset + iPos, iEnd - iPos )
+								   : WriteFileData( pOut, iOutOffset + iPos, buffer.data() + iPos, iEnd - iPos );
+			if ( bOK == false )
+			{
+				return false;
+			}
+
+			iPos = iEnd;
+		}
+
+		iInOffset += iRead;
+		iOutOffset += iRead;
+		iSize -= iRead;
+	}
+
+	return true;
+}
+
+#if defined( __linux__ ) && defined( FICLONE )
+
+// Share the input's blocks with the output instead of copying them, on
+// filesystems with copy on write such as Btrfs and XFS. Offsets must be block
+// aligned, and the length too unless the range ends both files. Returns how
+// many bytes from the start of the range were cloned.
+static int64_t CloneFileData( RawFile* pOut, int64_t iOutOffset, RawFile* pIn, int64_t iInOffset, int64_t iSize )
+{
+	// ... a whole file onto a whole file.
+	if ( iInOffset == 0 && iOutOffset == 0 && iSize == pIn->iSize && iSize == pOut->iSize )
+	{
+		if ( ioctl( pOut->fd, FICLONE, pIn->fd ) == 0 )
+		{
+			return iSize;
+		}
+	}
+
+	struct stat st;
+	if ( fstat( pOut->fd, &st ) != 0 || st.st_blksize <= 0 )
+	{
+		return 0;
+	}
+
+	const int64_t iBlock = st.st_blksize;
+	if ( iInOffset % iBlock != 0 || iOutOffset % iBlock != 0 )
+	{
+		return 0;
+	}
+
+	int64_t iLength = iSize;
+	if ( iInOffset + iSize != pIn->iSize || iOutOffset + iSize != pOut->iSize )
+	{
+		iLength -= iSize % iBlock;
+	}
+
+	if ( iLength == 0 )
+	{
+		return 0;
+	}
+
+	struct file_clone_range range;
+	range.src_fd = pIn->fd;
+	range.src_offset = iInOffset;
+	range.src_length = iLength;
+	range.dest_offset = iOutOffset;
+
+	if ( ioctl( pOut->fd, FICLONERANGE, &range ) != 0 )
+	{
+		return 0;
+	}
+
+	return iLength;
+}
+
+#endif
+
+// Copy a range that holds data, in the kernel where the system allows.
+static bool CopyExtent( RawFile* pOut, int64_t iOutOffset, RawFile* pIn, int64_t iInOffset, int64_t iSize )
+{
+#ifdef __linux__
+
+	// ... copy_file_range stays in the kernel, and can share blocks on
+	// filesystems that support it. It fails across filesystems on older kernels.
+	{
+		loff_t inPos = iInOffset;
+		loff_t outPos = iOutOffset;
+
+		while ( iSize > 0 )
+		{
+			const ssize_t n = copy_file_range( pIn->fd, &inPos, pOut->fd, &outPos,
+											   static_cast<size_t>( ( iSize < kCopyChunk ) ? iSize : kCopyChunk ), 0 );
+			if ( n <= 0 )
+			{
+				break;
+			}
+
+			iSize -= n;
+		}
+
+		iInOffset = inPos;
+		iOutOffset = outPos;
+	}
+
+	// ... sendfile writes at the output's file position, so move that first.
+	if ( iSize > 0 && lseek( pOut->fd, iOutOffset, SEEK_SET ) == iOutOffset )
+	{
+		off_t inPos = iInOffset;
+
+		while ( iSize > 0 )
+		{
+			const ssize_t n = sendfile( pOut->fd, pIn->fd, &inPos,
+										static_cast<size_t>( ( iSize < kCopyChunk ) ? iSize : kCopyChunk ) );
+			if ( n <= 0 )
+			{
+				break;
+			}
+
+			iOutOffset += n;
+			iSize -= n;
+		}
+
+		iInOffset = inPos;
+	}
+
+#endif
+
+	if ( iSize == 0 )
+	{
+		return true;
+	}
+
+	return CopyBuffered( pOut, iOutOffset, pIn, iInOffset, iSize );
+}
+
+bool CopyFileData( RawFile* pOut, int64_t iOutOffset, RawFile* pIn, int64_t iInOffset, int64_t iSize )
+{
+#if defined( __linux__ ) && defined( FICLONE )
+
+	{
+		const int64_t iCloned = CloneFileData( pOut, iOutOffset, pIn, iInOffset, iSize );
+
+		iInOffset += iCloned;
+		iOutOffset += iCloned;
+		iSize -= iCloned;
+	}
+
+#endif
+
+#if !defined( _WIN32 ) && defined( SEEK_HOLE )
+
+	// ... copy only the extents of the input that hold data, and leave holes
+	// in the output for the rest. This moves the input's file position.
+	while ( iSize > 0 )
+	{
+		const int64_t iEnd = iInOffset + iSize;
+
+		off_t iData = lseek( pIn->fd, iInOffset, SEEK_DATA );
+		if ( iData < 0 )
+		{
+			if ( errno != ENXIO )
+			{
+				// ... holes aren't reported here, so copy everything.
+				break;
+			}
+
+			// ... nothing but a hole up to the end of the file, unless the
+			// file ends before the range does.
+			struct stat st;
+			if ( fstat( pIn->fd, &st ) != 0 || st.st_size < iEnd )
+			{
+				return false;
+			}
+
+			iData = iEnd;
+		}
+
+		if ( iData > iEnd )
+		{
+			iData = iEnd;
+		}
+
+		if ( iData > iInOffset )
+		{
+			if ( ZeroFileData( pOut, iOutOffset, iData - iInOffset ) == false )
+			{
+				return false;
+			}
+
+			iOutOffset += iData - iInOffset;
+			iSize -= iData - iInOffset;
+			iInOffset = iData;
+		}
+
+		if ( iSize == 0 )
+		{
+			break;
+		}
+
+		off_t iHole = lseek( pIn->fd, iInOffset, SEEK_HOLE );
+		if ( iHole < 0 || iHole > iEnd )
+		{
+			iHole = iEnd;
+		}
+
+		if ( iHole <= iInOffset )
+		{
+			// ... the input changed under us; let the copy below report it.
+			break;
+		}
+
+		if ( CopyExtent( pOut, iOutOffset, pIn, iInOffset, iHole - iInOffset ) == false )
+		{
+			return false;
+		}
+
+		iOutOffset += iHole - iInOffset;
+		iSize -= iHole - iInOffset;
+		iInOffset = iHole;
+	}
+
+	if ( iSize == 0 )
+	{
+		return true;
+	}
+
+#endif
+
+	return CopyExtent( pOut, iOutOffset, pIn, iInOffset, iSize );
+}
+
+//==============================================================================
@@ -0,0 +1,109 @@
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// File I/O Functions
+//------------------------------------------------------------------------------
+
+// A read-only view of an entire file.
+struct MappedFile
+{
+	const uint8_t* pData;
+	int64_t iSize;
+};
+
+// Map a whole file into memory for reading. An empty file maps to a null
+// pointer with zero size. Returns false if the file couldn't be opened.
+bool MapFile( MappedFile* pMap, const char* pName );
+
+// Release a mapping made by MapFile.
+void UnmapFile( MappedFile* pMap );
+
+// An open file, read and written at explicit offsets.
+struct RawFile
+{
+#ifdef _WIN32
+	void* hFile;
+	int iSparse;		// 0 not tried yet, 1 marked sparse, -1 can't be
+#else
+	int fd;
+#endif
+	int64_t iSize;		// size when opened
+};
+
+// True if a path names a directory.
+bool IsDirectory( const char* pName );
+
+// Add every file in a directory and its subdirectories whose name ends with
+// pExtension (any case), sorted by path. Links to directories are skipped.
+// Returns false if it can't be read.
+bool ListFiles( std::vector< std::string >& files, const char* pDirectory, const char* pExtension );
+
+// Find the size of a file without opening it. Returns false if it doesn't exist.
+bool StatFileSize( const char* pName, int64_t* pSize );
+
+// Find when a file was last modified, in units that depend on the platform.
+// Returns false if it doesn't exist.
+bool StatFileTime( const char* pName, int64_t* pTime );
+
+// Open an existing file for reading. Returns false if it couldn't be opened.
+bool OpenInputFile( RawFile* pFile, const char* pName );
+
+// Open a file for writing without changing its size, creating it (empty) if
+// bCreate is set. Returns false if it couldn't be opened.
+bool OpenOutputFile( RawFile* pFile, const char* pName, bool bCreate );
+
+// Create or overwrite a file for writing, and set its size up front. Returns
+// false if it couldn't be created or sized.
+bool CreateOutputFile( RawFile* pFile, const char* pName, int64_t iSize );
+
+// Grow or shrink a file. Growing adds a hole that reads as zero, where the
+// system allows. Returns false on failure.
+bool SetFileSize( RawFile* pFile, int64_t iSize );
+
+void CloseRawFile( RawFile* pFile );
+
+// Copy iSize bytes from iInOffset in one file to iOutOffset in another, in
+// the kernel where the system allows. Holes and zero blocks in the input are
+// left as holes in the output. Returns false on a read or write error, or if
+// the input ends early.
+bool CopyFileData( RawFile* pOut, int64_t iOutOffset, RawFile* pIn, int64_t iInOffset, int64_t iSize );
+
+// Write a buffer at iOffset. Returns false on a write error.
+bool WriteFileData( RawFile* pOut, int64_t iOffset, const uint8_t* pData, int64_t iSize );
+
+// Write iSize copies of a byte at iOffset. Returns false on a write error.
+bool FillFileData( RawFile* pOut, int64_t iOffset, int64_t iSize, uint8_t fill );
+
+// Make a range of the file read as zero, leaving a hole where the system
+// allows. Returns false on a write error.
+bool ZeroFileData( RawFile* pOut, int64_t iOffset, int64_t iSize );
+
+//==============================================================================
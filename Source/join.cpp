@@ -23,81 +23,770 @@ SOFTWARE.
 
 */
 
+#include <cctype>
 #include <cstdio>
 #include <cstring>
+#include <string>
+#include <vector>
 
 #include "utils.h"
+#include "fileio.h"
+
+// With -parallel, inputs are copied in pieces of at most this size, so one
+// large input still spreads over every thread.
+static const int64_t kJoinPieceSize = 64 << 20;
 
 //------------------------------------------------------------------------------
-// Join
+// Layout
 //------------------------------------------------------------------------------
-int Join( int argc, char** argv )
+//
+// A -layout file lists the inputs in order, one per line, each optionally
+// followed by where it goes. ';' starts a comment.
+//
+//   fill $FF             fill byte for gaps (default 0)
+//   max-size 512KB       fail if the image would be larger
+//   size 512KB           pad the image to this size
+//   boot.bin             placed straight after the previous input
+//   bank1.bin align 16KB placed at the next multiple of 16KB
+//   header.bin at $7FF0  placed at a fixed offset
+//   music.bin name MUSIC symbol name for -include (default JOIN_music)
+
+// One input and where it should go.
+struct JoinEntry
+{
+	std::string name;
+	std::string label;		// symbol written by -include
+	int64_t iAt;			// fixed offset, or -1 to follow the previous input
+	int64_t iAlign;			// otherwise, round the offset up to a multiple of this
+	int64_t iOffset;		// where it was placed
+	int64_t iSize;
+	uint64_t iHash;			// of the contents, for -incremental
+};
+
+struct JoinLayout
+{
+	std::vector< JoinEntry > entries;
+	int iFill;
+	int64_t iMaxSize;		// or -1 for no limit
+	int64_t iSize;			// or -1 to end after the last input
+};
+
+// Symbol name for a path: "JOIN_" and the file name up to the first '.'.
+static std::string JoinLabel( const char* pPath )
+{
+	return FileLabel( "JOIN_", pPath );
+}
+
+static void AddJoinEntry( JoinLayout& layout, const char* pName )
+{
+	JoinEntry entry;
+	entry.name = pName;
+	entry.label = JoinLabel( pName );
+	entry.iAt = -1;
+	entry.iAlign = 1;
+	entry.iOffset = 0;
+	entry.iSize = 0;
+	entry.iHash = 0;
+
+	layout.entries.push_back( entry );
+}
+
+// Read a layout file (see above). Reports any error itself.
+static bool ReadJoinLayout( JoinLayout& layout, const char* pName )
 {
-	if ( argc < 4 )
+	int err;
+	FILE* fp;
+
+	err = fopen_s( &fp, pName, "r" );
+	if ( err != 0 || fp == nullptr )
 	{
-		PrintHelp( "join" );
-		return 1;
+		PrintError( "Cannot open layout file \"%s\"", pName );
+		return false;
+	}
+
+	char line[ 1024 ];
+	int iLine = 0;
+	bool bOK = true;
+
+	while ( bOK && fgets( line, sizeof( line ), fp ) )
+	{
+		++iLine;
+
+		// ... strip comments
+		char* pComment = strchr( line, ';' );
+		if ( pComment )
+		{
+			*pComment = 0;
+		}
+
+		// ... split on white space
+		std::vector< const char* > tokens;
+		const char* pDelim = " \t\r\n";
+		for ( char* pTok = strtok( line, pDelim ); pTok; pTok = strtok( nullptr, pDelim ) )
+		{
+			tokens.push_back( pTok );
+		}
+
+		if ( tokens.empty() )
+		{
+			continue;
+		}
+
+		const char* pKey = tokens[ 0 ];
+
+		if ( _stricmp( pKey, "fill" ) == 0 && tokens.size() == 2 )
+		{
+			layout.iFill = ParseValue( tokens[ 1 ], 255 );
+			bOK = ( layout.iFill >= 0 );
+		}
+		else if ( _stricmp( pKey, "max-size" ) == 0 && tokens.size() == 2 )
+		{
+			layout.iMaxSize = ParseSizeWithSuffix( tokens[ 1 ] );
+			bOK = ( layout.iMaxSize >= 0 );
+		}
+		else if ( _stricmp( pKey, "size" ) == 0 && tokens.size() == 2 )
+		{
+			layout.iSize = ParseSizeWithSuffix( tokens[ 1 ] );
+			bOK = ( layout.iSize >= 0 );
+		}
+		else
+		{
+			AddJoinEntry( layout, pKey );
+			JoinEntry& entry = layout.entries.back();
+
+			// ... placement, as keyword and value pairs.
+			for ( size_t i = 1; bOK && i < tokens.size(); i += 2 )
+			{
+				if ( i + 1 >= tokens.size() )
+				{
+					bOK = false;
+				}
+				else if ( _stricmp( tokens[ i ], "align" ) == 0 )
+				{
+					entry.iAlign = ParseSizeWithSuffix( tokens[ i + 1 ] );
+					bOK = ( entry.iAlign > 0 );
+				}
+				else if ( _stricmp( tokens[ i ], "at" ) == 0 )
+				{
+					entry.iAt = ParseSizeWithSuffix( tokens[ i + 1 ] );
+					bOK = ( entry.iAt >= 0 );
+				}
+				else if ( _stricmp( tokens[ i ], "name" ) == 0 )
+				{
+					entry.label = tokens[ i + 1 ];
+				}
+				else
+				{
+					bOK = false;
+				}
+			}
+		}
+	}
+
+	fclose( fp );
+
+	if ( bOK == false )
+	{
+		PrintError( "Invalid layout in \"%s\" on line %d.", pName, iLine );
+	}
+
+	return bOK;
+}
+
+// Write the offset and size of each input as assembler equates, or as
+// #defines for a C/C++ file name.
+static bool WriteJoinInclude( const char* pName, const char* pOutputName, const JoinLayout& layout, int64_t iTotalSize )
+{
+	FILE* fp;
+	int err = fopen_s( &fp, pName, "w" );
+	if ( err != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	const bool bC = IsCFileName( pName );
+	const char* pComment = bC ? "//" : ";";
+
+	fprintf( fp, "%s Generated by BinaryTools join from \"%s\" (%d files, %lld bytes).\n\n",
+			 pComment, pOutputName, static_cast<int>( layout.entries.size() ), static_cast<long long>( iTotalSize ) );
+
+	for ( const JoinEntry& entry : layout.entries )
+	{
+		fprintf( fp, "%s %s\n", pComment, entry.name.c_str() );
+
+		if ( bC )
+		{
+			fprintf( fp, "#define %s 0x%04llX\n", entry.label.c_str(), static_cast<long long>( entry.iOffset ) );
+			fprintf( fp, "#define %s_SIZE %lld\n\n", entry.label.c_str(), static_cast<long long>( entry.iSize ) );
+		}
+		else
+		{
+			fprintf( fp, "%s equ $%04llX\n", entry.label.c_str(), static_cast<long long>( entry.iOffset ) );
+			fprintf( fp, "%s_SIZE equ %lld\n\n", entry.label.c_str(), static_cast<long long>( entry.iSize ) );
+		}
+	}
+
+	fclose( fp );
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Incremental
+//------------------------------------------------------------------------------
+//
+// -incremental keeps "<output>.join" next to the output, recording where each
+// input went and a hash of what it held:
+//
+//   size <output size> fill <byte>
+//   <offset> <size> <hash> <name>
+//   ...
+//
+// If the next run places every input in the same way, only the inputs whose
+// hash changed are written again.
+
+// 64-bit hash of a buffer, a word at a time. Only used to spot changes.
+static uint64_t HashData( const uint8_t* pData, int64_t iSize )
+{
+	const uint64_t kPrime = 0x9E3779B97F4A7C15ull;
+	uint64_t h = static_cast<uint64_t>( iSize ) * kPrime;
+
+	int64_t i = 0;
+	for ( ; i + 8 <= iSize; i += 8 )
+	{
+		uint64_t w;
+		memcpy( &w, pData + i, 8 );
+
+		h = ( h ^ w ) * kPrime;
+		h ^= h >> 29;
 	}
 
-	const char* pOutputName = argv[ argc - 1 ];
-	FILE* fp_out;
+	for ( ; i < iSize; ++i )
+	{
+		h = ( h ^ pData[ i ] ) * kPrime;
+	}
+
+	h ^= h >> 32;
+
+	return h;
+}
+
+// Hash every input, in parallel. Returns false if one couldn't be read.
+static bool HashJoinInputs( JoinLayout& layout )
+{
+	const int iCount = static_cast<int>( layout.entries.size() );
+	std::vector< char > failed( iCount, 0 );
+
+	ParallelFor( iCount, [ & ]( int i )
+	{
+		JoinEntry& entry = layout.entries[ i ];
+
+		MappedFile file;
+		if ( MapFile( &file, entry.name.c_str() ) == false || file.iSize != entry.iSize )
+		{
+			UnmapFile( &file );
+			failed[ i ] = 1;
+			return;
+		}
+
+		entry.iHash = HashData( file.pData, file.iSize );
+		UnmapFile( &file );
+	} );
+
+	for ( int i = 0; i < iCount; ++i )
+	{
+		if ( failed[ i ] )
+		{
+			PrintError( "Cannot read input file \"%s\"", layout.entries[ i ].name.c_str() );
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool WriteJoinManifest( const char* pName, const JoinLayout& layout, int64_t iTotalSize, int64_t iOutputTime )
+{
+	FILE* fp;
+	int err = fopen_s( &fp, pName, "w" );
+	if ( err != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	fprintf( fp, "; Written by BinaryTools join -incremental.\n" );
+	fprintf( fp, "size %lld fill %d time %lld\n", static_cast<long long>( iTotalSize ), layout.iFill, static_cast<long long>( iOutputTime ) );
+
+	for ( const JoinEntry& entry : layout.entries )
+	{
+		fprintf( fp, "%lld %lld %016llx %s\n", static_cast<long long>( entry.iOffset ), static_cast<long long>( entry.iSize ),
+				 static_cast<unsigned long long>( entry.iHash ), entry.name.c_str() );
+	}
+
+	fclose( fp );
+	return true;
+}
+
+// Compare the layout with the manifest of the last run. Returns false if
+// there's no manifest, anything was placed differently or the output was
+// modified since, otherwise marks which inputs are unchanged.
+static bool MatchJoinManifest( const char* pName, const JoinLayout& layout, int64_t iTotalSize, int64_t iOutputTime, std::vector< char >& unchanged )
+{
 	int err;
+	FILE* fp;
 
+	err = fopen_s( &fp, pName, "r" );
+	if ( err != 0 || fp == nullptr )
+	{
+		return false;
+	}
 
-	// ... output file
-	err = fopen_s( &fp_out, pOutputName, "wb" );
-	if ( err != 0 || fp_out == nullptr )
+	unchanged.assign( layout.entries.size(), 0 );
+
+	char line[ 1024 ];
+	size_t iEntry = 0;
+	bool bHeader = false;
+	bool bMatch = true;
+
+	while ( bMatch && fgets( line, sizeof( line ), fp ) )
 	{
-		PrintError( "Cannot open output file \"%s\"", pOutputName );
+		// ... strip the line end
+		line[ strcspn( line, "\r\n" ) ] = 0;
+
+		if ( line[ 0 ] == ';' || line[ 0 ] == 0 )
+		{
+			continue;
+		}
+
+		long long iSize, iOffset, iTime;
+		int iFill;
+
+		if ( bHeader == false )
+		{
+			bHeader = true;
+			bMatch = sscanf( line, "size %lld fill %d time %lld", &iSize, &iFill, &iTime ) == 3 &&
+					 iSize == iTotalSize && iFill == layout.iFill && iTime == iOutputTime;
+			continue;
+		}
+
+		unsigned long long iHash;
+		int iNameStart = 0;
+
+		if ( iEntry >= layout.entries.size() ||
+			 sscanf( line, "%lld %lld %llx %n", &iOffset, &iSize, &iHash, &iNameStart ) != 3 || iNameStart == 0 )
+		{
+			bMatch = false;
+			break;
+		}
+
+		const JoinEntry& entry = layout.entries[ iEntry ];
+
+		bMatch = iOffset == entry.iOffset && iSize == entry.iSize && entry.name == line + iNameStart;
+		unchanged[ iEntry ] = ( iHash == entry.iHash );
+
+		++iEntry;
+	}
+
+	fclose( fp );
+
+	return bMatch && bHeader && iEntry == layout.entries.size();
+}
+
+//------------------------------------------------------------------------------
+// Copying
+//------------------------------------------------------------------------------
+
+// Part of an input, or a gap to fill, and where it lands in the output.
+struct JoinPiece
+{
+	int iInput;			// index into the layout entries, or -1 to fill
+	int64_t iInOffset;
+	int64_t iOutOffset;
+	int64_t iSize;
+};
+
+// Split a run of the output into pieces of at most iPieceSize bytes.
+static void AddPieces( std::vector< JoinPiece >& pieces, int iInput, int64_t iOutOffset, int64_t iSize, int64_t iPieceSize )
+{
+	int64_t iDone = 0;
+
+	do
+	{
+		JoinPiece piece;
+		piece.iInput = iInput;
+		piece.iInOffset = iDone;
+		piece.iOutOffset = iOutOffset + iDone;
+		piece.iSize = ( iSize - iDone < iPieceSize ) ? iSize - iDone : iPieceSize;
+		pieces.push_back( piece );
+
+		iDone += piece.iSize;
+	}
+	while ( iDone < iSize );
+}
+
+// Copy or fill one piece, with handles of its own so pieces can be done at once.
+static bool CopyPiece( const JoinPiece& piece, const JoinLayout& layout, const char* pOutputName )
+{
+	RawFile output;
+	if ( OpenOutputFile( &output, pOutputName, false ) == false )
+	{
+		return false;
+	}
+
+	bool bOK;
+
+	if ( piece.iInput < 0 )
+	{
+		bOK = FillFileData( &output, piece.iOutOffset, piece.iSize, static_cast<uint8_t>( layout.iFill ) );
+	}
+	else
+	{
+		RawFile input;
+		bOK = OpenInputFile( &input, layout.entries[ piece.iInput ].name.c_str() );
+
+		if ( bOK )
+		{
+			bOK = CopyFileData( &output, piece.iOutOffset, &input, piece.iInOffset, piece.iSize );
+			CloseRawFile( &input );
+		}
+	}
+
+	CloseRawFile( &output );
+
+	return bOK;
+}
+
+//------------------------------------------------------------------------------
+// Join
+//------------------------------------------------------------------------------
+int Join( int argc, char** argv )
+{
+	std::vector< const char* > names;
+	const char* pLayoutName = nullptr;
+	const char* pIncludeName = nullptr;
+
+	enum eOption
+	{
+		NONE,
+		OPT_LAYOUT,
+		OPT_INCLUDE,
+	};
+
+	eOption specialNextArg = NONE;
+
+	// defaults.
+	bool bOptParallel = false;
+	bool bOptIncremental = false;
+
+	// parse arguments (after the tool name)
+	for ( int i = 2; i < argc; ++i )
+	{
+		const char* pArg = argv[ i ];
+
+		if ( specialNextArg != NONE )
+		{
+			switch ( specialNextArg )
+			{
+
+			case OPT_LAYOUT:
+				pLayoutName = pArg;
+				break;
+
+			case OPT_INCLUDE:
+				pIncludeName = pArg;
+				break;
+
+			}
+
+			specialNextArg = NONE;
+		}
+		else if ( *pArg == '-' )
+		{
+			if ( _stricmp( pArg, "-parallel" ) == 0 )
+			{
+				bOptParallel = true;
+			}
+			else if ( _stricmp( pArg, "-incremental" ) == 0 )
+			{
+				bOptIncremental = true;
+			}
+			else if ( _stricmp( pArg, "-layout" ) == 0 )
+			{
+				specialNextArg = OPT_LAYOUT;
+			}
+			else if ( _stricmp( pArg, "-include" ) == 0 )
+			{
+				specialNextArg = OPT_INCLUDE;
+			}
+			else
+			{
+				// error.
+				PrintHelp( "join" );
+				return 1;
+			}
+		}
+		else
+		{
+			names.push_back( pArg );
+		}
+	}
+
+	// ... the output comes last, after any inputs.
+	if ( names.empty() || specialNextArg != NONE || ( pLayoutName ? names.size() != 1 : names.size() < 2 ) )
+	{
+		PrintHelp( "join" );
 		return 1;
 	}
 
-	if ( argc - 3 == 1 )
+	const char* pOutputName = names.back();
+	names.pop_back();
+
+	JoinLayout layout;
+	layout.iFill = 0;
+	layout.iMaxSize = -1;
+	layout.iSize = -1;
+
+	if ( pLayoutName )
 	{
-		Info( "Copying \"%s\" to \"%s\" ... ", argv[ 2 ], pOutputName );
+		if ( ReadJoinLayout( layout, pLayoutName ) == false )
+		{
+			return 1;
+		}
+
+		if ( layout.entries.empty() )
+		{
+			PrintError( "No input files in layout \"%s\"", pLayoutName );
+			return 1;
+		}
 	}
 	else
 	{
-		Info( "Joining %d files. Writing \"%s\" ... ", argc - 3, pOutputName );
+		for ( const char* pName : names )
+		{
+			AddJoinEntry( layout, pName );
+		}
 	}
 
-	// ... all inputs
-	for ( int arg = 2; arg < argc - 1; ++arg )
+	const int iInputCount = static_cast<int>( layout.entries.size() );
+
+	// ... size every input first, so the output can be sized up front and each
+	// input's place in it is known.
+	const int64_t iPieceSize = bOptParallel ? kJoinPieceSize : INT64_MAX;
+	std::vector< JoinPiece > pieces;
+	int64_t iTotalSize = 0;
+
+	for ( int i = 0; i < iInputCount; ++i )
 	{
-		const char* pInputName = argv[ arg ];
-		FILE* fp_in;
+		JoinEntry& entry = layout.entries[ i ];
 
-		err = fopen_s( &fp_in, pInputName, "rb" );
-		if ( err != 0 || fp_in == nullptr )
+		if ( StatFileSize( entry.name.c_str(), &entry.iSize ) == false )
 		{
-			printf( "FAILED\n" );
-			PrintError( "Cannot open input file \"%s\"", pInputName );
-			fclose( fp_out );
+			PrintError( "Cannot open input file \"%s\"", entry.name.c_str() );
 			return 1;
 		}
+
+		if ( entry.iAt >= 0 )
+		{
+			if ( entry.iAt < iTotalSize )
+			{
+				PrintError( "\"%s\" at $%llX overlaps the file before, which ends at $%llX.",
+							entry.name.c_str(), static_cast<long long>( entry.iAt ), static_cast<long long>( iTotalSize ) );
+				return 1;
+			}
+
+			entry.iOffset = entry.iAt;
+		}
 		else
 		{
-			// ... copy data
-			while ( feof( fp_in ) == 0 )
+			entry.iOffset = ( iTotalSize + entry.iAlign - 1 ) / entry.iAlign * entry.iAlign;
+		}
+
+		// ... a new file reads as zero, so only other fill bytes need writing.
+		if ( entry.iOffset > iTotalSize && layout.iFill != 0 )
+		{
+			AddPieces( pieces, -1, iTotalSize, entry.iOffset - iTotalSize, iPieceSize );
+		}
+
+		AddPieces( pieces, i, entry.iOffset, entry.iSize, iPieceSize );
+
+		iTotalSize = entry.iOffset + entry.iSize;
+	}
+
+	if ( layout.iSize >= 0 )
+	{
+		if ( iTotalSize > layout.iSize )
+		{
+			PrintError( "The files need %lld bytes, more than the size of %lld.",
+						static_cast<long long>( iTotalSize ), static_cast<long long>( layout.iSize ) );
+			return 1;
+		}
+
+		if ( layout.iSize > iTotalSize && layout.iFill != 0 )
+		{
+			AddPieces( pieces, -1, iTotalSize, layout.iSize - iTotalSize, iPieceSize );
+		}
+
+		iTotalSize = layout.iSize;
+	}
+
+	if ( layout.iMaxSize >= 0 && iTotalSize > layout.iMaxSize )
+	{
+		PrintError( "The output would be %lld bytes, more than the maximum of %lld.",
+					static_cast<long long>( iTotalSize ), static_cast<long long>( layout.iMaxSize ) );
+		return 1;
+	}
+
+	if ( pIncludeName )
+	{
+		for ( int i = 0; i < iInputCount; ++i )
+		{
+			for ( int j = 0; j < i; ++j )
 			{
-				int input = fgetc( fp_in );
+				if ( layout.entries[ i ].label == layout.entries[ j ].label )
+				{
+					PrintError( "\"%s\" and \"%s\" would both be called %s.",
+								layout.entries[ j ].name.c_str(), layout.entries[ i ].name.c_str(), layout.entries[ i ].label.c_str() );
+					return 1;
+				}
+			}
+		}
+	}
+
+	// ... with -incremental, keep only the inputs that changed, if the output
+	// was made from the same layout last time.
+	char manifestName[ 1024 ];
+	snprintf( manifestName, sizeof( manifestName ), "%s.join", pOutputName );
+
+	bool bUpdate = false;
+	int iChanged = iInputCount;
+
+	if ( bOptIncremental )
+	{
+		if ( HashJoinInputs( layout ) == false )
+		{
+			return 1;
+		}
+
+		int64_t iOldSize;
+		int64_t iOldTime;
+		std::vector< char > unchanged;
 
-				if ( input == EOF )
-					break;
+		// ... an output changed by anything else is written in full.
+		if ( StatFileSize( pOutputName, &iOldSize ) && iOldSize == iTotalSize && StatFileTime( pOutputName, &iOldTime ) &&
+			 MatchJoinManifest( manifestName, layout, iTotalSize, iOldTime, unchanged ) )
+		{
+			bUpdate = true;
+			iChanged = 0;
 
-				fputc( input, fp_out );
+			for ( int i = 0; i < iInputCount; ++i )
+			{
+				iChanged += unchanged[ i ] ? 0 : 1;
+			}
+
+			// ... gaps are the same too, so only the changed inputs are left.
+			std::vector< JoinPiece > changed;
+			for ( const JoinPiece& piece : pieces )
+			{
+				if ( piece.iInput >= 0 && unchanged[ piece.iInput ] == 0 )
+				{
+					changed.push_back( piece );
+				}
 			}
 
-			fclose( fp_in );
+			pieces.swap( changed );
 		}
+
+		// ... don't leave a manifest that could describe a half written output.
+		remove( manifestName );
 	}
 
-	// Tidy up
-	printf( "OK\n" );
-	fclose( fp_out );
+	// ... output file
+	if ( bUpdate == false )
+	{
+		RawFile output;
+		if ( CreateOutputFile( &output, pOutputName, iTotalSize ) == false )
+		{
+			PrintError( "Cannot open output file \"%s\"", pOutputName );
+			return 1;
+		}
+
+		CloseRawFile( &output );
+	}
+
+	if ( bUpdate )
+	{
+		Info( "Updating %d of %d files in \"%s\" ... ", iChanged, iInputCount, pOutputName );
+	}
+	else if ( iInputCount == 1 && pLayoutName == nullptr )
+	{
+		Info( "Copying \"%s\" to \"%s\" ... ", names[ 0 ], pOutputName );
+	}
+	else
+	{
+		Info( "Joining %d files. Writing \"%s\" ... ", iInputCount, pOutputName );
+	}
+
+	// ... all inputs
+	const int iPieceCount = static_cast<int>( pieces.size() );
+	std::vector< char > failed( iPieceCount, 0 );
+
+	auto copy = [ & ]( int i )
+	{
+		failed[ i ] = ( CopyPiece( pieces[ i ], layout, pOutputName ) == false );
+	};
+
+	if ( bOptParallel )
+	{
+		ParallelFor( iPieceCount, copy );
+	}
+	else
+	{
+		for ( int i = 0; i < iPieceCount; ++i )
+		{
+			copy( i );
+
+			if ( failed[ i ] )
+			{
+				break;
+			}
+		}
+	}
+
+	for ( int i = 0; i < iPieceCount; ++i )
+	{
+		if ( failed[ i ] )
+		{
+			printf( "FAILED\n" );
+
+			if ( pieces[ i ].iInput < 0 )
+			{
+				PrintError( "Cannot write output file \"%s\"", pOutputName );
+			}
+			else
+			{
+				PrintError( "Cannot copy input file \"%s\"", layout.entries[ pieces[ i ].iInput ].name.c_str() );
+			}
+
+			return 1;
+		}
+	}
+
+	printf( "OK (%lld bytes)\n", static_cast<long long>( iTotalSize ) );
+
+	int64_t iOutputTime;
+	if ( bOptIncremental && ( StatFileTime( pOutputName, &iOutputTime ) == false ||
+							  WriteJoinManifest( manifestName, layout, iTotalSize, iOutputTime ) == false ) )
+	{
+		PrintError( "Cannot write manifest file \"%s\"", manifestName );
+		return 1;
+	}
+
+	if ( pIncludeName && WriteJoinInclude( pIncludeName, pOutputName, layout, iTotalSize ) == false )
+	{
+		PrintError( "Cannot write include file \"%s\"", pIncludeName );
+		return 1;
+	}
 
 	return 0;
 }
 
 //==============================================================================
-
@@ -0,0 +1,547 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+#include "utils.h"
+#include "fileio.h"
+#include "lz.h"
+
+// Matches are found in chunks of this many positions, one chunk per task.
+static const int kLzChunkSize = 4096;
+
+// Hash chain candidates tried per position for long offsets.
+static const int kLzMaxChainDepth = 256;
+
+static const int kLzHashBits = 16;
+
+// Cost of something that can't be encoded.
+static const int kLzInfinity = 0x3FFFFFFF;
+
+//------------------------------------------------------------------------------
+// Match Finder
+//------------------------------------------------------------------------------
+//
+// Every offset in a class costs the same, so only the longest match of each
+// class matters to the parse: one with a short (1 byte) offset and one with a
+// long (2 byte) offset.
+
+struct LzMatches
+{
+	std::vector< int > shortLength;
+	std::vector< int > shortOffset;
+	std::vector< int > longLength;
+	std::vector< int > longOffset;
+};
+
+static int MaxMatch( int iPos, int iInputSize )
+{
+	int iMax = iInputSize - iPos;
+	return ( iMax > kLzMaxCount ) ? kLzMaxCount : iMax;
+}
+
+// Short offsets: the length of the match at offset d is kept for every d,
+// working backwards, so it's exact and costs 256 compares per position.
+static void FindShortMatches( LzMatches& matches, const uint8_t* pInput, int iInputSize )
+{
+	std::vector< int > run( kLzShortWindow + 1, 0 );
+
+	for ( int iPos = iInputSize - 1; iPos >= 0; --iPos )
+	{
+		const int iMax = MaxMatch( iPos, iInputSize );
+		const int iWindow = ( iPos < kLzShortWindow ) ? iPos : kLzShortWindow;
+
+		int iBest = 0;
+		int iBestOffset = 0;
+
+		for ( int d = 1; d <= iWindow; ++d )
+		{
+			run[ d ] = ( pInput[ iPos ] == pInput[ iPos - d ] ) ? run[ d ] + 1 : 0;
+
+			const int iLength = ( run[ d ] < iMax ) ? run[ d ] : iMax;
+			if ( iLength > iBest )
+			{
+				iBest = iLength;
+				iBestOffset = d;
+			}
+		}
+
+		matches.shortLength[ iPos ] = iBest;
+		matches.shortOffset[ iPos ] = iBestOffset;
+	}
+}
+
+static uint32_t Hash3( const uint8_t* p )
+{
+	const uint32_t v = p[ 0 ] | ( p[ 1 ] << 8 ) | ( p[ 2 ] << 16 );
+	return ( v * 2654435761u ) >> ( 32 - kLzHashBits );
+}
+
+// Long offsets: hash chains of 3 byte prefixes, searched in parallel. Only a
+// match longer than the short one is worth keeping.
+static void FindLongMatches( LzMatches& matches, const uint8_t* pInput, int iInputSize )
+{
+	std::vector< int > prev( iInputSize, -1 );
+
+	{
+		std::vector< int > head( 1 << kLzHashBits, -1 );
+
+		for ( int iPos = 0; iPos + kLzMinMatch <= iInputSize; ++iPos )
+		{
+			const uint32_t h = Hash3( pInput + iPos );
+			prev[ iPos ] = head[ h ];
+			head[ h ] = iPos;
+		}
+	}
+
+	const int iChunks = ( iInputSize + kLzChunkSize - 1 ) / kLzChunkSize;
+
+	ParallelFor( iChunks, [ & ]( int iChunk )
+	{
+		const int iStart = iChunk * kLzChunkSize;
+		const int iEnd = ( iStart + kLzChunkSize < iInputSize ) ? iStart + kLzChunkSize : iInputSize;
+
+		for ( int iPos = iStart; iPos < iEnd; ++iPos )
+		{
+			const int iMax = MaxMatch( iPos, iInputSize );
+
+			int iBest = matches.shortLength[ iPos ];
+			int iBestOffset = 0;
+
+			if ( iBest < kLzMinMatch - 1 )
+			{
+				iBest = kLzMinMatch - 1;
+			}
+
+			int iDepth = 0;
+
+			for ( int iCandidate = prev[ iPos ];
+				  iCandidate >= 0 && iPos - iCandidate <= kLzWindow && iBest < iMax && iDepth < kLzMaxChainDepth;
+				  iCandidate = prev[ iCandidate ], ++iDepth )
+			{
+				// ... short offsets are already covered.
+				if ( iPos - iCandidate <= kLzShortWindow || pInput[ iCandidate + iBest ] != pInput[ iPos + iBest ] )
+				{
+					continue;
+				}
+
+				int iLength = 0;
+				while ( iLength < iMax && pInput[ iCandidate + iLength ] == pInput[ iPos + iLength ] )
+				{
+					++iLength;
+				}
+
+				if ( iLength > iBest )
+				{
+					iBest = iLength;
+					iBestOffset = iPos - iCandidate;
+				}
+			}
+
+			matches.longLength[ iPos ] = iBestOffset ? iBest : 0;
+			matches.longOffset[ iPos ] = iBestOffset;
+		}
+	} );
+}
+
+//------------------------------------------------------------------------------
+// Optimal Parse
+//------------------------------------------------------------------------------
+//
+// Working backwards, with
+//
+//   T[i] = bytes to encode from i, starting a new token at i
+//   M[j] = bytes for a match at j (offset and length) plus T[j + length]
+//
+// T[i] = 1 + min over k of ( literal count cost(k) + k + M[i + k] ) and
+// M[j] = min over class and length L of ( offset cost + length cost(L) +
+// T[j + L] ). The count and length costs are constant over a few ranges of k
+// and L, so each is a handful of range minimum queries. M[n] is the end
+// marker.
+
+// Range minimum over values filled in from the back, returning the position
+// of the minimum too. Ties go to the position furthest from the query start.
+struct LzMinTree
+{
+	int iSize;
+	bool bPreferHigh;
+	std::vector< int > value;
+	std::vector< int > pos;
+
+	LzMinTree( int iCount, bool bHigh ) :
+
+		iSize( 1 ),
+		bPreferHigh( bHigh )
+	{
+		while ( iSize < iCount )
+		{
+			iSize *= 2;
+		}
+
+		value.assign( iSize * 2, kLzInfinity );
+		pos.assign( iSize * 2, -1 );
+	}
+
+	bool Better( int a, int b ) const
+	{
+		if ( value[ a ] != value[ b ] )
+		{
+			return value[ a ] < value[ b ];
+		}
+
+		return bPreferHigh ? ( pos[ a ] > pos[ b ] ) : ( pos[ a ] < pos[ b ] );
+	}
+
+	void Set( int i, int v )
+	{
+		int n = i + iSize;
+		value[ n ] = v;
+		pos[ n ] = i;
+
+		for ( n /= 2; n >= 1; n /= 2 )
+		{
+			const int iBetter = Better( n * 2, n * 2 + 1 ) ? n * 2 : n * 2 + 1;
+			value[ n ] = value[ iBetter ];
+			pos[ n ] = pos[ iBetter ];
+		}
+	}
+
+	// Minimum over [iFirst, iLast]. Returns kLzInfinity for an empty range.
+	int Query( int iFirst, int iLast, int& iPos ) const
+	{
+		int iBestNode = 0;	// value[ 0 ] is never set, so it's infinity.
+		iPos = -1;
+
+		for ( int lo = iFirst + iSize, hi = iLast + iSize + 1; lo < hi; lo /= 2, hi /= 2 )
+		{
+			if ( lo & 1 )
+			{
+				iBestNode = Better( lo, iBestNode ) ? lo : iBestNode;
+				++lo;
+			}
+
+			if ( hi & 1 )
+			{
+				--hi;
+				iBestNode = Better( hi, iBestNode ) ? hi : iBestNode;
+			}
+		}
+
+		iPos = pos[ iBestNode ];
+		return value[ iBestNode ];
+	}
+};
+
+// The cheapest of the ranges [iFirst, iLast] split where the extra bytes change.
+// Each range is tested as [iBase + a, iBase + b], clipped to iLimit.
+struct LzRange
+{
+	int a;
+	int b;
+	int iExtra;
+};
+
+static int QueryRanges( const LzMinTree& tree, const LzRange* pRanges, int iRanges, int iBase, int iLimit, int& iBestPos )
+{
+	int iBest = kLzInfinity;
+	iBestPos = -1;
+
+	for ( int r = 0; r < iRanges; ++r )
+	{
+		const int iFirst = iBase + pRanges[ r ].a;
+		int iLast = iBase + pRanges[ r ].b;
+
+		if ( iLast > iLimit )
+		{
+			iLast = iLimit;
+		}
+
+		if ( iFirst > iLast )
+		{
+			continue;
+		}
+
+		int iPos;
+		int iValue = tree.Query( iFirst, iLast, iPos );
+
+		if ( iValue < kLzInfinity && iValue + pRanges[ r ].iExtra < iBest )
+		{
+			iBest = iValue + pRanges[ r ].iExtra;
+			iBestPos = iPos;
+		}
+	}
+
+	return iBest;
+}
+
+static void WriteCount( std::vector< uint8_t >& output, int iCount )
+{
+	if ( iCount <= 255 )
+	{
+		output.push_back( static_cast<uint8_t>( iCount ) );
+	}
+	else
+	{
+		output.push_back( 0 );
+		output.push_back( iCount & 0xFF );
+		output.push_back( iCount >> 8 );
+	}
+}
+
+bool EncodeLzBuffer( std::vector< uint8_t >& output, const uint8_t* pInput, int iInputSize )
+{
+	const int n = iInputSize;
+
+	LzMatches matches;
+	matches.shortLength.assign( n, 0 );
+	matches.shortOffset.assign( n, 0 );
+	matches.longLength.assign( n, 0 );
+	matches.longOffset.assign( n, 0 );
+
+	FindShortMatches( matches, pInput, n );
+	FindLongMatches( matches, pInput, n );
+
+	// ... T and G = position + M, each with its own range minimum tree.
+	LzMinTree tokenTree( n + 1, true );		// prefer longer matches
+	LzMinTree matchTree( n + 1, false );	// prefer fewer literals
+
+	std::vector< int > literalChoice( n + 1 );
+	std::vector< int > matchEnd( n + 1, -1 );
+	std::vector< bool > matchLong( n + 1, false );
+
+	static const LzRange kLiteralRanges[] =
+	{
+		{ 0, 6, 0 },
+		{ 7, 255, 1 },
+		{ 256, kLzMaxCount, 3 },
+	};
+
+	static const LzRange kLengthRanges[] =
+	{
+		{ kLzMinMatch, 17, 0 },
+		{ 18, 255, 1 },
+		{ 256, kLzMaxCount, 3 },
+	};
+
+	for ( int i = n; i >= 0; --i )
+	{
+		int M = kLzInfinity;
+
+		if ( i == n )
+		{
+			// ... the end marker.
+			M = 2;
+		}
+		else
+		{
+			for ( int iClass = 0; iClass < 2; ++iClass )
+			{
+				const int iLength = iClass ? matches.longLength[ i ] : matches.shortLength[ i ];
+				if ( iLength < kLzMinMatch )
+				{
+					continue;
+				}
+
+				int iEnd;
+				int iCost = QueryRanges( tokenTree, kLengthRanges, 3, i, i + iLength, iEnd );
+
+				if ( iCost < kLzInfinity && iCost + 1 + iClass < M )
+				{
+					M = iCost + 1 + iClass;
+					matchEnd[ i ] = iEnd;
+					matchLong[ i ] = ( iClass != 0 );
+				}
+			}
+		}
+
+		if ( M < kLzInfinity )
+		{
+			matchTree.Set( i, i + M );
+		}
+
+		int iMatchPos;
+		int T = QueryRanges( matchTree, kLiteralRanges, 3, i, n, iMatchPos );
+
+		if ( T < kLzInfinity )
+		{
+			literalChoice[ i ] = iMatchPos;
+			tokenTree.Set( i, T - i + 1 );
+		}
+		else if ( i == 0 )
+		{
+			return false;
+		}
+	}
+
+	// Walk the choices forwards.
+	int i = 0;
+
+	for ( ; ; )
+	{
+		const int j = literalChoice[ i ];
+		const int k = j - i;
+		const bool bEnd = ( j == n );
+		const bool bLong = bEnd || matchLong[ j ];
+		const int L = bEnd ? 0 : matchEnd[ j ] - j;
+
+		uint8_t token = bLong ? 0x80 : 0x00;
+		token |= ( ( k < 7 ) ? k : 7 ) << 4;
+
+		if ( bEnd == false )
+		{
+			token |= ( L - kLzMinMatch < 15 ) ? L - kLzMinMatch : 15;
+		}
+
+		output.push_back( token );
+
+		if ( k >= 7 )
+		{
+			WriteCount( output, k );
+		}
+
+		output.insert( output.end(), pInput + i, pInput + j );
+
+		if ( bEnd )
+		{
+			output.push_back( 0 );
+			output.push_back( 0 );
+			break;
+		}
+
+		const int iOffset = bLong ? matches.longOffset[ j ] : matches.shortOffset[ j ];
+
+		output.push_back( ( 65536 - iOffset ) & 0xFF );
+
+		if ( bLong )
+		{
+			output.push_back( ( ( 65536 - iOffset ) >> 8 ) & 0xFF );
+		}
+
+		if ( L - kLzMinMatch >= 15 )
+		{
+			WriteCount( output, L );
+		}
+
+		i = j + L;
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// LZ
+//------------------------------------------------------------------------------
+int LZ( int argc, char** argv )
+{
+	const char* pInputName = nullptr;
+	const char* pOutputName = nullptr;
+
+	// defaults.
+	bool bOptAppend = false;
+
+	// parse arguments (after the tool name)
+	for ( int i = 2; i < argc; ++i )
+	{
+		const char* pArg = argv[ i ];
+
+		if ( *pArg == '-' )
+		{
+			if ( _stricmp( pArg, "-append" ) == 0 )
+			{
+				bOptAppend = true;
+			}
+			else
+			{
+				// error.
+				PrintHelp( "lz" );
+				return 1;
+			}
+		}
+		else if ( pInputName == nullptr )
+		{
+			pInputName = pArg;
+		}
+		else if ( pOutputName == nullptr )
+		{
+			pOutputName = pArg;
+		}
+		else
+		{
+			// error.
+			PrintHelp( "lz" );
+			return 1;
+		}
+	}
+
+	if ( pInputName == nullptr || pOutputName == nullptr )
+	{
+		PrintHelp( "lz" );
+		return 1;
+	}
+
+	MappedFile input;
+	if ( MapFile( &input, pInputName ) == false )
+	{
+		PrintError( "Cannot open input file \"%s\"", pInputName );
+		return 1;
+	}
+
+	const int iInputSize = static_cast<int>( input.iSize );
+
+	Info( "Compressing \"%s\" ... ", pInputName );
+
+	std::vector< uint8_t > encoded;
+	if ( EncodeLzBuffer( encoded, input.pData, iInputSize ) == false )
+	{
+		printf( "FAILED\n" );
+		PrintError( "More than %d bytes in a row have no match, so can't be encoded.", kLzMaxCount );
+		UnmapFile( &input );
+		return 1;
+	}
+
+	UnmapFile( &input );
+
+	// ... output file
+	FILE* fp_out;
+	int err = fopen_s( &fp_out, pOutputName, bOptAppend ? "ab" : "wb" );
+	if ( err != 0 || fp_out == nullptr )
+	{
+		printf( "FAILED\n" );
+		PrintError( "Cannot open output file \"%s\"", pOutputName );
+		return 1;
+	}
+
+	fwrite( encoded.data(), 1, encoded.size(), fp_out );
+	fclose( fp_out );
+
+	printf( "OK (%d -> %d bytes)\n", iInputSize, static_cast<int>( encoded.size() ) );
+
+	return 0;
+}
+
+//==============================================================================
@@ -0,0 +1,59 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// LZ Format
+//------------------------------------------------------------------------------
+//
+// Written by the 'lz' tool and read by Extras/lz_decompress.z80. The data is a
+// sequence of tokens, each some literal bytes followed by a match:
+//
+//   token    O LLL MMMM
+//   [count]  if LLL is 7: a byte holding the literal count (7-255), or 00 and
+//            then a 16-bit count
+//   literals
+//   offset   O = 0: one byte, 256 - offset (offsets 1-256)
+//            O = 1: two bytes, 65536 - offset (offsets 257-32768)
+//   [length] if MMMM is 15: a byte holding the match length (18-255), or 00
+//            and then a 16-bit length. Otherwise the length is MMMM + 3.
+//
+// A long offset of 0000 ends the data, so the last token is only literals.
+// 16-bit values are little-endian. Matches may overlap the bytes they copy.
+
+static const int kLzMinMatch = 3;
+static const int kLzShortWindow = 256;
+static const int kLzWindow = 32768;
+static const int kLzMaxCount = 65535;		// longest literal run or match
+
+// Compress a buffer, appending to output. Returns false if the input can't be
+// encoded (more than kLzMaxCount bytes in a row with no match).
+bool EncodeLzBuffer( std::vector< uint8_t >& output, const uint8_t* pInput, int iInputSize );
+
+//==============================================================================
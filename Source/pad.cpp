@@ -24,27 +24,217 @@ SOFTWARE.
 */
 
 #include <cstdio>
+#include <cstring>
+#include <vector>
 
 #include "utils.h"
+#include "fileio.h"
+
+// How each file's new size is chosen.
+enum ePadMode
+{
+	PAD_SIZE,			// a fixed size
+	PAD_ALIGN,			// round up to a multiple of a size
+	PAD_POW2,			// round up to a power of two
+};
+
+// What happened to one file.
+enum ePadResult
+{
+	PAD_OK,
+	PAD_TOO_BIG,		// already larger than the size asked for
+	PAD_MISSING,		// -align and -pow2 need an existing file
+	PAD_ERROR,			// couldn't be opened or written
+};
+
+struct PadFileResult
+{
+	ePadResult result;
+	bool bNewFile;
+	int64_t iOldSize;
+	int64_t iNewSize;
+};
+
+// The size a file of iSize bytes should be padded to.
+static int64_t PadTarget( ePadMode mode, int64_t iValue, int64_t iSize )
+{
+	switch ( mode )
+	{
+
+	case PAD_ALIGN:
+		return ( iSize + iValue - 1 ) / iValue * iValue;
+
+	case PAD_POW2:
+	{
+		// ... an empty file stays empty, as with -align.
+		if ( iSize == 0 )
+		{
+			return 0;
+		}
+
+		int64_t iTarget = 1;
+		while ( iTarget < iSize )
+		{
+			iTarget <<= 1;
+		}
+
+		return iTarget;
+	}
+
+	default:
+		return iValue;
+
+	}
+}
+
+// Pad one file. Growing the file fills it with zeros, as a hole where the
+// system allows, so only other fill bytes need writing.
+static void PadFile( PadFileResult& out, const char* pName, ePadMode mode, int64_t iValue, int iFillByte )
+{
+	int64_t iSize;
+	out.bNewFile = ( StatFileSize( pName, &iSize ) == false );
+	out.iOldSize = 0;
+	out.iNewSize = 0;
+
+	if ( out.bNewFile && mode != PAD_SIZE )
+	{
+		out.result = PAD_MISSING;
+		return;
+	}
+
+	// ... open file for writing, creating it if needed.
+	RawFile file;
+	if ( OpenOutputFile( &file, pName, true ) == false )
+	{
+		out.result = PAD_ERROR;
+		return;
+	}
+
+	out.iOldSize = file.iSize;
+	out.iNewSize = PadTarget( mode, iValue, file.iSize );
+
+	if ( out.iOldSize > out.iNewSize )
+	{
+		out.result = PAD_TOO_BIG;
+	}
+	else if ( SetFileSize( &file, out.iNewSize ) &&
+			  ( iFillByte == 0 || FillFileData( &file, out.iOldSize, out.iNewSize - out.iOldSize, static_cast<uint8_t>( iFillByte ) ) ) )
+	{
+		out.result = PAD_OK;
+	}
+	else
+	{
+		out.result = PAD_ERROR;
+	}
+
+	CloseRawFile( &file );
+}
 
 //------------------------------------------------------------------------------
 // Pad
 //------------------------------------------------------------------------------
 int Pad( int argc, char** argv )
 {
-	if ( argc < 4 || argc > 5 )
+	std::vector< const char* > files;
+
+	enum eOption
+	{
+		NONE,
+		OPT_SIZE,
+		OPT_ALIGN,
+		OPT_FILL,
+	};
+
+	eOption specialNextArg = NONE;
+
+	// defaults.
+	bool bOptMode = false;
+	ePadMode mode = PAD_SIZE;
+	int64_t iValue = 0;
+	int iFillByte = 0x00;
+	const char* pSize = nullptr;
+	const char* pFill = nullptr;
+
+	// parse arguments (after the tool name)
+	for ( int i = 2; i < argc; ++i )
+	{
+		const char* pArg = argv[ i ];
+
+		if ( specialNextArg != NONE )
+		{
+			switch ( specialNextArg )
+			{
+
+			case OPT_SIZE:
+			case OPT_ALIGN:
+				pSize = pArg;
+				break;
+
+			case OPT_FILL:
+				pFill = pArg;
+				break;
+
+			}
+
+			specialNextArg = NONE;
+		}
+		else if ( *pArg == '-' )
+		{
+			if ( _stricmp( pArg, "-size" ) == 0 )
+			{
+				bOptMode = true;
+				mode = PAD_SIZE;
+				specialNextArg = OPT_SIZE;
+			}
+			else if ( _stricmp( pArg, "-align" ) == 0 )
+			{
+				bOptMode = true;
+				mode = PAD_ALIGN;
+				specialNextArg = OPT_ALIGN;
+			}
+			else if ( _stricmp( pArg, "-pow2" ) == 0 )
+			{
+				bOptMode = true;
+				mode = PAD_POW2;
+			}
+			else if ( _stricmp( pArg, "-fill" ) == 0 )
+			{
+				specialNextArg = OPT_FILL;
+			}
+			else
+			{
+				// error.
+				PrintHelp( "pad" );
+				return 1;
+			}
+		}
+		else
+		{
+			files.push_back( pArg );
+		}
+	}
+
+	// ... without -size, -align or -pow2: pad <file> size [fill]
+	if ( bOptMode == false && pFill == nullptr && ( files.size() == 2 || files.size() == 3 ) )
+	{
+		pSize = files[ 1 ];
+		pFill = ( files.size() == 3 ) ? files[ 2 ] : nullptr;
+		files.resize( 1 );
+	}
+	else if ( bOptMode == false || files.empty() )
 	{
 		PrintHelp( "pad" );
 		return 1;
 	}
 
-	const char* pFile = argv[ 2 ];
-	const char* pSize = argv[ 3 ];
+	if ( specialNextArg != NONE )
+	{
+		PrintHelp( "pad" );
+		return 1;
+	}
 
-	int iFillByte = 0x00; // Default
-	if ( argc == 5 )
+	if ( pFill )
 	{
-		const char* pFill = argv[ 4 ];
 		iFillByte = ParseValue( pFill, 255 );
 
 		if ( iFillByte < 0 )
@@ -55,76 +245,119 @@ int Pad( int argc, char** argv )
 	}
 
 	// ... determine size.
-	int64_t iNewSize = ParseSizeWithSuffix( pSize );
-	if ( iNewSize < 0 )
+	if ( mode != PAD_POW2 )
 	{
-		PrintError( "Invalid size \"%s\"", pSize );
-		return 1;
+		iValue = ParseSizeWithSuffix( pSize );
+		if ( iValue < 0 || ( mode == PAD_ALIGN && iValue == 0 ) )
+		{
+			PrintError( "Invalid size \"%s\"", pSize );
+			return 1;
+		}
 	}
 
-	int err;
-	FILE* fp;
-	bool bNewFile = false;
+	const int iFileCount = static_cast<int>( files.size() );
+	std::vector< PadFileResult > results( iFileCount );
 
-	// ... file exists?
-	err = fopen_s( &fp, pFile, "r" );
-	if ( err != 0 || fp == nullptr )
+	// Say hello
+	if ( iFileCount == 1 && mode == PAD_SIZE )
+	{
+		int64_t iSize;
+		if ( StatFileSize( files[ 0 ], &iSize ) == false )
+		{
+			Info( "Creating \"%s\" with %lld bytes of 0x%02X ... ", files[ 0 ], static_cast<long long>( iValue ), iFillByte );
+		}
+		else
+		{
+			Info( "Padding \"%s\" to %lld bytes with 0x%02X ... ", files[ 0 ], static_cast<long long>( iValue ), iFillByte );
+		}
+	}
+	else if ( iFileCount == 1 )
 	{
-		bNewFile = true;
+		Info( "Padding \"%s\" with 0x%02X ... ", files[ 0 ], iFillByte );
 	}
 	else
 	{
-		fclose( fp );
+		Info( "Padding %d files with 0x%02X ... ", iFileCount, iFillByte );
 	}
 
-	// ... open file for appending
-	err = fopen_s( &fp, pFile, "ab" );
-	if ( err != 0 || fp == nullptr )
+	// Pad !
+	ParallelFor( iFileCount, [ & ]( int i )
 	{
-		PrintError( "Failed to open file \"%s\" for writing.", pFile );
-		return 1;
-	}
+		PadFile( results[ i ], files[ i ], mode, iValue, iFillByte );
+	} );
 
-	// ... seek to the end and measure.
-	fseek( fp, 0, SEEK_END );
-	int64_t iOldSize = ftell( fp );
+	int iFailed = 0;
+	bool bError = false;
 
-	// Say hello
-	if ( bNewFile )
+	for ( const PadFileResult& result : results )
 	{
-		Info( "Creating \"%s\" with %lld bytes of 0x%02X ... ", pFile, iNewSize, iFillByte );
+		iFailed += ( result.result != PAD_OK ) ? 1 : 0;
+		bError |= ( result.result == PAD_ERROR || result.result == PAD_MISSING );
+	}
+
+	if ( iFailed == 0 )
+	{
+		printf( "DONE\n" );
 	}
 	else
 	{
-		Info( "Padding \"%s\" to %lld bytes with 0x%02X ... ", pFile, iNewSize, iFillByte );
+		printf( "FAILED\n" );
 	}
 
-	// Pad !
-	while ( iOldSize < iNewSize )
+	// ... a table of what happened to each file.
+	if ( iFileCount > 1 || mode != PAD_SIZE )
 	{
-		int ret;
-		ret = fputc( iFillByte, fp );
-		if ( ret == EOF )
+		int iNameWidth = 4;
+		for ( const char* pName : files )
 		{
-			break;
+			const int iLength = static_cast<int>( strlen( pName ) );
+			iNameWidth = ( iLength > iNameWidth ) ? iLength : iNameWidth;
 		}
 
-		++iOldSize;
-	}
+		printf( "\n  %-*s  %12s  %12s\n", iNameWidth, "File", "Old size", "New size" );
 
-	if ( iOldSize == iNewSize )
-	{
-		printf( "DONE\n" );
+		for ( int i = 0; i < iFileCount; ++i )
+		{
+			const PadFileResult& result = results[ i ];
+
+			printf( "  %-*s  ", iNameWidth, files[ i ] );
+
+			switch ( result.result )
+			{
+
+			case PAD_OK:
+				if ( result.bNewFile )
+				{
+					printf( "%12s  %12lld\n", "(new)", static_cast<long long>( result.iNewSize ) );
+				}
+				else
+				{
+					printf( "%12lld  %12lld%s\n", static_cast<long long>( result.iOldSize ), static_cast<long long>( result.iNewSize ),
+							( result.iOldSize == result.iNewSize ) ? "  (unchanged)" : "" );
+				}
+				break;
+
+			case PAD_TOO_BIG:
+				printf( "%12lld  %12lld  FAILED: already larger\n", static_cast<long long>( result.iOldSize ), static_cast<long long>( result.iNewSize ) );
+				break;
+
+			case PAD_MISSING:
+				printf( "%12s  %12s  FAILED: doesn't exist\n", "", "" );
+				break;
+
+			case PAD_ERROR:
+				printf( "%12s  %12s  FAILED: can't write\n", "", "" );
+				break;
+
+			}
+		}
 	}
-	else
+	else if ( results[ 0 ].result == PAD_ERROR )
 	{
-		printf( "FAILED\n" );
+		PrintError( "Failed to open file \"%s\" for writing.", files[ 0 ] );
 	}
 
-	fclose( fp );
-
-	return 0;
+	return bError ? 1 : 0;
 }
 
 //==============================================================================
-
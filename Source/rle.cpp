@@ -22,24 +22,157 @@ SOFTWARE.
 
 */
 
+#include <cctype>
+#include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "utils.h"
+#include "fileio.h"
+#include "rle.h"
 
 enum Endian
 {
-	LITTLE_ENDIAN,
-	BIG_ENDIAN
+	ENDIAN_LITTLE,
+	ENDIAN_BIG
+};
+
+// Encoder output. Collects the encoded bytes in memory, or with no buffer
+// attached only counts them (for dry runs).
+struct RleOutput
+{
+	std::vector< uint8_t >* pBuffer;
+	int iSize;
+
+	RleOutput( std::vector< uint8_t >* pBuf ) :
+
+		pBuffer( pBuf ),
+		iSize( 0 )
+	{
+	}
+
+	void Put( uint8_t val )
+	{
+		if ( pBuffer )
+		{
+			pBuffer->push_back( val );
+		}
+
+		++iSize;
+	}
+
+	void Write( const void* pData, int iCount )
+	{
+		if ( pBuffer )
+		{
+			const uint8_t* p = static_cast<const uint8_t*>( pData );
+			pBuffer->insert( pBuffer->end(), p, p + iCount );
+		}
+
+		iSize += iCount;
+	}
+};
+
+// Encoder statistics policy for the normal case. Every hook is empty, so the
+// encoder compiles to exactly what it would be without them.
+struct RleNoStats
+{
+	void Run( int, uint32_t ) {}
+	void Literal( int ) {}
+	void Capped( bool, uint32_t ) {}
+	void Plane( int, int ) {}
+};
+
+// Statistics gathered for -stats.
+struct RleStats
+{
+	int iRunBlocks;
+	int iLiteralBlocks;
+	int64_t iRunBytes;				// input bytes covered by runs
+	int64_t iLiteralBytes;			// input bytes covered by literals
+	int iRunSplits;					// runs continued in a new block because of the length cap
+	int iLiteralSplits;				// literals continued in a new block because of the length cap
+	int64_t iCapBytesLost;			// extra control (and value) bytes those splits cost
+	int runHistogram[ 128 ];
+	int literalHistogram[ 128 ];
+	std::vector< int > planeInput;
+	std::vector< int > planeOutput;
+
+	bool _bRunCapped;
+	bool _bLiteralCapped;
+	uint32_t _capValue;
+
+	RleStats()
+	{
+		iRunBlocks = iLiteralBlocks = 0;
+		iRunBytes = iLiteralBytes = 0;
+		iRunSplits = iLiteralSplits = 0;
+		iCapBytesLost = 0;
+		memset( runHistogram, 0, sizeof( runHistogram ) );
+		memset( literalHistogram, 0, sizeof( literalHistogram ) );
+
+		_bRunCapped = _bLiteralCapped = false;
+		_capValue = 0;
+	}
+
+	void Run( int iLength, uint32_t value )
+	{
+		++iRunBlocks;
+		iRunBytes += iLength;
+		++runHistogram[ iLength < 127 ? iLength : 127 ];
+
+		// ... a new block for the same value only exists because of the cap.
+		if ( _bRunCapped && value == _capValue )
+		{
+			++iRunSplits;
+			iCapBytesLost += 2;
+		}
+
+		_bRunCapped = _bLiteralCapped = false;
+	}
+
+	void Literal( int iLength )
+	{
+		++iLiteralBlocks;
+		iLiteralBytes += iLength;
+		++literalHistogram[ iLength < 127 ? iLength : 127 ];
+
+		if ( _bLiteralCapped )
+		{
+			++iLiteralSplits;
+			iCapBytesLost += 1;
+		}
+
+		_bRunCapped = _bLiteralCapped = false;
+	}
+
+	// The block just written was cut short by the cap.
+	void Capped( bool bRun, uint32_t value )
+	{
+		_bRunCapped = bRun;
+		_bLiteralCapped = !bRun;
+		_capValue = value;
+	}
+
+	void Plane( int iInputSize, int iOutputSize )
+	{
+		planeInput.push_back( iInputSize );
+		planeOutput.push_back( iOutputSize );
+
+		_bRunCapped = _bLiteralCapped = false;
+	}
 };
 
 // Simple RLE encoder.
-template< typename T >
+template< typename T, typename Stats = RleNoStats >
 struct SimpleRleEncoder
 {
-	FILE* fp_out;
+	RleOutput& out;
+	Stats& stats;
 	int _reps;
 	bool _bCtrlIsByte;
 	Endian _endian;
@@ -47,12 +180,13 @@ struct SimpleRleEncoder
 
 	std::vector< T > _rawbuf;
 
-	SimpleRleEncoder( FILE* fp, bool bCtrlIsByte, Endian endian ) :
+	SimpleRleEncoder( RleOutput& output, Stats& statistics, bool bCtrlIsByte, Endian endian ) :
 
+		out( output ),
+		stats( statistics ),
 		_reps( 0 ),
 		_bCtrlIsByte( bCtrlIsByte ),
-		_endian( endian ),
-		fp_out( fp )
+		_endian( endian )
 	{
 		//
 		if ( _bCtrlIsByte )
@@ -81,7 +215,7 @@ struct SimpleRleEncoder
 
 		for ( int i = sizeof( T ) - 1; i >= 0; --i )
 		{
-			fputc( p[i], fp_out );
+			out.Put( p[i] );
 		}
 	}
 
@@ -117,6 +251,7 @@ struct SimpleRleEncoder
 				if ( _reps == _iMaxCount - 1 )
 				{
 					Flush();
+					stats.Capped( true, data );
 				}
 			}
 			else
@@ -134,6 +269,7 @@ struct SimpleRleEncoder
 				if ( _rawbuf.size() == _iMaxCount )
 				{
 					Flush();
+					stats.Capped( false, data );
 				}
 			}
 		}
@@ -149,26 +285,28 @@ struct SimpleRleEncoder
 			{
 				uint8_t ctrl;
 				ctrl = 0x80 | static_cast<uint8_t>( _reps + 1 ); // +1 to count initial ambiguous value
-				fputc( ctrl, fp_out );
+				out.Put( ctrl );
 			}
 			else
 			{
 				T ctrl;
 				ctrl = ( 1 << ( ( sizeof( T ) * 8 ) - 1 ) ) | static_cast< uint8_t >( _reps + 1 ); // +1 to count initial ambiguous value
 
-				if ( _endian == BIG_ENDIAN )
+				if ( _endian == ENDIAN_BIG )
 				{
 					WriteBigEndian( ctrl );
 				}
 				else
 				{
-					fwrite( &ctrl, sizeof( T ), 1, fp_out );
+					out.Write( &ctrl, sizeof( T ) );
 				}
 			}
 			
 			// ... data word
 			T repData = _rawbuf[ 0 ];
-			fwrite( &repData, sizeof( T ), 1, fp_out );
+			out.Write( &repData, sizeof( T ) );
+
+			stats.Run( _reps + 1, repData );
 		}
 		else if ( _rawbuf.empty() == false )
 		{
@@ -178,28 +316,30 @@ struct SimpleRleEncoder
 			{
 				uint8_t ctrl;
 				ctrl = static_cast<uint8_t>( _rawbuf.size() );
-				fputc( ctrl, fp_out );
+				out.Put( ctrl );
 			}
 			else
 			{
 				T ctrl;
 				ctrl = static_cast<T>( _rawbuf.size() );
 				
-				if ( _endian == BIG_ENDIAN )
+				if ( _endian == ENDIAN_BIG )
 				{
 					WriteBigEndian( ctrl );
 				}
 				else
 				{
-					fwrite( &ctrl, sizeof( T ), 1, fp_out );
+					out.Write( &ctrl, sizeof( T ) );
 				}
 			}
 
 			// ... data words
 			for ( T ch : _rawbuf )
 			{
-				fwrite( &ch, sizeof( T ), 1, fp_out );
+				out.Write( &ch, sizeof( T ) );
 			}
+
+			stats.Literal( static_cast<int>( _rawbuf.size() ) );
 		}
 
 		_rawbuf.clear();
@@ -208,34 +348,169 @@ struct SimpleRleEncoder
 
 };
 
-// Simple 8-bit RLE
-static void SimpleRLE8( FILE* fp_out, int iPlanes, uint8_t* pInputData, int iInputSize )
+// Simple 8-bit RLE. With an index, runs are broken at every seek block and the
+// offset of each block is added to pBlockOffsets (if given).
+template< typename Stats >
+static void SimpleRLE8( RleOutput& out, Stats& stats, const RleParams& params, const uint8_t* pInputData, int iInputSize, std::vector< uint32_t >* pBlockOffsets )
 {
-	SimpleRleEncoder< uint8_t > enc8( fp_out, true, LITTLE_ENDIAN );
+	SimpleRleEncoder< uint8_t, Stats > enc8( out, stats, true, ENDIAN_LITTLE );
+
+	const int iPlanes = params.iPlanes;
+
+	// Split, reorder and filter the planes up front so the encoder reads
+	// contiguous memory.
+	std::vector< uint8_t > planeData;
+	PrepareRlePlanes( planeData, pInputData, iInputSize, params );
+
+	const uint8_t* pPlaneData = planeData.data();
 
 	for ( int iPlane = 0; iPlane < iPlanes; ++iPlane )
 	{
 		enc8.BeginPlane();
 
-		// Read input, handle planes here - the encoder is unaware.
-		for ( int iCursor = iPlane; iCursor < iInputSize; iCursor += iPlanes )
+		const int iPlaneSize = PlaneSize( iPlane, iPlanes, iInputSize );
+		const int iPlaneStart = out.iSize;
+
+		for ( int iCursor = 0; iCursor < iPlaneSize; ++iCursor )
 		{
-			const uint8_t* pInput = reinterpret_cast<const uint8_t*>( pInputData + iCursor );
-			enc8.Add( *pInput );
+			if ( params.iIndexBlock > 0 && ( iCursor % params.iIndexBlock ) == 0 )
+			{
+				enc8.Flush();
+
+				if ( pBlockOffsets )
+				{
+					pBlockOffsets->push_back( out.iSize );
+				}
+			}
+
+			enc8.Add( pPlaneData[ iCursor ] );
 		}
 
+		pPlaneData += iPlaneSize;
+
 		enc8.Flush();
 
 		// end of plane.
-		fputc( 0, fp_out );
+		out.Put( 0 );
+
+		stats.Plane( iPlaneSize, out.iSize - iPlaneStart );
+	}
+}
+
+// Nibble RLE (see "Nibble Format" in rle.h). Blocks are chosen by a shortest
+// path over the nibbles of each plane, working backwards. Block lengths are
+// capped, so each nibble only has a few hundred choices to compare.
+static void NibbleRLE( RleOutput& out, const RleParams& params, const uint8_t* pInputData, int iInputSize )
+{
+	const int iPlanes = params.iPlanes;
+
+	std::vector< uint8_t > planeData;
+	PrepareRlePlanes( planeData, pInputData, iInputSize, params );
+
+	const uint8_t* pPlaneData = planeData.data();
+
+	std::vector< uint8_t > nibbles;
+	std::vector< int > run;			// length of the run of equal nibbles from here
+	std::vector< int > cost;		// bytes needed to encode the rest of the plane
+	std::vector< int > choice;		// run length, or minus the literal count
+
+	for ( int iPlane = 0; iPlane < iPlanes; ++iPlane )
+	{
+		const int iPlaneSize = PlaneSize( iPlane, iPlanes, iInputSize );
+		const int n = iPlaneSize * 2;
+
+		nibbles.resize( n );
+		for ( int i = 0; i < iPlaneSize; ++i )
+		{
+			nibbles[ i * 2 ] = pPlaneData[ i ] >> 4;
+			nibbles[ i * 2 + 1 ] = pPlaneData[ i ] & 0x0F;
+		}
+
+		pPlaneData += iPlaneSize;
+
+		run.assign( n + 1, 0 );
+		cost.assign( n + 1, 0 );
+		choice.assign( n + 1, 0 );
+
+		for ( int i = n - 1; i >= 0; --i )
+		{
+			run[ i ] = ( i + 1 < n && nibbles[ i ] == nibbles[ i + 1 ] ) ? run[ i + 1 ] + 1 : 1;
+
+			int iBest = 0x7FFFFFFF;
+
+			for ( int k = 1; k <= kRleNibbleMaxLiteral && i + k <= n; ++k )
+			{
+				const int c = 1 + ( k + 1 ) / 2 + cost[ i + k ];
+				if ( c < iBest )
+				{
+					iBest = c;
+					choice[ i ] = -k;
+				}
+			}
+
+			// ... runs win ties, as they decode faster.
+			const int iMaxRun = ( run[ i ] < kRleNibbleMaxRun ) ? run[ i ] : kRleNibbleMaxRun;
+
+			for ( int L = 2; L <= iMaxRun; ++L )
+			{
+				const int c = ( ( L <= kRleNibbleShortRun ) ? 1 : 2 ) + cost[ i + L ];
+				if ( c <= iBest )
+				{
+					iBest = c;
+					choice[ i ] = L;
+				}
+			}
+
+			cost[ i ] = iBest;
+		}
+
+		for ( int i = 0; i < n; )
+		{
+			if ( choice[ i ] > 0 )
+			{
+				// Uniform data.
+				const int L = choice[ i ];
+				const uint8_t ctrl = 0x80 | static_cast<uint8_t>( nibbles[ i ] << 3 );
+
+				if ( L <= kRleNibbleShortRun )
+				{
+					out.Put( ctrl | static_cast<uint8_t>( L - 2 ) );
+				}
+				else
+				{
+					out.Put( ctrl | 7 );
+					out.Put( static_cast<uint8_t>( L - ( kRleNibbleShortRun + 1 ) ) );
+				}
+
+				i += L;
+			}
+			else
+			{
+				// Noisy data, packed.
+				const int k = -choice[ i ];
+				out.Put( static_cast<uint8_t>( k ) );
+
+				for ( int j = 0; j < k; j += 2 )
+				{
+					const uint8_t lo = ( j + 1 < k ) ? nibbles[ i + j + 1 ] : 0;
+					out.Put( static_cast<uint8_t>( ( nibbles[ i + j ] << 4 ) | lo ) );
+				}
+
+				i += k;
+			}
+		}
+
+		// end of plane.
+		out.Put( 0 );
 	}
 }
 
 /*
 // Simple 16-bit RLE Big-Endian (68000?)
-static void SimpleRLE16BE( FILE* fp_out, int iPlanes, uint8_t* pInputData, int iInputSize )
+static void SimpleRLE16BE( RleOutput& out, int iPlanes, const uint8_t* pInputData, int iInputSize )
 {
-	SimpleRleEncoder< uint16_t > enc16( fp_out, false, BIG_ENDIAN );
+	RleNoStats noStats;
+	SimpleRleEncoder< uint16_t > enc16( out, noStats, false, ENDIAN_BIG );
 
 	for ( int iPlane = 0; iPlane < iPlanes; ++iPlane )
 	{
@@ -251,198 +526,1167 @@ static void SimpleRLE16BE( FILE* fp_out, int iPlanes, uint8_t* pInputData, int i
 		enc16.Flush();
 
 		// end of plane.
-		fputc( 0, fp_out );
+		out.Put( 0 );
 	}
 }
 */
 
-//------------------------------------------------------------------------------
-// RLE
-//------------------------------------------------------------------------------
-int RLE( int argc, char** argv )
+// Encode the whole input with the given parameters. Statistics are only
+// gathered (by a separate instance of the encoder) if pStats is given.
+static void EncodeRLE( RleOutput& out, const RleParams& params, const uint8_t* pInputData, int iInputSize,
+					   std::vector< uint32_t >* pBlockOffsets = nullptr, RleStats* pStats = nullptr )
 {
-	const char* pInputName = nullptr;
-	const char* pOutputName = nullptr;
+	// ... no index or statistics for nibbles.
+	if ( params.bNibbles )
+	{
+		NibbleRLE( out, params, pInputData, iInputSize );
+		return;
+	}
 
-	enum eOption
+	switch ( params.iWordSize )
 	{
-		NONE,
-		OPT_PLANES,
-	};
 
-	eOption specialNextArg = NONE;
+	case 1:
+		if ( pStats )
+		{
+			SimpleRLE8( out, *pStats, params, pInputData, iInputSize, pBlockOffsets );
+		}
+		else
+		{
+			RleNoStats noStats;
+			SimpleRLE8( out, noStats, params, pInputData, iInputSize, pBlockOffsets );
+		}
+		break;
 
-	// defaults.
-	bool bOptAppend = false;
-	int iPlanes = 1;
-	int iWordSize = 1; // TODO: Other word sizes / algorithms
+	/*case 2:
+		SimpleRLE16BE( out, params.iPlanes, pInputData, iInputSize );
+		break;*/
 
-	// parse arguments (after the tool name)
-	for ( int i = 2; i < argc; ++i )
-	{
-		const char* pArg = argv[ i ];
+	}; // switch ( iWordSize )
+}
 
-		if ( specialNextArg != NONE )
-		{
-			switch ( specialNextArg )
-			{
+void EncodeRleBuffer( std::vector< uint8_t >& output, const RleParams& params, const uint8_t* pInputData, int iInputSize )
+{
+	RleOutput out( &output );
+	EncodeRLE( out, params, pInputData, iInputSize );
+}
 
-			case OPT_PLANES:
+//------------------------------------------------------------------------------
+// Cost-aware encoding
+//------------------------------------------------------------------------------
 
-				{
-					int iValue;
-					char* pEnd = nullptr;
-					iValue = strtol( pArg, &pEnd, 10 );
+// Range of the size weight searched by -max-size and -max-cycles, in T-states
+// per byte. Blocks are chosen to minimise cycles + weight * size, so the low end
+// gives the fastest decode and the high end the smallest output.
+static const double kCostWeightMin = 1e-6;
+static const double kCostWeightMax = 1e6;
+static const int kCostSearchSteps = 40;
+
+// Encode with the optimal parse under a size budget (iMaxSize) or a decode time
+// budget (iMaxCycles), whichever is non-zero. The Lagrangian search only finds
+// encodings on the size/time trade-off curve, so the result may sit a little
+// inside the budget. Returns false (having reported why) if nothing fits.
+static bool CostEncodeRLE( RleOutput& out, RleCost& result, std::vector< uint32_t >* pBlockOffsets,
+						   const RleParams& params, const uint8_t* pInputData, int iInputSize,
+						   int iMaxSize, int iMaxCycles )
+{
+	std::vector< uint8_t > planeData;
+	PrepareRlePlanes( planeData, pInputData, iInputSize, params );
 
-					if ( iValue > 0 )
-					{
-						iPlanes = iValue;
-					}
-					else if ( *pEnd != 0 )
-					{
-						// error.
-						PrintError( "Invalid -planes parameter \"%s\".", pArg );
-						return 1;
-					}
-					else
-					{
-						// error.
-						PrintError( "Invalid -planes %d. Must be 1 or more.", iValue );
-						return 1;
-					}
-				}
+	auto parse = [ & ]( double fWeight ) -> RleCost
+	{
+		return RleOptimalParse( nullptr, nullptr, planeData.data(), iInputSize, params, fWeight, 1.0 );
+	};
 
-				break;
+	auto fits = [ & ]( const RleCost& cost ) -> bool
+	{
+		return iMaxSize > 0 ? ( cost.iSize <= iMaxSize ) : ( cost.iCycles <= iMaxCycles );
+	};
 
-			}
+	const RleCost fastest = parse( kCostWeightMin );
+	const RleCost smallest = parse( kCostWeightMax );
 
-			specialNextArg = NONE;
+	double fWeight;
+
+	if ( iMaxSize > 0 )
+	{
+		// Find the fastest encoding that fits: the smallest weight that fits.
+		if ( fits( smallest ) == false )
+		{
+			printf( "FAILED\n" );
+			PrintError( "Can't fit in %d bytes, the smallest encoding is %d bytes.", iMaxSize, static_cast<int>( smallest.iSize ) );
+			return false;
 		}
-		else if ( *pArg == '-' )
+
+		double fLo = kCostWeightMin;
+		double fHi = kCostWeightMax;
+
+		if ( fits( fastest ) )
 		{
-			if ( _stricmp( pArg, "-planes" ) == 0 )
-			{
-				specialNextArg = OPT_PLANES;
-			}
-			else if ( _stricmp( pArg, "-append" ) == 0 )
+			fHi = fLo;
+		}
+
+		for ( int iStep = 0; iStep < kCostSearchSteps && fHi > fLo; ++iStep )
+		{
+			const double fMid = sqrt( fLo * fHi );
+
+			if ( fits( parse( fMid ) ) )
 			{
-				bOptAppend = true;
+				fHi = fMid;
 			}
 			else
 			{
-				// error.
-				PrintHelp( "rle" );
-				return 1;
+				fLo = fMid;
 			}
 		}
-		else if ( pInputName == nullptr )
+
+		fWeight = fHi;
+	}
+	else
+	{
+		// Find the smallest encoding that fits: the largest weight that fits.
+		if ( fits( fastest ) == false )
 		{
-			pInputName = pArg;
+			printf( "FAILED\n" );
+			PrintError( "Can't decode in %d T-states, the fastest encoding takes %lld.", iMaxCycles, static_cast<long long>( fastest.iCycles ) );
+			return false;
 		}
-		else if ( pOutputName == nullptr )
+
+		double fLo = kCostWeightMin;
+		double fHi = kCostWeightMax;
+
+		if ( fits( smallest ) )
 		{
-			pOutputName = pArg;
+			fLo = fHi;
 		}
-		else
+
+		for ( int iStep = 0; iStep < kCostSearchSteps && fHi > fLo; ++iStep )
 		{
-			// error.
-			PrintHelp( "rle" );
-			return 1;
+			const double fMid = sqrt( fLo * fHi );
+
+			if ( fits( parse( fMid ) ) )
+			{
+				fLo = fMid;
+			}
+			else
+			{
+				fHi = fMid;
+			}
 		}
-	}
 
-	if ( pInputName == nullptr || pOutputName == nullptr )
-	{
-		PrintHelp( "rle" );
-		return 1;
+		fWeight = fLo;
 	}
 
+	std::vector< uint8_t > encoded;
+	result = RleOptimalParse( &encoded, pBlockOffsets, planeData.data(), iInputSize, params, fWeight, 1.0 );
 
-	int err;
-	FILE* fp_in;
-	FILE* fp_out;
-
-	Info( "Encoding \"%s\"", pInputName );
+	out.Write( encoded.data(), static_cast<int>( encoded.size() ) );
 
-	if ( iPlanes > 1 )
-	{
-		printf( " (%d planes)", iPlanes );
-	}
+	return true;
+}
 
-	printf( " ... " );
+//------------------------------------------------------------------------------
+// Automatic parameter search
+//------------------------------------------------------------------------------
 
-	// ... open input.
-	err = fopen_s( &fp_in, pInputName, "rb" );
-	if ( err != 0 || fp_in == nullptr )
-	{
-		printf( "FAILED\n" );
-		PrintError( "Cannot open input file \"%s\"", pInputName );
-		return 1;
-	}
+// Highest plane count tried by -auto.
+static const int kAutoMaxPlanes = 16;
 
-	// ... output file
-	err = fopen_s( &fp_out, pOutputName, bOptAppend ? "ab" : "wb" );
-	if ( err != 0 || fp_out == nullptr )
-	{
-		printf( "FAILED\n" );
-		PrintError( "Cannot open output file \"%s\"", pOutputName );
-		return 1;
-	}
-	
-	if ( bOptAppend )
-	{
-		fseek( fp_out, 0, SEEK_END );
-	}
+// Word sizes tried by -auto. Only the 8-bit encoder is enabled at present.
+static const int kAutoWordSizes[] = { 1 };
 
-	int fp_out_start = ftell( fp_out );
+// Row pitches tried with the xor-row filter by -auto. Common tile and screen
+// row widths in bytes.
+static const int kAutoPitches[] = { 4, 8, 16, 32, 40, 64, 80, 128, 160 };
 
-	fseek( fp_in, 0, SEEK_END );
-	int iInputSize = ftell( fp_in );
-	rewind( fp_in );
+struct RleCandidate
+{
+	RleParams params;
+	int iSize;
+};
 
-	// round up to word size, padding with zero
-	int iAllocSize = iInputSize;
-	while ( iAllocSize % iWordSize )
+// List every combination of parameters worth trying on an input of the given
+// size. Any scan order in the base parameters is kept for every candidate.
+static void ListAutoCandidates( std::vector< RleCandidate >& candidates, const RleParams& base, int iInputSize )
+{
+	int iMaxPlanes = ( iInputSize < kAutoMaxPlanes ) ? iInputSize : kAutoMaxPlanes;
+	if ( iMaxPlanes < 1 )
 	{
-		++iAllocSize;
+		iMaxPlanes = 1;
 	}
 
-	uint8_t* pInputData;
-	pInputData = (uint8_t*)malloc( iAllocSize );
-	if ( pInputData == NULL )
+	for ( int iWordSize : kAutoWordSizes )
 	{
-		printf( "FAILED\n" );
-		PrintError( "Couldn't allocate memory for the file." );
-		return 1;
-	}
-
-	// Read file data
-	fread( pInputData, sizeof( char ), iInputSize, fp_in );
-	fclose( fp_in );
+		for ( int iPlanes = 1; iPlanes <= iMaxPlanes; ++iPlanes )
+		{
+			RleCandidate candidate;
+			candidate.params = base;
+			candidate.params.filter = FILTER_NONE;
+			candidate.params.iFilterPitch = 0;
+			candidate.params.iPlanes = iPlanes;
+			candidate.params.iWordSize = iWordSize;
+			candidate.iSize = 0;
+
+			// ... unfiltered
+			candidates.push_back( candidate );
+
+			// ... delta
+			candidate.params.filter = FILTER_DELTA;
+			candidate.params.iFilterPitch = 1;
+			candidates.push_back( candidate );
+
+			// ... xor with the previous row, when there's more than one row.
+			for ( int iPitch : kAutoPitches )
+			{
+				if ( iPitch < PlaneSize( 0, iPlanes, iInputSize ) )
+				{
+					candidate.params.filter = FILTER_XOR_ROW;
+					candidate.params.iFilterPitch = iPitch;
+					candidates.push_back( candidate );
+				}
+			}
+		}
+	}
+
+}
+
+// Smallest wins. Ties go to the earlier (simpler) candidate.
+static int BestAutoCandidate( const std::vector< RleCandidate >& candidates )
+{
+	int iBest = 0;
+	for ( int i = 1; i < static_cast<int>( candidates.size() ); ++i )
+	{
+		if ( candidates[ i ].iSize < candidates[ iBest ].iSize )
+		{
+			iBest = i;
+		}
+	}
+
+	return iBest;
+}
+
+// Dry-run every combination of parameters on a thread pool, all reading the
+// same input. Fills in each candidate's size and returns the smallest.
+static int AutoSearch( std::vector< RleCandidate >& candidates, const RleParams& base, const uint8_t* pInputData, int iInputSize )
+{
+	ListAutoCandidates( candidates, base, iInputSize );
+
+	ParallelFor( static_cast<int>( candidates.size() ), [ & ]( int i )
+	{
+		// No buffer, just count.
+		RleOutput dryRun( nullptr );
+		EncodeRLE( dryRun, candidates[ i ].params, pInputData, iInputSize );
+
+		candidates[ i ].iSize = dryRun.iSize;
+	} );
+
+	return BestAutoCandidate( candidates );
+}
+
+// Write the "<output>.params" sidecar. The last line holds the options needed
+// to decode the output, with the -auto results (if any) listed above it.
+static bool WriteParamsFile( const char* pReportName, const char* pInputName, int iInputSize, const RleParams& params, int iOutputSize,
+							 const std::vector< RleCandidate >& candidates, int iBest )
+{
+	int err;
+	FILE* fp;
+
+	err = fopen_s( &fp, pReportName, "w" );
+	if ( err != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	fprintf( fp, "; BinaryTools rle parameters for \"%s\" (%d bytes)\n", pInputName, iInputSize );
+	fprintf( fp, ";\n" );
+
+	char options[ 256 ];
+
+	if ( candidates.empty() == false )
+	{
+		fprintf( fp, "; word  output  options\n" );
+
+		for ( const RleCandidate& candidate : candidates )
+		{
+			FormatRleParams( options, sizeof( options ), candidate.params );
+
+			fprintf( fp, "; %4d  %6d  %s%s\n", candidate.params.iWordSize, candidate.iSize, options,
+					 ( &candidate == &candidates[ iBest ] ) ? "  <--" : "" );
+		}
+
+		fprintf( fp, ";\n" );
+	}
+
+	FormatRleParams( options, sizeof( options ), params );
+
+	fprintf( fp, "; Parameters used (%d -> %d bytes):\n", iInputSize, iOutputSize );
+	fprintf( fp, "%s\n", options );
+
+	fclose( fp );
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Statistics
+//------------------------------------------------------------------------------
+
+static void PrintStats( const RleStats& stats, int iInputSize, int iOutputSize )
+{
+	printf( "\n  plane     input    output   ratio\n" );
+
+	for ( size_t iPlane = 0; iPlane < stats.planeInput.size(); ++iPlane )
+	{
+		const int iIn = stats.planeInput[ iPlane ];
+		const int iOut = stats.planeOutput[ iPlane ];
+
+		printf( "  %5d  %8d  %8d  %5.1f%%\n", static_cast<int>( iPlane ), iIn, iOut, iIn ? ( 100.0 * iOut / iIn ) : 0.0 );
+	}
+
+	printf( "  total  %8d  %8d  %5.1f%%\n\n", iInputSize, iOutputSize, iInputSize ? ( 100.0 * iOutputSize / iInputSize ) : 0.0 );
+
+	printf( "  run blocks      %8d  covering %lld bytes\n", stats.iRunBlocks, static_cast<long long>( stats.iRunBytes ) );
+	printf( "  literal blocks  %8d  covering %lld bytes\n", stats.iLiteralBlocks, static_cast<long long>( stats.iLiteralBytes ) );
+	printf( "  127 cap splits  %8d  runs, %d literals, costing %lld bytes\n\n",
+			stats.iRunSplits, stats.iLiteralSplits, static_cast<long long>( stats.iCapBytesLost ) );
+
+	printf( "  length      runs  literals\n" );
+
+	for ( int iLength = 1; iLength < 128; ++iLength )
+	{
+		if ( stats.runHistogram[ iLength ] || stats.literalHistogram[ iLength ] )
+		{
+			printf( "  %6d  %8d  %8d\n", iLength, stats.runHistogram[ iLength ], stats.literalHistogram[ iLength ] );
+		}
+	}
+
+	printf( "\n" );
+}
+
+// Write one histogram as a JSON object of "length": count, skipping zeros.
+static void WriteJsonHistogram( FILE* fp, const char* pName, const int* pHistogram )
+{
+	fprintf( fp, "\t\"%s\": {", pName );
+
+	const char* pSeparator = "";
+	for ( int iLength = 1; iLength < 128; ++iLength )
+	{
+		if ( pHistogram[ iLength ] )
+		{
+			fprintf( fp, "%s \"%d\": %d", pSeparator, iLength, pHistogram[ iLength ] );
+			pSeparator = ",";
+		}
+	}
+
+	fprintf( fp, " }" );
+}
+
+static bool WriteStatsJson( const char* pName, const RleStats& stats, int iInputSize, int iOutputSize )
+{
+	FILE* fp;
+	int err = fopen_s( &fp, pName, "w" );
+	if ( err != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	fprintf( fp, "{\n" );
+	fprintf( fp, "\t\"input\": %d,\n", iInputSize );
+	fprintf( fp, "\t\"output\": %d,\n", iOutputSize );
+	fprintf( fp, "\t\"planes\": [" );
+
+	for ( size_t iPlane = 0; iPlane < stats.planeInput.size(); ++iPlane )
+	{
+		fprintf( fp, "%s { \"input\": %d, \"output\": %d }", iPlane ? "," : "",
+				 stats.planeInput[ iPlane ], stats.planeOutput[ iPlane ] );
+	}
+
+	fprintf( fp, " ],\n" );
+	fprintf( fp, "\t\"run_blocks\": %d,\n", stats.iRunBlocks );
+	fprintf( fp, "\t\"run_bytes\": %lld,\n", static_cast<long long>( stats.iRunBytes ) );
+	fprintf( fp, "\t\"literal_blocks\": %d,\n", stats.iLiteralBlocks );
+	fprintf( fp, "\t\"literal_bytes\": %lld,\n", static_cast<long long>( stats.iLiteralBytes ) );
+	fprintf( fp, "\t\"run_cap_splits\": %d,\n", stats.iRunSplits );
+	fprintf( fp, "\t\"literal_cap_splits\": %d,\n", stats.iLiteralSplits );
+	fprintf( fp, "\t\"cap_bytes_lost\": %lld,\n", static_cast<long long>( stats.iCapBytesLost ) );
+
+	WriteJsonHistogram( fp, "run_histogram", stats.runHistogram );
+	fprintf( fp, ",\n" );
+	WriteJsonHistogram( fp, "literal_histogram", stats.literalHistogram );
+	fprintf( fp, "\n}\n" );
+
+	fclose( fp );
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Archive
+//------------------------------------------------------------------------------
+
+// Name for a file's data in generated source, e.g. "gfx/title.rle" -> RLE_title.
+static std::string RleLabel( const char* pPath )
+{
+	return FileLabel( "RLE_", pPath );
+}
+
+// Write the offset, size and plane count of each entry as assembler equates, or
+// as #defines for a C/C++ file name.
+static bool WriteArchiveInclude( const char* pName, const char* pArchiveName, const std::vector< const char* >& inputs,
+								 const std::vector< RleArchiveEntry >& entries )
+{
+	FILE* fp;
+	int err = fopen_s( &fp, pName, "w" );
+	if ( err != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	const bool bC = IsCFileName( pName );
+	const char* pComment = bC ? "//" : ";";
+
+	fprintf( fp, "%s Generated by BinaryTools rle from \"%s\" (%d entries).\n", pComment, pArchiveName, static_cast<int>( entries.size() ) );
+	fprintf( fp, "%s Offsets are from the start of the archive.\n\n", pComment );
+
+	for ( size_t i = 0; i < entries.size(); ++i )
+	{
+		const RleArchiveEntry& entry = entries[ i ];
+		const std::string label = RleLabel( inputs[ i ] );
+
+		char options[ 256 ];
+		FormatRleParams( options, sizeof( options ), entry.params );
+
+		fprintf( fp, "%s %s: %s\n", pComment, inputs[ i ], options );
+
+		if ( bC )
+		{
+			fprintf( fp, "#define %s 0x%04X\n", label.c_str(), entry.iOffset );
+			fprintf( fp, "#define %s_SIZE %d\n", label.c_str(), entry.iOutputSize );
+			fprintf( fp, "#define %s_PLANES %d\n\n", label.c_str(), entry.params.iPlanes );
+		}
+		else
+		{
+			fprintf( fp, "%s equ $%04X\n", label.c_str(), entry.iOffset );
+			fprintf( fp, "%s_SIZE equ %d\n", label.c_str(), entry.iOutputSize );
+			fprintf( fp, "%s_PLANES equ %d\n\n", label.c_str(), entry.params.iPlanes );
+		}
+	}
+
+	fclose( fp );
+	return true;
+}
+
+// Encode many files into one archive (see rle.h). Every file is encoded (and
+// with -auto, searched) in parallel, then written in the order given.
+static int RleArchive( const std::vector< const char* >& inputs, const char* pOutputName, const char* pIncludeName,
+					   const RleParams& params, bool bAuto )
+{
+	const int iCount = static_cast<int>( inputs.size() );
+
+	// ... every entry needs its own name in the include.
+	if ( pIncludeName )
+	{
+		for ( int i = 0; i < iCount; ++i )
+		{
+			for ( int j = 0; j < i; ++j )
+			{
+				if ( RleLabel( inputs[ i ] ) == RleLabel( inputs[ j ] ) )
+				{
+					PrintError( "\"%s\" and \"%s\" would both be called %s.", inputs[ j ], inputs[ i ], RleLabel( inputs[ i ] ).c_str() );
+					return 1;
+				}
+			}
+		}
+	}
+
+	std::vector< MappedFile > files( iCount );
+
+	for ( int i = 0; i < iCount; ++i )
+	{
+		if ( MapFile( &files[ i ], inputs[ i ] ) == false )
+		{
+			PrintError( "Cannot open input file \"%s\"", inputs[ i ] );
+
+			for ( int j = 0; j < i; ++j )
+			{
+				UnmapFile( &files[ j ] );
+			}
+
+			return 1;
+		}
+	}
+
+	// ... each entry's size is stored in 4 bytes.
+	for ( int i = 0; i < iCount; ++i )
+	{
+		if ( files[ i ].iSize > 0x7FFFFFFF )
+		{
+			PrintError( "Input file \"%s\" is too large to archive.", inputs[ i ] );
+
+			for ( int j = 0; j < iCount; ++j )
+			{
+				UnmapFile( &files[ j ] );
+			}
+
+			return 1;
+		}
+	}
+
+	Info( "Archiving %d files%s ... ", iCount, bAuto ? " (auto)" : "" );
+
+	std::vector< RleArchiveEntry > entries( iCount );
+
+	for ( int i = 0; i < iCount; ++i )
+	{
+		entries[ i ].params = params;
+		entries[ i ].iOutputSize = static_cast<int>( files[ i ].iSize );
+	}
+
+	// Search every entry's candidates in one pool, so small files still fill it.
+	if ( bAuto )
+	{
+		std::vector< std::vector< RleCandidate > > candidates( iCount );
+		std::vector< std::pair< int, int > > jobs;
+
+		for ( int i = 0; i < iCount; ++i )
+		{
+			ListAutoCandidates( candidates[ i ], params, entries[ i ].iOutputSize );
+
+			for ( int c = 0; c < static_cast<int>( candidates[ i ].size() ); ++c )
+			{
+				jobs.push_back( std::make_pair( i, c ) );
+			}
+		}
+
+		ParallelFor( static_cast<int>( jobs.size() ), [ & ]( int iJob )
+		{
+			const int i = jobs[ iJob ].first;
+			RleCandidate& candidate = candidates[ i ][ jobs[ iJob ].second ];
+
+			RleOutput dryRun( nullptr );
+			EncodeRLE( dryRun, candidate.params, files[ i ].pData, entries[ i ].iOutputSize );
+
+			candidate.iSize = dryRun.iSize;
+		} );
+
+		for ( int i = 0; i < iCount; ++i )
+		{
+			entries[ i ].params = candidates[ i ][ BestAutoCandidate( candidates[ i ] ) ].params;
+		}
+	}
+
+	std::vector< std::vector< uint8_t > > encoded( iCount );
+
+	ParallelFor( iCount, [ & ]( int i )
+	{
+		RleOutput output( &encoded[ i ] );
+		EncodeRLE( output, entries[ i ].params, files[ i ].pData, entries[ i ].iOutputSize );
+	} );
+
+	int iInputTotal = 0;
+	for ( int i = 0; i < iCount; ++i )
+	{
+		iInputTotal += entries[ i ].iOutputSize;
+		UnmapFile( &files[ i ] );
+	}
+
+	// ... the streams follow the directory.
+	int iOffset = kRleArchiveHeaderSize + iCount * kRleArchiveEntrySize;
+
+	for ( int i = 0; i < iCount; ++i )
+	{
+		entries[ i ].iOffset = iOffset;
+		iOffset += static_cast<int>( encoded[ i ].size() );
+	}
+
+	std::vector< uint8_t > header;
+	WriteRleArchive( header, entries );
+
+	FILE* fp_out;
+	int err = fopen_s( &fp_out, pOutputName, "wb" );
+	if ( err != 0 || fp_out == nullptr )
+	{
+		printf( "FAILED\n" );
+		PrintError( "Cannot open output file \"%s\"", pOutputName );
+		return 1;
+	}
+
+	fwrite( header.data(), 1, header.size(), fp_out );
+
+	for ( const std::vector< uint8_t >& stream : encoded )
+	{
+		fwrite( stream.data(), 1, stream.size(), fp_out );
+	}
+
+	fclose( fp_out );
+
+	printf( "OK (%d -> %d bytes)\n", iInputTotal, iOffset );
+
+	if ( pIncludeName && WriteArchiveInclude( pIncludeName, pOutputName, inputs, entries ) == false )
+	{
+		PrintError( "Cannot write include file \"%s\"", pIncludeName );
+		return 1;
+	}
+
+	return 0;
+}
+
+//------------------------------------------------------------------------------
+// In-place Decoding
+//------------------------------------------------------------------------------
+
+// Write the symbols needed to decode in place, as assembler equates or as
+// #defines for a C/C++ file name.
+static bool WriteInPlaceSymbols( const char* pName, const char* pDataName, const std::string& label,
+								 int iOutputSize, int iDataSize, int iMargin )
+{
+	FILE* fp;
+	int err = fopen_s( &fp, pName, "w" );
+	if ( err != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	const bool bC = IsCFileName( pName );
+	const char* pComment = bC ? "//" : ";";
+
+	fprintf( fp, "%s Generated by BinaryTools rle for in-place decoding of \"%s\" with RLEDecompress.\n", pComment, pDataName );
+	fprintf( fp, "%s Reserve %s_SIZE + %s_MARGIN bytes, load the data at offset %s_LOAD and\n", pComment, label.c_str(), label.c_str(), label.c_str() );
+	fprintf( fp, "%s decode to offset 0.\n\n", pComment );
+
+	const char* pNames[ 4 ] = { "SIZE", "PACKED", "MARGIN", "LOAD" };
+	const int values[ 4 ] = { iOutputSize, iDataSize, iMargin, iOutputSize + iMargin - iDataSize };
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		if ( bC )
+		{
+			fprintf( fp, "#define %s_%s %d\n", label.c_str(), pNames[ i ], values[ i ] );
+		}
+		else
+		{
+			fprintf( fp, "%s_%s equ %d\n", label.c_str(), pNames[ i ], values[ i ] );
+		}
+	}
+
+	fclose( fp );
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// RLE
+//------------------------------------------------------------------------------
+int RLE( int argc, char** argv )
+{
+	std::vector< const char* > files;
+
+	enum eOption
+	{
+		NONE,
+		OPT_PLANES,
+		OPT_FILTER,
+		OPT_SCAN,
+		OPT_WIDTH,
+		OPT_INDEX,
+		OPT_MAX_SIZE,
+		OPT_MAX_CYCLES,
+		OPT_STATS_JSON,
+		OPT_EMIT_DECODER,
+		OPT_INCLUDE,
+		OPT_INPLACE,
+	};
+
+	eOption specialNextArg = NONE;
+
+	// defaults.
+	bool bOptAppend = false;
+	bool bOptAuto = false;
+	int iMaxSize = 0;
+	int iMaxCycles = 0;
+	bool bOptStats = false;
+	const char* pStatsJsonName = nullptr;
+	const char* pDecoderName = nullptr;
+	bool bOptArchive = false;
+	const char* pIncludeName = nullptr;
+	const char* pInPlaceName = nullptr;
+	bool bOptInPlaceMin = false;
+	RleParams params;
+	DefaultRleParams( params ); // TODO: Other word sizes / algorithms
+
+	// parse arguments (after the tool name)
+	for ( int i = 2; i < argc; ++i )
+	{
+		const char* pArg = argv[ i ];
+
+		if ( specialNextArg != NONE )
+		{
+			switch ( specialNextArg )
+			{
+
+			case OPT_PLANES:
+
+				{
+					int iValue;
+					char* pEnd = nullptr;
+					iValue = strtol( pArg, &pEnd, 10 );
+
+					if ( iValue > 0 )
+					{
+						params.iPlanes = iValue;
+					}
+					else if ( *pEnd != 0 )
+					{
+						// error.
+						PrintError( "Invalid -planes parameter \"%s\".", pArg );
+						return 1;
+					}
+					else
+					{
+						// error.
+						PrintError( "Invalid -planes %d. Must be 1 or more.", iValue );
+						return 1;
+					}
+				}
+
+				break;
+
+			case OPT_FILTER:
+
+				if ( ParseRleFilter( params, pArg ) == false )
+				{
+					// error.
+					PrintError( "Invalid -filter \"%s\". Use delta or xor-row:<pitch>.", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_SCAN:
+
+				if ( ParseRleScan( params, pArg ) == false )
+				{
+					// error.
+					PrintError( "Invalid -scan \"%s\". Use column:<w>x<h>, tile:<tw>x<th> or zigzag.", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_WIDTH:
+
+				params.iWidth = ParseValue( pArg, 0x7FFFFFFF );
+
+				if ( params.iWidth < 1 )
+				{
+					// error.
+					PrintError( "Invalid -width parameter \"%s\".", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_INDEX:
+
+				params.iIndexBlock = ParseValue( pArg, 0x7FFFFFFF );
+
+				if ( params.iIndexBlock < 1 )
+				{
+					// error.
+					PrintError( "Invalid -index parameter \"%s\".", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_MAX_SIZE:
+
+				iMaxSize = ParseValue( pArg, 0x7FFFFFFF );
+
+				if ( iMaxSize < 1 )
+				{
+					// error.
+					PrintError( "Invalid -max-size parameter \"%s\".", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_MAX_CYCLES:
+
+				iMaxCycles = ParseValue( pArg, 0x7FFFFFFF );
+
+				if ( iMaxCycles < 1 )
+				{
+					// error.
+					PrintError( "Invalid -max-cycles parameter \"%s\".", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_STATS_JSON:
+
+				pStatsJsonName = pArg;
+				break;
+
+			case OPT_EMIT_DECODER:
+
+				pDecoderName = pArg;
+				break;
+
+			case OPT_INCLUDE:
+
+				pIncludeName = pArg;
+				break;
+
+			case OPT_INPLACE:
+
+				pInPlaceName = pArg;
+				break;
+
+			}
+
+			specialNextArg = NONE;
+		}
+		else if ( *pArg == '-' )
+		{
+			if ( _stricmp( pArg, "-planes" ) == 0 )
+			{
+				specialNextArg = OPT_PLANES;
+			}
+			else if ( _stricmp( pArg, "-filter" ) == 0 )
+			{
+				specialNextArg = OPT_FILTER;
+			}
+			else if ( _stricmp( pArg, "-scan" ) == 0 )
+			{
+				specialNextArg = OPT_SCAN;
+			}
+			else if ( _stricmp( pArg, "-width" ) == 0 )
+			{
+				specialNextArg = OPT_WIDTH;
+			}
+			else if ( _stricmp( pArg, "-index" ) == 0 )
+			{
+				specialNextArg = OPT_INDEX;
+			}
+			else if ( _stricmp( pArg, "-max-size" ) == 0 )
+			{
+				specialNextArg = OPT_MAX_SIZE;
+			}
+			else if ( _stricmp( pArg, "-max-cycles" ) == 0 )
+			{
+				specialNextArg = OPT_MAX_CYCLES;
+			}
+			else if ( _stricmp( pArg, "-stats" ) == 0 )
+			{
+				bOptStats = true;
+			}
+			else if ( _stricmp( pArg, "-stats-json" ) == 0 )
+			{
+				specialNextArg = OPT_STATS_JSON;
+			}
+			else if ( _stricmp( pArg, "-emit-decoder" ) == 0 )
+			{
+				specialNextArg = OPT_EMIT_DECODER;
+			}
+			else if ( _stricmp( pArg, "-inplace" ) == 0 )
+			{
+				specialNextArg = OPT_INPLACE;
+			}
+			else if ( _stricmp( pArg, "-inplace-min" ) == 0 )
+			{
+				bOptInPlaceMin = true;
+			}
+			else if ( _stricmp( pArg, "-nibble" ) == 0 )
+			{
+				params.bNibbles = true;
+			}
+			else if ( _stricmp( pArg, "-archive" ) == 0 )
+			{
+				bOptArchive = true;
+			}
+			else if ( _stricmp( pArg, "-include" ) == 0 )
+			{
+				specialNextArg = OPT_INCLUDE;
+			}
+			else if ( _stricmp( pArg, "-append" ) == 0 )
+			{
+				bOptAppend = true;
+			}
+			else if ( _stricmp( pArg, "-auto" ) == 0 )
+			{
+				bOptAuto = true;
+			}
+			else
+			{
+				// error.
+				PrintHelp( "rle" );
+				return 1;
+			}
+		}
+		else
+		{
+			files.push_back( pArg );
+		}
+	}
+
+	// ... one input, unless building an archive. The output comes last.
+	if ( files.size() < 2 || ( files.size() > 2 && bOptArchive == false ) || specialNextArg != NONE )
+	{
+		PrintHelp( "rle" );
+		return 1;
+	}
+
+	const char* pInputName = files.front();
+	const char* pOutputName = files.back();
+
+
+	const char* pParamsError = CheckRleParams( params );
+	if ( pParamsError )
+	{
+		PrintError( "%s", pParamsError );
+		return 1;
+	}
+
+	const bool bCostModel = ( iMaxSize > 0 || iMaxCycles > 0 );
+
+	if ( iMaxSize > 0 && iMaxCycles > 0 )
+	{
+		PrintError( "Use either -max-size or -max-cycles, not both." );
+		return 1;
+	}
+
+	if ( bCostModel && bOptAuto )
+	{
+		PrintError( "-auto can't be combined with -max-size or -max-cycles." );
+		return 1;
+	}
+
+	// ... the generated decoder writes straight into the final layout, and
+	// always decodes the whole stream.
+	if ( pDecoderName && ( params.scan != SCAN_ROWS || params.iIndexBlock > 0 ) )
+	{
+		PrintError( "-emit-decoder can't be combined with -scan or -index." );
+		return 1;
+	}
+
+	const bool bGatherStats = ( bOptStats || pStatsJsonName != nullptr );
+
+	// ... the cost model, statistics and decoder generator only know the byte format.
+	if ( params.bNibbles && ( bCostModel || bGatherStats || pDecoderName ) )
+	{
+		PrintError( "-nibble can't be combined with -max-size, -max-cycles, -stats or -emit-decoder." );
+		return 1;
+	}
+
+	// ... the margin models RLEDecompress on a plain stream, and -inplace-min
+	// replaces the blocks the cost model and statistics describe.
+	if ( pInPlaceName && ( params.iIndexBlock > 0 || params.bNibbles || pDecoderName ) )
+	{
+		PrintError( "-inplace can't be combined with -index, -nibble or -emit-decoder." );
+		return 1;
+	}
+
+	if ( bOptInPlaceMin && ( pInPlaceName == nullptr || bCostModel || bGatherStats ) )
+	{
+		PrintError( "-inplace-min needs -inplace, and can't be combined with -max-size, -max-cycles or -stats." );
+		return 1;
+	}
+
+	if ( pIncludeName && bOptArchive == false )
+	{
+		PrintError( "-include needs -archive." );
+		return 1;
+	}
+
+	// ... each entry records only its planes and filter.
+	if ( bOptArchive )
+	{
+		if ( params.scan != SCAN_ROWS || params.iIndexBlock > 0 || params.bNibbles || bCostModel || bGatherStats || pDecoderName || pInPlaceName || bOptAppend )
+		{
+			PrintError( "-archive can only be combined with -planes, -filter, -auto and -include." );
+			return 1;
+		}
+
+		if ( params.iFilterPitch > 0xFFFF || params.iPlanes > 0xFF )
+		{
+			PrintError( "-archive supports up to 255 planes and a filter pitch up to 65535." );
+			return 1;
+		}
+
+		files.pop_back();
+		return RleArchive( files, pOutputName, pIncludeName, params, bOptAuto );
+	}
+
+	if ( bCostModel && bGatherStats )
+	{
+		PrintError( "-stats can't be combined with -max-size or -max-cycles." );
+		return 1;
+	}
+
+	int err;
+	FILE* fp_out;
+
+	// ... map the input. Every encode (including -auto dry runs) reads from this one copy.
+	MappedFile input;
+	if ( MapFile( &input, pInputName ) == false )
+	{
+		PrintError( "Cannot open input file \"%s\"", pInputName );
+		return 1;
+	}
+
+	// ... sizes are handled as int.
+	if ( input.iSize > 0x7FFFFFFF )
+	{
+		PrintError( "Input file \"%s\" is too large.", pInputName );
+		UnmapFile( &input );
+		return 1;
+	}
+
+	int iInputSize = static_cast<int>( input.iSize );
+
+	// Search for the best parameters?
+	std::vector< RleCandidate > candidates;
+	int iBest = 0;
+
+	if ( bOptAuto )
+	{
+		Info( "Searching for the best parameters for \"%s\" ... ", pInputName );
+
+		iBest = AutoSearch( candidates, params, input.pData, iInputSize );
+		params = candidates[ iBest ].params;
+
+		char options[ 256 ];
+		FormatRleParams( options, sizeof( options ), params );
+		printf( "%s (%d tried)\n", options, static_cast<int>( candidates.size() ) );
+	}
+
+	Info( "Encoding \"%s\"", pInputName );
+
+	if ( params.iPlanes > 1 )
+	{
+		printf( " (%d planes)", params.iPlanes );
+	}
 
-	// Pad the padding space with zeros.
-	uint8_t* pPad = pInputData + iInputSize;
-	for ( int i = iInputSize; i < iAllocSize; ++i )
+	if ( params.filter == FILTER_DELTA )
 	{
-		*pPad++ = 0;
+		printf( " (delta)" );
+	}
+	else if ( params.filter == FILTER_XOR_ROW )
+	{
+		printf( " (xor-row:%d)", params.iFilterPitch );
+	}
+
+	if ( params.scan == SCAN_COLUMN )
+	{
+		printf( " (column:%dx%d)", params.iScanW, params.iScanH );
+	}
+	else if ( params.scan == SCAN_TILE )
+	{
+		printf( " (tile:%dx%d)", params.iScanW, params.iScanH );
+	}
+	else if ( params.scan == SCAN_ZIGZAG )
+	{
+		printf( " (zigzag)" );
+	}
+
+	if ( params.bNibbles )
+	{
+		printf( " (nibbles)" );
+	}
+
+	printf( " ... " );
+
+	// round up to word size, padding with zero
+	int iAllocSize = iInputSize;
+	while ( iAllocSize % params.iWordSize )
+	{
+		++iAllocSize;
+	}
+
+	// Only copy the input if it needs padding.
+	std::vector< uint8_t > paddedInput;
+	const uint8_t* pInputData = input.pData;
+
+	if ( iAllocSize != iInputSize )
+	{
+		paddedInput.resize( iAllocSize, 0 );
+		memcpy( paddedInput.data(), input.pData, iInputSize );
+		pInputData = paddedInput.data();
 	}
 
 	// Encode
-	switch ( iWordSize )
+	std::vector< uint8_t > encoded;
+	RleOutput output( &encoded );
+
+	std::vector< uint32_t > blockOffsets;
+	RleCost cost = { 0, 0 };
+	RleStats stats;
+
+	if ( bCostModel )
+	{
+		if ( CostEncodeRLE( output, cost, &blockOffsets, params, pInputData, iInputSize, iMaxSize, iMaxCycles ) == false )
+		{
+			UnmapFile( &input );
+			return 1;
+		}
+	}
+	else
 	{
+		EncodeRLE( output, params, pInputData, iInputSize, &blockOffsets, bGatherStats ? &stats : nullptr );
+	}
 
-	case 1:
-		SimpleRLE8( fp_out, iPlanes, pInputData, iInputSize );
-		break;
+	// Try the smallest blocks too, which avoid the literal splits that make a
+	// tail of the data grow. Keep whichever needs less room to decode in place.
+	int iGreedyMargin = -1;
 
-	/*case 2:
-		SimpleRLE16BE( fp_out, iPlanes, pInputData, iInputSize );
-		break;*/
+	if ( bOptInPlaceMin )
+	{
+		std::vector< uint8_t > planeData;
+		PrepareRlePlanes( planeData, pInputData, iInputSize, params );
 
-	}; // switch ( iWordSize )
+		std::vector< uint8_t > smallest;
+		RleOptimalParse( &smallest, nullptr, planeData.data(), iInputSize, params, 1.0, 0.0 );
+
+		const int iSmallestSize = static_cast<int>( smallest.size() );
+
+		iGreedyMargin = RleInPlaceMargin( encoded.data(), output.iSize, iInputSize );
+		const int iSmallestMargin = RleInPlaceMargin( smallest.data(), iSmallestSize, iInputSize );
+
+		if ( iSmallestMargin < iGreedyMargin || ( iSmallestMargin == iGreedyMargin && iSmallestSize < output.iSize ) )
+		{
+			encoded.swap( smallest );
+			output.iSize = iSmallestSize;
+		}
+	}
+
+	// ... output file
+	err = fopen_s( &fp_out, pOutputName, bOptAppend ? "ab" : "wb" );
+	if ( err != 0 || fp_out == nullptr )
+	{
+		printf( "FAILED\n" );
+		PrintError( "Cannot open output file \"%s\"", pOutputName );
+		UnmapFile( &input );
+		return 1;
+	}
+	
+	if ( bOptAppend )
+	{
+		fseek( fp_out, 0, SEEK_END );
+	}
+
+	// ... the seek table goes in front of the data.
+	std::vector< uint8_t > header;
+	if ( params.iIndexBlock > 0 )
+	{
+		WriteRleIndex( header, params, iInputSize, blockOffsets );
+		fwrite( header.data(), 1, header.size(), fp_out );
+	}
 
-	// 
-	int fp_out_len = ftell( fp_out ) - fp_out_start;
+	fwrite( encoded.data(), 1, encoded.size(), fp_out );
+
+	const int iOutputSize = static_cast<int>( header.size() ) + output.iSize;
 
 	printf( "OK (%d", iAllocSize );
 
@@ -452,14 +1696,150 @@ int RLE( int argc, char** argv )
 		putchar( '*' );
 	}
 
-	printf( " -> %d bytes)\n", fp_out_len );
+	printf( " -> %d bytes)\n", iOutputSize );
+
+	// Report what the index costs: the table itself, plus the runs broken at block boundaries.
+	if ( params.iIndexBlock > 0 )
+	{
+		RleParams plainParams = params;
+		plainParams.iIndexBlock = 0;
+
+		RleOutput plain( nullptr );
+
+		if ( bCostModel )
+		{
+			RleCost plainCost;
+			CostEncodeRLE( plain, plainCost, nullptr, plainParams, pInputData, iInputSize, iMaxSize, iMaxCycles );
+		}
+		else
+		{
+			EncodeRLE( plain, plainParams, pInputData, iInputSize );
+		}
+
+		Info( "Index of %d blocks costs %d bytes of table and %d bytes of broken runs (%d -> %d bytes)\n",
+			  static_cast<int>( blockOffsets.size() ), static_cast<int>( header.size() ), output.iSize - plain.iSize,
+			  plain.iSize, iOutputSize );
+	}
+
+	if ( pInPlaceName )
+	{
+		const int iMargin = RleInPlaceMargin( encoded.data(), output.iSize, iInputSize );
+
+		if ( WriteInPlaceSymbols( pInPlaceName, pOutputName, RleLabel( pOutputName ), iInputSize, output.iSize, iMargin ) == false )
+		{
+			PrintError( "Cannot write in-place symbols file \"%s\"", pInPlaceName );
+			UnmapFile( &input );
+			fclose( fp_out );
+			return 1;
+		}
+
+		Info( "In-place decoding needs %d bytes of margin: load at offset %d of a %d byte buffer",
+			  iMargin, iInputSize + iMargin - output.iSize, iInputSize + iMargin );
+
+		if ( iGreedyMargin >= 0 )
+		{
+			printf( " (default blocks need %d)", iGreedyMargin );
+		}
+
+		printf( "\n" );
+	}
+
+	// Compare with the byte format.
+	if ( params.bNibbles )
+	{
+		RleParams byteParams = params;
+		byteParams.bNibbles = false;
+
+		RleOutput byteOutput( nullptr );
+		EncodeRLE( byteOutput, byteParams, pInputData, iInputSize );
+
+		const int iChange = output.iSize - byteOutput.iSize;
+
+		Info( "Byte RLE would be %d bytes, nibbles are %+d bytes (%+.1f%%)\n", byteOutput.iSize, iChange,
+			  byteOutput.iSize ? 100.0 * iChange / byteOutput.iSize : 0.0 );
+	}
+
+	if ( bOptStats )
+	{
+		PrintStats( stats, iInputSize, output.iSize );
+	}
+
+	if ( pStatsJsonName && WriteStatsJson( pStatsJsonName, stats, iInputSize, output.iSize ) == false )
+	{
+		PrintError( "Cannot write statistics file \"%s\"", pStatsJsonName );
+		UnmapFile( &input );
+		fclose( fp_out );
+		return 1;
+	}
+
+	// Compare the decode time with the default encoder.
+	if ( bCostModel )
+	{
+		std::vector< uint8_t > greedy;
+		RleOutput greedyOutput( &greedy );
+		EncodeRLE( greedyOutput, params, pInputData, iInputSize );
+
+		Info( "Estimated Z80 decode time %lld T-states, %d bytes (default encoding %lld T-states, %d bytes)\n",
+			  static_cast<long long>( cost.iCycles ), static_cast<int>( cost.iSize ),
+			  static_cast<long long>( RleDecodeCycles( greedy.data(), greedyOutput.iSize ) ), greedyOutput.iSize );
+	}
+
+	if ( pDecoderName )
+	{
+		// ... name the routine after the output file, e.g. "gfx/title.rle" -> RLE_title.
+		const std::string label = RleLabel( pOutputName );
+
+		const char* pBase = pOutputName;
+		for ( const char* p = pOutputName; *p; ++p )
+		{
+			if ( *p == '/' || *p == '\\' || *p == ':' )
+			{
+				pBase = p + 1;
+			}
+		}
+
+		RleDecoderInfo decoder;
+		if ( WriteRleDecoder( decoder, pDecoderName, label.c_str(), pBase, encoded.data(), output.iSize, iInputSize, params ) == false )
+		{
+			UnmapFile( &input );
+			fclose( fp_out );
+			return 1;
+		}
+
+		const int64_t iGenericCycles = RleDecodeCycles( encoded.data(), output.iSize );
+
+		Info( "Wrote %s to \"%s\": %d bytes, about %lld T-states (RLEDecompress alone %lld)\n",
+			  label.c_str(), pDecoderName, decoder.iSize, static_cast<long long>( decoder.iCycles ),
+			  static_cast<long long>( iGenericCycles ) );
+
+		// ... writing planes into place, or undoing a filter, can cost more than
+		// the specialised block loop saves. Blocks of a few bytes over many
+		// planes are the usual cause.
+		if ( decoder.iCycles >= iGenericCycles )
+		{
+			Info( "%s is no faster than RLEDecompress%s on this data. Calling RLEDecompress once per plane is quicker, if the planes can stay apart.\n",
+				  label.c_str(), ( params.filter != FILTER_NONE ) ? " before unfiltering" : "" );
+		}
+	}
 
 	// Tidy up
-	free( pInputData );
+	UnmapFile( &input );
 	fclose( fp_out );
 
+	// ... record the parameters next to the output when they can't be guessed.
+	if ( bOptAuto || params.scan != SCAN_ROWS || params.bNibbles )
+	{
+		char reportName[ 1024 ];
+		snprintf( reportName, sizeof( reportName ), "%s.params", pOutputName );
+
+		if ( WriteParamsFile( reportName, pInputName, iInputSize, params, iOutputSize, candidates, iBest ) == false )
+		{
+			PrintError( "Cannot write parameters file \"%s\"", reportName );
+			return 1;
+		}
+	}
+
 	return 0;
 }
 
 //==============================================================================
-
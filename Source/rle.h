@@ -0,0 +1,263 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// RLE Shared Definitions
+//------------------------------------------------------------------------------
+
+// Filters applied to each plane before encoding (and undone after decoding).
+enum RleFilter
+{
+	FILTER_NONE,
+	FILTER_DELTA,		// each byte minus the previous byte
+	FILTER_XOR_ROW,		// each byte XOR the byte one row (pitch) earlier
+};
+
+// Order in which each plane's bytes are fed to the encoder.
+enum RleScan
+{
+	SCAN_ROWS,			// as stored
+	SCAN_COLUMN,		// column by column, within pages of W x H bytes
+	SCAN_TILE,			// tile by tile (each TW x TH bytes), across rows of iWidth bytes
+	SCAN_ZIGZAG,		// rows of iWidth bytes, alternating direction
+};
+
+// Encoding parameters. The decoder must be given the same values.
+struct RleParams
+{
+	int iPlanes;
+	int iWordSize;
+	RleFilter filter;
+	int iFilterPitch;
+	RleScan scan;
+	int iScanW;			// page (column) or tile (tile) width
+	int iScanH;			// page (column) or tile (tile) height
+	int iWidth;			// row width in bytes for tile and zigzag scans
+	int iIndexBlock;	// bytes per seek block in each plane, or 0 for no index
+	bool bNibbles;		// encode runs of 4-bit values (see Nibble Format)
+};
+
+// Default parameters: a single plane of bytes with no filter.
+void DefaultRleParams( RleParams& params );
+
+// Parse the argument of -filter ("delta" or "xor-row:<pitch>").
+bool ParseRleFilter( RleParams& params, const char* pArg );
+
+// Parse the argument of -scan ("column:<w>x<h>", "tile:<tw>x<th>" or "zigzag").
+bool ParseRleScan( RleParams& params, const char* pArg );
+
+// Check a set of parameters is usable. Returns an error message, or nullptr.
+const char* CheckRleParams( const RleParams& params );
+
+// Write the command line options that reproduce a set of parameters.
+void FormatRleParams( char* pBuffer, size_t size, const RleParams& params );
+
+// Read the options stored in a .params file, skipping ';' comments.
+bool ReadRleParamsFile( std::vector< std::string >& args, const char* pName );
+
+// Number of bytes that belong to a given plane.
+int PlaneSize( int iPlane, int iPlanes, int iInputSize );
+
+// Transpose interleaved input into contiguous planes, stored back to back.
+void DeinterleavePlanes( uint8_t* pOutput, const uint8_t* pInput, int iInputSize, int iPlanes );
+
+// Inverse of DeinterleavePlanes.
+void InterleavePlanes( uint8_t* pOutput, const uint8_t* pInput, int iOutputSize, int iPlanes );
+
+// Apply the filter to a single plane, in-place.
+void FilterPlane( uint8_t* pData, int iSize, const RleParams& params );
+
+// Undo FilterPlane, in-place.
+void UnfilterPlane( uint8_t* pData, int iSize, const RleParams& params );
+
+// Reorder a single plane into scan order (or back again if bInverse is set).
+void ScanPlane( uint8_t* pDst, const uint8_t* pSrc, int iSize, const RleParams& params, bool bInverse );
+
+// Everything that happens to the input before encoding: split into planes,
+// then scan and filter each plane. Planes are stored back to back.
+void PrepareRlePlanes( std::vector< uint8_t >& planes, const uint8_t* pInput, int iInputSize, const RleParams& params );
+
+// Inverse of PrepareRlePlanes.
+void RestoreRlePlanes( uint8_t* pOutput, std::vector< uint8_t >& planes, int iOutputSize, const RleParams& params );
+
+// Encode a buffer as 'rle' would, appending to output.
+void EncodeRleBuffer( std::vector< uint8_t >& output, const RleParams& params, const uint8_t* pInputData, int iInputSize );
+
+//------------------------------------------------------------------------------
+// Nibble Format
+//------------------------------------------------------------------------------
+//
+// Written by 'rle -nibble' for 2bpp and 4bpp graphics, where runs start and end
+// on nibble boundaries. Each byte is read as two nibbles, high nibble first,
+// and each plane is a sequence of blocks:
+//
+//   00         end of plane
+//   0nnnnnnn   n nibbles (1-127) of literal data follow, packed two to a
+//              byte, high nibble first. The spare nibble of an odd count is 0.
+//   1vvvvnnn   a run of nibble v. nnn of 0-6 gives a run of 2-8 nibbles; 7
+//              means the next byte holds the run length - 9 (9-264).
+
+static const int kRleNibbleMaxLiteral = 127;
+static const int kRleNibbleShortRun = 8;
+static const int kRleNibbleMaxRun = 264;
+
+//------------------------------------------------------------------------------
+// Indexed Container
+//------------------------------------------------------------------------------
+//
+// Written by 'rle -index N'. All values are little-endian.
+//
+//   +0   "RLEX"
+//   +4   u8    plane count
+//   +5   u8    filter (RleFilter)
+//   +6   u16   filter pitch
+//   +8   u32   block size N, in bytes of a single plane
+//   +12  u32   uncompressed size
+//   +16  u32   entry count
+//   +20  u32 x entry count - offset of each block, from the end of the table
+//
+// Entries are stored plane by plane, so the first entry of each plane is its
+// entry point. Block k of a plane starts at byte k * N of that plane, so only
+// the compressed offsets need storing. After the table comes an ordinary RLE
+// stream, except that no run crosses a block boundary and each block is
+// filtered on its own, so any block can be decoded without the ones before it.
+
+// Size of the fixed part of the header.
+static const int kRleIndexHeaderSize = 20;
+
+struct RleIndex
+{
+	RleParams params;
+	int iOutputSize;					// uncompressed size
+	int iDataStart;						// offset of the RLE stream in the file
+	std::vector< uint32_t > offsets;	// block offsets, relative to iDataStart
+};
+
+// Number of seek blocks (table entries) for a single plane.
+int RleIndexPlaneBlocks( int iPlane, const RleParams& params, int iOutputSize );
+
+// Build the header and table that go in front of the encoded data.
+void WriteRleIndex( std::vector< uint8_t >& out, const RleParams& params, int iOutputSize, const std::vector< uint32_t >& offsets );
+
+// Read and check the header. Returns false if the input isn't an indexed container.
+bool ReadRleIndex( RleIndex& index, const uint8_t* pInput, int iInputSize );
+
+//------------------------------------------------------------------------------
+// Archive
+//------------------------------------------------------------------------------
+//
+// Written by 'rle -archive'. Holds many files, each an ordinary RLE stream with
+// its own parameters. All values are little-endian.
+//
+//   +0   "RLEA"
+//   +4   u32   entry count
+//   +8   12 bytes per entry:
+//          u32   offset of the entry's RLE stream, from the start of the archive
+//          u32   uncompressed size
+//          u8    plane count
+//          u8    filter (RleFilter)
+//          u16   filter pitch
+//
+// The streams follow the directory, in the same order as the entries.
+
+static const int kRleArchiveHeaderSize = 8;
+static const int kRleArchiveEntrySize = 12;
+
+struct RleArchiveEntry
+{
+	RleParams params;
+	int iOffset;			// from the start of the archive
+	int iOutputSize;		// uncompressed size
+};
+
+// Build the header and directory. Offsets must already allow for their size.
+void WriteRleArchive( std::vector< uint8_t >& out, const std::vector< RleArchiveEntry >& entries );
+
+// Read and check the directory. Returns false if the input isn't an archive.
+bool ReadRleArchive( std::vector< RleArchiveEntry >& entries, const uint8_t* pInput, int iInputSize );
+
+//------------------------------------------------------------------------------
+// Z80 Cost Model
+//------------------------------------------------------------------------------
+//
+// T-states spent by RLEDecompress in Extras/rle_decompress.z80 (not counting
+// the call). A literal block of n bytes takes 43 + 39n, a run of n bytes takes
+// 63 + 26n and the 00 terminator at the end of each plane takes 28.
+
+static const int kZ80LiteralBlockCycles = 43;
+static const int kZ80LiteralByteCycles = 39;
+static const int kZ80RunBlockCycles = 63;
+static const int kZ80RunByteCycles = 26;
+static const int kZ80EndCycles = 28;
+
+// Size and decode time of an encoding.
+struct RleCost
+{
+	int64_t iSize;
+	int64_t iCycles;
+};
+
+// Estimate the decode time of an 8-bit RLE stream, walking its blocks.
+int64_t RleDecodeCycles( const uint8_t* pInput, int iInputSize );
+
+// Bytes of slack needed to decode an 8-bit RLE stream in place. The data goes
+// at the end of a buffer of iOutputSize + margin bytes and RLEDecompress
+// writes from the start of it, one plane after another, so that no write
+// lands on a byte it hasn't read yet.
+int RleInPlaceMargin( const uint8_t* pInput, int iInputSize, int iOutputSize );
+
+// Encode prepared planes (see PrepareRlePlanes) with the blocks that minimise
+// fSizeWeight * size + fCycleWeight * cycles, rather than the greedy choice.
+// Runs are broken at -index blocks, as the plain encoder does. pOutput and
+// pBlockOffsets may be null to only measure the result.
+RleCost RleOptimalParse( std::vector< uint8_t >* pOutput, std::vector< uint32_t >* pBlockOffsets,
+						 const uint8_t* pPlanes, int iInputSize, const RleParams& params,
+						 double fSizeWeight, double fCycleWeight );
+
+//------------------------------------------------------------------------------
+// Z80 Decoder Generator
+//------------------------------------------------------------------------------
+
+// Size and estimated decode time of a generated decoder.
+struct RleDecoderInfo
+{
+	int iSize;
+	int64_t iCycles;
+};
+
+// Write a Z80 routine (vasm "oldstyle") that decodes one encoded stream, made
+// without an index, into its original interleaved and unfiltered form. It is
+// specialised for the parameters and for the block types and lengths found in
+// the stream. pLabel names the routine; pDataName is only used in comments.
+bool WriteRleDecoder( RleDecoderInfo& info, const char* pName, const char* pLabel, const char* pDataName,
+					  const uint8_t* pInput, int iInputSize, int iOutputSize, const RleParams& params );
+
+//==============================================================================
@@ -0,0 +1,268 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
+#include "utils.h"
+#include "rle.h"
+
+//------------------------------------------------------------------------------
+// Z80 Cost Model
+//------------------------------------------------------------------------------
+
+int64_t RleDecodeCycles( const uint8_t* pInput, int iInputSize )
+{
+	int64_t iCycles = 0;
+	int iCursor = 0;
+
+	while ( iCursor < iInputSize )
+	{
+		uint8_t ctrl = pInput[ iCursor++ ];
+		int iLength = ctrl & 0x7F;
+
+		if ( ctrl == 0 )
+		{
+			iCycles += kZ80EndCycles;
+		}
+		else if ( ctrl & 0x80 )
+		{
+			iCycles += kZ80RunBlockCycles + kZ80RunByteCycles * iLength;
+			iCursor += 1;
+		}
+		else
+		{
+			iCycles += kZ80LiteralBlockCycles + kZ80LiteralByteCycles * iLength;
+			iCursor += iLength;
+		}
+	}
+
+	return iCycles;
+}
+
+int RleInPlaceMargin( const uint8_t* pInput, int iInputSize, int iOutputSize )
+{
+	// ... track how far the output gets ahead of the input. Each byte is read
+	// before it's written, so a literal byte needs its own slot read first.
+	int iRead = 0;
+	int iWritten = 0;
+	int iMaxLead = -iInputSize;
+
+	while ( iRead < iInputSize )
+	{
+		uint8_t ctrl = pInput[ iRead++ ];
+		int iLength = ctrl & 0x7F;
+
+		if ( ctrl & 0x80 )
+		{
+			iRead += 1;
+
+			// ... the last byte of a run gets furthest ahead.
+			const int iLead = iWritten + iLength - 1 - iRead;
+			iMaxLead = ( iLead > iMaxLead ) ? iLead : iMaxLead;
+		}
+		else if ( iLength )
+		{
+			// ... each literal keeps the same lead.
+			const int iLead = iWritten - ( iRead + 1 );
+			iMaxLead = ( iLead > iMaxLead ) ? iLead : iMaxLead;
+
+			iRead += iLength;
+		}
+
+		iWritten += iLength;
+	}
+
+	// The write at offset w needs w < start of data + bytes read, and the data
+	// can't start before the buffer.
+	const int iDataStart = ( iMaxLead + 1 > 0 ) ? iMaxLead + 1 : 0;
+	const int iMargin = iDataStart + iInputSize - iOutputSize;
+	return ( iMargin > 0 ) ? iMargin : 0;
+}
+
+//------------------------------------------------------------------------------
+// Optimal Parse
+//------------------------------------------------------------------------------
+
+// Choose the blocks for one run of bytes that no block may cross (a plane, or
+// an index block). Both block types cost A + B * length, so the best choice at
+// each position is a sliding window minimum over the next 127 positions, and
+// the whole segment is parsed in linear time working backwards.
+static RleCost ParseSegment( std::vector< uint8_t >* pOutput, const uint8_t* pData, int iSize,
+							 double fSizeWeight, double fCycleWeight,
+							 std::vector< double >& best, std::vector< int >& choice )
+{
+	const double fLitA = fSizeWeight * 1 + fCycleWeight * kZ80LiteralBlockCycles;
+	const double fLitB = fSizeWeight * 1 + fCycleWeight * kZ80LiteralByteCycles;
+	const double fRunA = fSizeWeight * 2 + fCycleWeight * kZ80RunBlockCycles;
+	const double fRunB = fCycleWeight * kZ80RunByteCycles;
+
+	best.resize( iSize + 1 );
+	choice.resize( iSize + 1 );
+	best[ iSize ] = 0;
+
+	// Candidate end positions, best at the back. A literal can end anywhere in
+	// the next 127 bytes; a run only as far as the bytes stay equal.
+	std::deque< int > literalEnds;
+	std::deque< int > runEnds;
+
+	for ( int i = iSize - 1; i >= 0; --i )
+	{
+		const int j = i + 1;
+
+		while ( literalEnds.empty() == false && best[ literalEnds.front() ] + fLitB * literalEnds.front() >= best[ j ] + fLitB * j )
+		{
+			literalEnds.pop_front();
+		}
+
+		literalEnds.push_front( j );
+
+		if ( literalEnds.back() > i + 127 )
+		{
+			literalEnds.pop_back();
+		}
+
+		if ( j == iSize || pData[ i ] != pData[ j ] )
+		{
+			runEnds.clear();
+		}
+
+		while ( runEnds.empty() == false && best[ runEnds.front() ] + fRunB * runEnds.front() >= best[ j ] + fRunB * j )
+		{
+			runEnds.pop_front();
+		}
+
+		runEnds.push_front( j );
+
+		if ( runEnds.back() > i + 127 )
+		{
+			runEnds.pop_back();
+		}
+
+		const int iLitEnd = literalEnds.back();
+		const int iRunEnd = runEnds.back();
+
+		const double fLitCost = fLitA + fLitB * ( iLitEnd - i ) + best[ iLitEnd ];
+		const double fRunCost = fRunA + fRunB * ( iRunEnd - i ) + best[ iRunEnd ];
+
+		if ( fRunCost <= fLitCost )
+		{
+			best[ i ] = fRunCost;
+			choice[ i ] = -( iRunEnd - i );
+		}
+		else
+		{
+			best[ i ] = fLitCost;
+			choice[ i ] = iLitEnd - i;
+		}
+	}
+
+	// Walk forwards through the choices.
+	RleCost cost = { 0, 0 };
+
+	for ( int i = 0; i < iSize; )
+	{
+		if ( choice[ i ] < 0 )
+		{
+			const int iLength = -choice[ i ];
+
+			if ( pOutput )
+			{
+				pOutput->push_back( static_cast<uint8_t>( 0x80 | iLength ) );
+				pOutput->push_back( pData[ i ] );
+			}
+
+			cost.iSize += 2;
+			cost.iCycles += kZ80RunBlockCycles + kZ80RunByteCycles * iLength;
+			i += iLength;
+		}
+		else
+		{
+			const int iLength = choice[ i ];
+
+			if ( pOutput )
+			{
+				pOutput->push_back( static_cast<uint8_t>( iLength ) );
+				pOutput->insert( pOutput->end(), pData + i, pData + i + iLength );
+			}
+
+			cost.iSize += 1 + iLength;
+			cost.iCycles += kZ80LiteralBlockCycles + kZ80LiteralByteCycles * iLength;
+			i += iLength;
+		}
+	}
+
+	return cost;
+}
+
+RleCost RleOptimalParse( std::vector< uint8_t >* pOutput, std::vector< uint32_t >* pBlockOffsets,
+						 const uint8_t* pPlanes, int iInputSize, const RleParams& params,
+						 double fSizeWeight, double fCycleWeight )
+{
+	RleCost total = { 0, 0 };
+
+	std::vector< double > best;
+	std::vector< int > choice;
+
+	for ( int iPlane = 0; iPlane < params.iPlanes; ++iPlane )
+	{
+		const int iPlaneSize = PlaneSize( iPlane, params.iPlanes, iInputSize );
+		const int iBlock = params.iIndexBlock > 0 ? params.iIndexBlock : iPlaneSize;
+
+		for ( int iDone = 0; iDone < iPlaneSize; iDone += iBlock )
+		{
+			const int iLeft = iPlaneSize - iDone;
+
+			if ( pBlockOffsets && params.iIndexBlock > 0 )
+			{
+				pBlockOffsets->push_back( static_cast<uint32_t>( total.iSize ) );
+			}
+
+			RleCost cost = ParseSegment( pOutput, pPlanes + iDone, iLeft < iBlock ? iLeft : iBlock,
+										 fSizeWeight, fCycleWeight, best, choice );
+
+			total.iSize += cost.iSize;
+			total.iCycles += cost.iCycles;
+		}
+
+		pPlanes += iPlaneSize;
+
+		// end of plane.
+		if ( pOutput )
+		{
+			pOutput->push_back( 0 );
+		}
+
+		total.iSize += 1;
+		total.iCycles += kZ80EndCycles;
+	}
+
+	return total;
+}
+
+//==============================================================================
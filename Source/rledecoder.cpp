@@ -0,0 +1,923 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cstdarg>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "rle.h"
+#include "z80.h"
+
+//------------------------------------------------------------------------------
+// Decoder Plan
+//------------------------------------------------------------------------------
+//
+// The generated decoder writes every plane straight into interleaved output, so
+// each store steps DE on by the plane count. Each plane is decoded by the block
+// loop below, which is cut down to the block types the stream actually uses:
+//
+//   runs and literals   or a / jp m,run / ret z - the terminator can only
+//                       look like a literal header, so only that path tests it
+//   literals only       or a / ret z
+//   runs only           sub $80 / jr nc,run / ret - anything else is the end
+//   neither             inc hl / ret
+//
+// Runs and literals are stored whichever way is fastest for this stream. With
+// more than one plane, stepping DE on by the stride after every byte is what
+// costs, so the stride can instead be held in a register pair and added to HL,
+// with the source moved to DE for the duration:
+//
+//   runs       a djnz loop stepping DE, the same storing two bytes a turn, a
+//              djnz loop of ld (hl),a / add hl,de, or a jump into an unrolled
+//              chain of ld (hl),a / add hl,de
+//   literals   ldir (single plane), a byte loop, a loop of ldi / inc de, a jump
+//              into an unrolled chain of ldi / inc de, or into one of
+//              ld a,(de) / inc de / ld (hl),a / add hl,bc
+
+enum LiteralCopy
+{
+	COPY_LOOP,
+	COPY_LDIR,
+	COPY_CHAIN,
+	COPY_ADD_CHAIN,
+	COPY_LDI_LOOP,
+};
+
+enum RunStore
+{
+	RUN_LOOP,
+	RUN_PAIRS,
+	RUN_ADD,
+	RUN_CHAIN,
+};
+
+// Block counts of an encoded stream.
+struct StreamSurvey
+{
+	int iTerminators;
+	int iRuns;
+	int64_t iRunBytes;
+	int iMaxRun;
+	int iMaxLiteral;
+	int runs[ 128 ];		// run blocks of each length
+	int literals[ 128 ];	// literal blocks of each length
+};
+
+struct DecoderPlan
+{
+	int iStride;			// planes
+	bool bRuns;
+	bool bLiterals;
+	RunStore run;
+	LiteralCopy copy;
+	int iChainEntry;		// bytes per ldi in the chain
+	bool bLongChain;		// the add chain is too long to index with A alone
+};
+
+// Longest stride stepped with inc de. Larger strides add to E instead.
+static const int kMaxIncStride = 4;
+
+static void SurveyStream( StreamSurvey& survey, const uint8_t* pInput, int iInputSize )
+{
+	memset( &survey, 0, sizeof( survey ) );
+
+	int iCursor = 0;
+
+	while ( iCursor < iInputSize )
+	{
+		uint8_t ctrl = pInput[ iCursor++ ];
+		int iLength = ctrl & 0x7F;
+
+		if ( ctrl == 0 )
+		{
+			++survey.iTerminators;
+		}
+		else if ( ctrl & 0x80 )
+		{
+			++survey.iRuns;
+			survey.iRunBytes += iLength;
+			survey.iMaxRun = ( iLength > survey.iMaxRun ) ? iLength : survey.iMaxRun;
+			++survey.runs[ iLength ];
+			iCursor += 1;
+		}
+		else
+		{
+			++survey.literals[ iLength ];
+			survey.iMaxLiteral = ( iLength > survey.iMaxLiteral ) ? iLength : survey.iMaxLiteral;
+			iCursor += iLength;
+		}
+	}
+}
+
+// T-states to step DE on by k bytes.
+static int AdvanceCycles( int k )
+{
+	return ( k <= kMaxIncStride ) ? 6 * k : 27;
+}
+
+// T-states to multiply A by the chain entry size.
+static int ChainMultiplyCycles( int iEntry )
+{
+	switch ( iEntry )
+	{
+	case 2:		return 4;
+	case 3:		return 12;
+	case 4:		return 8;
+	default:	return 16;		// 5 or 6
+	}
+}
+
+// T-states for the body of a literal block of n bytes (after its header).
+static int64_t LiteralCycles( const DecoderPlan& plan, LiteralCopy copy, int n )
+{
+	switch ( copy )
+	{
+
+	case COPY_LDIR:
+		return 16 + 21 * n;
+
+	case COPY_CHAIN:
+		return ChainMultiplyCycles( plan.iChainEntry ) + 68 + n * ( 16 + AdvanceCycles( plan.iStride - 1 ) );
+
+	case COPY_ADD_CHAIN:
+		return ( plan.bLongChain ? 123 : 94 ) + 31 * n;
+
+	case COPY_LDI_LOOP:
+		return 13 + n * ( 29 + AdvanceCycles( plan.iStride - 1 ) );
+
+	default:
+		return 9 + n * ( 33 + AdvanceCycles( plan.iStride ) );
+
+	}
+}
+
+// T-states for the body of a run of n bytes, from the count in A (the header
+// is counted with the block loop).
+static int64_t RunCycles( const DecoderPlan& plan, RunStore run, int n )
+{
+	const int iAdvance = AdvanceCycles( plan.iStride );
+
+	switch ( run )
+	{
+
+	case RUN_PAIRS:
+	{
+		const int iPairs = n >> 1;
+		const int iPairCycles = iPairs * ( 27 + 2 * iAdvance ) - 5;
+
+		if ( n == 1 )
+		{
+			return 51 + iAdvance;
+		}
+
+		return ( n & 1 ) ? 46 + iAdvance + iPairCycles : 37 + iPairCycles;
+	}
+
+	case RUN_ADD:
+		return 51 + 31 * n;
+
+	case RUN_CHAIN:
+		return 113 + 18 * n;
+
+	default:
+	{
+		const bool bValueInC = ( plan.iStride > kMaxIncStride );
+		return 17 + ( bValueInC ? 4 : 0 ) - 5 + n * ( 7 + iAdvance + 13 + ( bValueInC ? 4 : 0 ) );
+	}
+
+	}
+}
+
+// T-states for all the run bodies of a stream, stored one way.
+static int64_t AllRunCycles( const DecoderPlan& plan, RunStore run, const StreamSurvey& survey )
+{
+	int64_t iCycles = 0;
+
+	for ( int n = 1; n < 128; ++n )
+	{
+		iCycles += survey.runs[ n ] * RunCycles( plan, run, n );
+	}
+
+	return iCycles;
+}
+
+// T-states for all the literal bodies of a stream, copied one way.
+static int64_t AllLiteralCycles( const DecoderPlan& plan, LiteralCopy copy, const StreamSurvey& survey )
+{
+	int64_t iCycles = 0;
+
+	for ( int n = 1; n < 128; ++n )
+	{
+		iCycles += survey.literals[ n ] * LiteralCycles( plan, copy, n );
+	}
+
+	return iCycles;
+}
+
+static void PlanDecoder( DecoderPlan& plan, const StreamSurvey& survey, const RleParams& params )
+{
+	plan.iStride = params.iPlanes;
+	plan.bRuns = ( survey.iRuns > 0 );
+	plan.bLiterals = ( survey.iMaxLiteral > 0 );
+	plan.run = RUN_LOOP;
+	plan.copy = ( plan.iStride == 1 ) ? COPY_LDIR : COPY_LOOP;
+	plan.iChainEntry = 2 + ( plan.iStride - 1 );
+	plan.bLongChain = ( survey.iMaxLiteral * 4 > 255 );
+
+	// ... runs: the run chain is indexed by A, 2 bytes per entry, which always
+	// fits. Storing pairs steps DE with inc de.
+	if ( plan.bRuns )
+	{
+		int64_t iBest = AllRunCycles( plan, RUN_LOOP, survey );
+
+		for ( RunStore run : { RUN_PAIRS, RUN_ADD, RUN_CHAIN } )
+		{
+			if ( run == RUN_PAIRS && plan.iStride > kMaxIncStride )
+			{
+				continue;
+			}
+
+			const int64_t iCycles = AllRunCycles( plan, run, survey );
+			if ( iCycles < iBest )
+			{
+				iBest = iCycles;
+				plan.run = run;
+			}
+		}
+	}
+
+	if ( plan.bLiterals == false || plan.iStride == 1 )
+	{
+		return;
+	}
+
+	// ... literals: the ldi chain offset (longest literal * entry size) has to
+	// fit in A, and each entry steps DE with inc de.
+	int64_t iBest = AllLiteralCycles( plan, plan.copy, survey );
+
+	if ( plan.iStride <= kMaxIncStride + 1 )
+	{
+		const int64_t iCycles = AllLiteralCycles( plan, COPY_LDI_LOOP, survey );
+		if ( iCycles < iBest )
+		{
+			iBest = iCycles;
+			plan.copy = COPY_LDI_LOOP;
+		}
+	}
+
+	if ( plan.iStride <= kMaxIncStride + 1 && survey.iMaxLiteral * plan.iChainEntry <= 255 )
+	{
+		const int64_t iCycles = AllLiteralCycles( plan, COPY_CHAIN, survey );
+		if ( iCycles < iBest )
+		{
+			iBest = iCycles;
+			plan.copy = COPY_CHAIN;
+		}
+	}
+
+	if ( AllLiteralCycles( plan, COPY_ADD_CHAIN, survey ) < iBest )
+	{
+		plan.copy = COPY_ADD_CHAIN;
+	}
+}
+
+// Estimated T-states to decode the whole stream, including the unfilter pass.
+static int64_t DecoderCycles( const DecoderPlan& plan, const StreamSurvey& survey, const RleParams& params, int iOutputSize )
+{
+	const int iStride = plan.iStride;
+	int64_t iCycles = 0;
+
+	// ... block headers and the terminators.
+	if ( plan.bRuns && plan.bLiterals )
+	{
+		int64_t iLiterals = 0;
+		for ( int n = 1; n < 128; ++n )
+		{
+			iLiterals += survey.literals[ n ];
+		}
+
+		iCycles += 27 * ( survey.iRuns + iLiterals + survey.iTerminators ) + 5 * iLiterals + 11 * survey.iTerminators;
+		iCycles += 7 * survey.iRuns;
+	}
+	else if ( plan.bRuns == false && plan.bLiterals == false )
+	{
+		iCycles += 16 * survey.iTerminators;
+	}
+	else if ( plan.bRuns )
+	{
+		// ... jp nc reaches back over a run chain, where jr nc can't.
+		if ( plan.run == RUN_CHAIN )
+		{
+			iCycles += 30 * survey.iRuns + 40 * survey.iTerminators;
+		}
+		else
+		{
+			iCycles += 32 * survey.iRuns + 37 * survey.iTerminators;
+		}
+	}
+	else
+	{
+		for ( int n = 1; n < 128; ++n )
+		{
+			iCycles += survey.literals[ n ] * ( 17 + 5 );
+		}
+
+		iCycles += 28 * survey.iTerminators;
+	}
+
+	// ... run and literal bodies.
+	if ( plan.bRuns )
+	{
+		iCycles += AllRunCycles( plan, plan.run, survey );
+	}
+
+	iCycles += AllLiteralCycles( plan, plan.copy, survey );
+
+	// ... the plane loop.
+	const bool bFilter = ( params.filter != FILTER_NONE );
+
+	if ( iStride > 1 )
+	{
+		iCycles += 7 + 78 * iStride - 5;
+	}
+	else if ( bFilter )
+	{
+		iCycles += 17;
+	}
+
+	if ( bFilter )
+	{
+		const int iDistance = ( params.filter == FILTER_DELTA ) ? iStride : iStride * params.iFilterPitch;
+		const int iCount = iOutputSize - iDistance;
+
+		iCycles += 11 + 10 + 10;
+
+		if ( iCount > 0 )
+		{
+			const int iOuter = ( iCount + 255 ) >> 8;
+			iCycles += 11 + 10 + 11 + 10 + 10;
+			iCycles += 46 * static_cast<int64_t>( iCount ) - 5 * iOuter + 4 * iOuter + 12 * ( iOuter - 1 ) + 7;
+		}
+	}
+	else if ( iStride > 1 )
+	{
+		iCycles += 10;
+	}
+
+	return iCycles;
+}
+
+//------------------------------------------------------------------------------
+// Code Generation
+//------------------------------------------------------------------------------
+
+struct DecoderWriter
+{
+	std::string text;
+	std::string label;
+
+	void Line( const char* pFormat, ... )
+	{
+		char buffer[ 256 ];
+
+		va_list	vl;
+		va_start( vl, pFormat );
+		vsprintf_s( buffer, sizeof( buffer ), pFormat, vl );
+		va_end( vl );
+
+		text += buffer;
+		text += '\n';
+	}
+
+	void Label( const char* pSuffix )
+	{
+		Line( "%s%s:", label.c_str(), pSuffix );
+	}
+
+	// Push the address 4 * count bytes before the label with this suffix, for
+	// a ret into an unrolled chain. Takes the count in A and trashes BC.
+	void PushChainEntry( const char* pSuffix, bool bLong )
+	{
+		if ( bLong )
+		{
+			// ... end - 2 * ( 2 * count ). Carry is clear after add a,a.
+			Line( "\tadd a,a" );
+			Line( "\tld c,a" );
+			Line( "\tld b,0" );
+			Line( "\tpush hl" );
+			Line( "\tld hl,%s%s", label.c_str(), pSuffix );
+			Line( "\tsbc hl,bc" );
+			Line( "\tsbc hl,bc" );
+			Line( "\tex (sp),hl" );
+			return;
+		}
+
+		Line( "\tadd a,a" );
+		Line( "\tadd a,a" );
+		Line( "\tld c,a" );
+		Line( "\tld a,%s%s&$FF", label.c_str(), pSuffix );
+		Line( "\tsub c" );
+		Line( "\tld c,a" );
+		Line( "\tld a,%s%s>>8", label.c_str(), pSuffix );
+		Line( "\tsbc a,0" );
+		Line( "\tld b,a" );
+		Line( "\tpush bc" );
+	}
+
+	// Step DE on by k bytes. Trashes A if k is large.
+	void Advance( int k )
+	{
+		if ( k <= kMaxIncStride )
+		{
+			for ( int i = 0; i < k; ++i )
+			{
+				Line( "\tinc de" );
+			}
+		}
+		else
+		{
+			Line( "\tld a,e" );
+			Line( "\tadd a,%d", k );
+			Line( "\tld e,a" );
+			Line( "\tjr nc,$+3" );
+			Line( "\tinc d" );
+		}
+	}
+};
+
+// The block loop for one plane. bEntry puts the routine's own label on it.
+static void WriteBlockLoop( DecoderWriter& w, const DecoderPlan& plan, int iMaxRun, int iMaxLiteral, bool bEntry )
+{
+	const int iStride = plan.iStride;
+	const bool bValueInC = ( iStride > kMaxIncStride );
+
+	// Runs come first so they fall straight through into the next block header.
+	if ( plan.bRuns && plan.run == RUN_ADD )
+	{
+		w.Label( "_run" );
+
+		if ( plan.bLiterals )
+		{
+			w.Line( "\tand %%01111111\t\t\t\t; Clear the top bit, leaving the count" );
+		}
+
+		w.Line( "\tld b,a" );
+		w.Line( "\tld a,(hl)\t\t\t\t\t; Value to repeat" );
+		w.Line( "\tinc hl" );
+		w.Line( "\tex de,hl\t\t\t\t\t; HL = output, stepped by the plane count in DE" );
+		w.Line( "\tpush de" );
+		w.Line( "\tld de,%d", iStride );
+		w.Label( "_run_loop" );
+		w.Line( "\tld (hl),a" );
+		w.Line( "\tadd hl,de" );
+		w.Line( "\tdjnz %s_run_loop", w.label.c_str() );
+		w.Line( "\tpop de" );
+		w.Line( "\tex de,hl" );
+		w.Line( "\t; * fall through" );
+	}
+	else if ( plan.bRuns && plan.run == RUN_PAIRS )
+	{
+		w.Label( "_run" );
+
+		if ( plan.bLiterals )
+		{
+			w.Line( "\tand %%01111111\t\t\t\t; Clear the top bit, leaving the count" );
+		}
+
+		w.Line( "\tld b,a" );
+		w.Line( "\tld a,(hl)\t\t\t\t\t; Value to repeat" );
+		w.Line( "\tinc hl" );
+		w.Line( "\tsrl b\t\t\t\t\t\t; Store two bytes a turn, and one first if the count is odd" );
+		w.Line( "\tjr nc,%s_run_loop", w.label.c_str() );
+		w.Line( "\tld (de),a" );
+		w.Advance( iStride );
+		w.Line( "\tjr z,%s_block\t\t\t\t; Just the one?", w.label.c_str() );
+		w.Label( "_run_loop" );
+		w.Line( "\tld (de),a" );
+		w.Advance( iStride );
+		w.Line( "\tld (de),a" );
+		w.Advance( iStride );
+		w.Line( "\tdjnz %s_run_loop", w.label.c_str() );
+		w.Line( "\t; * fall through" );
+	}
+	else if ( plan.bRuns && plan.run == RUN_CHAIN )
+	{
+		w.Label( "_run" );
+
+		if ( plan.bLiterals )
+		{
+			w.Line( "\tand %%01111111\t\t\t\t; Clear the top bit, leaving the count" );
+		}
+
+		// ... carry is clear after add a,a, for the sbc.
+		w.Line( "\tadd a,a\t\t\t\t\t\t; Jump into the run chain, 2 bytes per byte to store" );
+		w.Line( "\tld c,a" );
+		w.Line( "\tld a,(hl)\t\t\t\t\t; Value to repeat" );
+		w.Line( "\tinc hl" );
+		w.Line( "\tpush hl" );
+		w.Line( "\tld hl,%s_run_end", w.label.c_str() );
+		w.Line( "\tld b,0" );
+		w.Line( "\tsbc hl,bc" );
+		w.Line( "\tpush hl" );
+		w.Line( "\tex de,hl\t\t\t\t\t; HL = output, stepped by the plane count in DE" );
+		w.Line( "\tld de,%d", iStride );
+		w.Line( "\tret" );
+		w.Label( "_run_chain" );
+
+		for ( int i = 0; i < iMaxRun; ++i )
+		{
+			w.Line( "\tld (hl),a" );
+			w.Line( "\tadd hl,de" );
+		}
+
+		w.Label( "_run_end" );
+		w.Line( "\tpop de" );
+		w.Line( "\tex de,hl" );
+		w.Line( "\t; * fall through" );
+	}
+	else if ( plan.bRuns )
+	{
+		w.Label( "_run" );
+
+		if ( plan.bLiterals )
+		{
+			w.Line( "\tand %%01111111\t\t\t\t; Clear the top bit, leaving the count" );
+		}
+
+		w.Line( "\tld b,a" );
+		w.Line( "\tld a,(hl)\t\t\t\t\t; Value to repeat" );
+		w.Line( "\tinc hl" );
+
+		if ( bValueInC )
+		{
+			w.Line( "\tld c,a" );
+		}
+
+		w.Label( "_run_loop" );
+
+		if ( bValueInC )
+		{
+			w.Line( "\tld a,c" );
+		}
+
+		w.Line( "\tld (de),a" );
+		w.Advance( iStride );
+		w.Line( "\tdjnz %s_run_loop", w.label.c_str() );
+		w.Line( "\t; * fall through" );
+	}
+
+	if ( bEntry )
+	{
+		w.Line( "%s:", w.label.c_str() );
+	}
+
+	w.Label( "_block" );
+
+	if ( plan.bRuns == false && plan.bLiterals == false )
+	{
+		// ... nothing but terminators.
+		w.Line( "\tinc hl\t\t\t\t\t\t; Skip the 00 terminator" );
+		w.Line( "\tret" );
+		return;
+	}
+
+	w.Line( "\tld a,(hl)\t\t\t\t\t; Load the RLE block header" );
+	w.Line( "\tinc hl" );
+
+	if ( plan.bLiterals == false )
+	{
+		// ... every header is a run, or the terminator.
+		w.Line( "\tsub $80\t\t\t\t\t\t; Run count, or carry for the 00 terminator" );
+		w.Line( ( plan.run == RUN_CHAIN ) ? "\tjp nc,%s_run" : "\tjr nc,%s_run", w.label.c_str() );
+		w.Line( "\tret" );
+		return;
+	}
+
+	w.Line( "\tor a" );
+
+	if ( plan.bRuns )
+	{
+		w.Line( "\tjp m,%s_run\t\t\t\t; Top bit set? It's a run", w.label.c_str() );
+	}
+
+	w.Line( "\tret z\t\t\t\t\t\t; 00 marks the end of the plane" );
+
+	switch ( plan.copy )
+	{
+
+	case COPY_LDIR:
+
+		w.Line( "\tld c,a\t\t\t\t\t\t; Copy 1-%d literal bytes", iMaxLiteral );
+		w.Line( "\tld b,0" );
+		w.Line( "\tldir" );
+		w.Line( "\tjp %s_block", w.label.c_str() );
+		break;
+
+	case COPY_LOOP:
+
+		w.Line( "\tld b,a\t\t\t\t\t\t; Copy 1-%d literal bytes", iMaxLiteral );
+		w.Label( "_literal_loop" );
+		w.Line( "\tld a,(hl)" );
+		w.Line( "\tinc hl" );
+		w.Line( "\tld (de),a" );
+		w.Advance( iStride );
+		w.Line( "\tdjnz %s_literal_loop", w.label.c_str() );
+		w.Line( "\tjp %s_block", w.label.c_str() );
+		break;
+
+	case COPY_CHAIN:
+
+		// ... jump to chain_end - count * entry size.
+		w.Line( "\t; Jump into the ldi chain, %d bytes per literal byte", plan.iChainEntry );
+
+		switch ( plan.iChainEntry )
+		{
+		case 2:
+			w.Line( "\tadd a,a" );
+			break;
+		case 3:
+			w.Line( "\tld c,a" );
+			w.Line( "\tadd a,a" );
+			w.Line( "\tadd a,c" );
+			break;
+		case 4:
+			w.Line( "\tadd a,a" );
+			w.Line( "\tadd a,a" );
+			break;
+		case 5:
+			w.Line( "\tld c,a" );
+			w.Line( "\tadd a,a" );
+			w.Line( "\tadd a,a" );
+			w.Line( "\tadd a,c" );
+			break;
+		default:
+			w.Line( "\tadd a,a" );
+			w.Line( "\tld c,a" );
+			w.Line( "\tadd a,a" );
+			w.Line( "\tadd a,c" );
+			break;
+		}
+
+		w.Line( "\tld c,a" );
+		w.Line( "\tld a,%s_chain_end&$FF", w.label.c_str() );
+		w.Line( "\tsub c" );
+		w.Line( "\tld c,a" );
+		w.Line( "\tld a,%s_chain_end>>8", w.label.c_str() );
+		w.Line( "\tsbc a,0" );
+		w.Line( "\tld b,a" );
+		w.Line( "\tpush bc" );
+		w.Line( "\tret" );
+		w.Label( "_chain" );
+
+		for ( int i = 0; i < iMaxLiteral; ++i )
+		{
+			w.Line( "\tldi" );
+			w.Advance( iStride - 1 );
+		}
+
+		w.Label( "_chain_end" );
+		w.Line( "\tjp %s_block", w.label.c_str() );
+		break;
+
+	case COPY_LDI_LOOP:
+
+		// ... ldi counts C down too, from the same count, so B is left to djnz.
+		w.Line( "\tld b,a\t\t\t\t\t\t; Copy 1-%d literal bytes", iMaxLiteral );
+		w.Line( "\tld c,a" );
+		w.Label( "_literal_loop" );
+		w.Line( "\tldi" );
+		w.Advance( iStride - 1 );
+		w.Line( "\tdjnz %s_literal_loop", w.label.c_str() );
+		w.Line( "\tjp %s_block", w.label.c_str() );
+		break;
+
+	case COPY_ADD_CHAIN:
+
+		w.Line( "\t; Jump into the copy chain, 4 bytes per literal byte" );
+		w.PushChainEntry( "_chain_end", plan.bLongChain );
+		w.Line( "\tld bc,%d\t\t\t\t\t; HL = output, stepped by the plane count in BC", iStride );
+		w.Line( "\tex de,hl" );
+		w.Line( "\tret" );
+		w.Label( "_chain" );
+
+		for ( int i = 0; i < iMaxLiteral; ++i )
+		{
+			w.Line( "\tld a,(de)" );
+			w.Line( "\tinc de" );
+			w.Line( "\tld (hl),a" );
+			w.Line( "\tadd hl,bc" );
+		}
+
+		w.Label( "_chain_end" );
+		w.Line( "\tex de,hl" );
+		w.Line( "\tjp %s_block", w.label.c_str() );
+		break;
+
+	}
+}
+
+// Plane loop and unfilter pass, when there is more than a single plain plane.
+static void WriteEntry( DecoderWriter& w, const DecoderPlan& plan, const RleParams& params, int iOutputSize )
+{
+	const int iStride = plan.iStride;
+	const bool bFilter = ( params.filter != FILTER_NONE );
+
+	w.Line( "%s:", w.label.c_str() );
+
+	if ( bFilter )
+	{
+		w.Line( "\tpush de\t\t\t\t\t\t; Keep the output address for the unfilter pass" );
+	}
+
+	if ( iStride > 1 )
+	{
+		w.Line( "\tld b,%d\t\t\t\t\t\t; Planes", iStride );
+		w.Label( "_planes" );
+		w.Line( "\tpush bc" );
+		w.Line( "\tpush de" );
+		w.Line( "\tcall %s_block", w.label.c_str() );
+		w.Line( "\tpop de" );
+		w.Line( "\tinc de\t\t\t\t\t\t; The next plane starts one byte later" );
+		w.Line( "\tpop bc" );
+		w.Line( "\tdjnz %s_planes", w.label.c_str() );
+	}
+	else
+	{
+		w.Line( "\tcall %s_block", w.label.c_str() );
+	}
+
+	if ( bFilter == false )
+	{
+		w.Line( "\tret" );
+		return;
+	}
+
+	// ... with the planes interleaved, both filters become one pass of
+	// out[i] op= out[i - distance] over the whole output.
+	const bool bDelta = ( params.filter == FILTER_DELTA );
+	const int iDistance = bDelta ? iStride : iStride * params.iFilterPitch;
+	const int iCount = iOutputSize - iDistance;
+
+	w.Line( "\tpop de" );
+
+	if ( iCount > 0 )
+	{
+		w.Line( "\tpush hl\t\t\t\t\t\t; Keep the end of the RLE data" );
+		w.Line( "\tld hl,%d", iDistance );
+		w.Line( "\tadd hl,de" );
+		w.Line( "\tld bc,$%04X\t\t\t\t\t; %d bytes", ( ( iCount & 0xFF ) << 8 ) | ( ( iCount + 255 ) >> 8 ), iCount );
+		w.Label( "_unfilter" );
+		w.Line( "\tld a,(de)" );
+		w.Line( bDelta ? "\tadd a,(hl)" : "\txor (hl)" );
+		w.Line( "\tld (hl),a" );
+		w.Line( "\tinc hl" );
+		w.Line( "\tinc de" );
+		w.Line( "\tdjnz %s_unfilter", w.label.c_str() );
+		w.Line( "\tdec c" );
+		w.Line( "\tjr nz,%s_unfilter", w.label.c_str() );
+		w.Line( "\tpop hl" );
+	}
+
+	w.Line( "\tret" );
+}
+
+//------------------------------------------------------------------------------
+// Interface
+//------------------------------------------------------------------------------
+
+bool WriteRleDecoder( RleDecoderInfo& info, const char* pName, const char* pLabel, const char* pDataName,
+					  const uint8_t* pInput, int iInputSize, int iOutputSize, const RleParams& params )
+{
+	StreamSurvey survey;
+	SurveyStream( survey, pInput, iInputSize );
+
+	DecoderPlan plan;
+	PlanDecoder( plan, survey, params );
+
+	DecoderWriter w;
+	w.label = pLabel;
+
+	char options[ 256 ];
+	FormatRleParams( options, sizeof( options ), params );
+
+	static const char* kCopyNames[] = { "byte loop", "ldir", "unrolled ldi", "unrolled copy", "ldi loop" };
+
+	const bool bEntry = ( plan.iStride > 1 || params.filter != FILTER_NONE );
+
+	info.iCycles = DecoderCycles( plan, survey, params, iOutputSize );
+
+	w.Line( "; Generated by \"BinaryTools rle -emit-decoder\" for %s.", pDataName );
+	w.Line( "; Written for vasm 1.8L \"oldstyle\", other assemblers may require changes." );
+	w.Line( ";" );
+	w.Line( "; Only for data encoded with the same options (%s)", options );
+
+	if ( plan.bLiterals )
+	{
+		w.Line( "; and with literals of at most %d bytes%s.", survey.iMaxLiteral, plan.bRuns ? "" : " and no runs" );
+	}
+	else
+	{
+		w.Line( "; and with no literals." );
+	}
+
+	w.Line( "; Re-generate it if the data changes." );
+	w.Line( "" );
+	w.Line( ";========================================================" );
+	w.Line( ";" );
+	w.Line( "; %s", pLabel );
+	w.Line( ";" );
+	if ( plan.iStride > 1 )
+	{
+		w.Line( "; Decompress %d planes, %d bytes in all, writing them", plan.iStride, iOutputSize );
+		w.Line( "; interleaved%s.", ( params.filter != FILTER_NONE ) ? " and undoing the filter" : "" );
+	}
+	else
+	{
+		w.Line( "; Decompress %d bytes%s.", iOutputSize, ( params.filter != FILTER_NONE ) ? " and undo the filter" : "" );
+	}
+
+	w.Line( "; Literals are copied with %s.", kCopyNames[ plan.copy ] );
+	w.Line( ";" );
+	w.Line( "; Inputs:\tHL = Address of compressed RLE data" );
+	w.Line( ";\t\t\tDE = Address of decompression target" );
+	w.Line( ";" );
+	w.Line( "; Outputs:\tHL = Address after the compressed data" );
+	w.Line( ";" );
+	w.Line( "; Trashes A, BC and DE registers." );
+	w.Line( ";" );
+	w.Line( "; About %lld T-states.", static_cast<long long>( info.iCycles ) );
+	w.Line( ";" );
+	w.Line( ";========================================================" );
+	w.Line( "" );
+
+	if ( bEntry )
+	{
+		WriteEntry( w, plan, params, iOutputSize );
+		w.Line( "" );
+	}
+
+	// ... a plain single plane needs no entry code, so the block loop is the routine.
+	if ( bEntry == false && plan.bRuns )
+	{
+		w.Line( "\t; %s starts below, at the first block header.", pLabel );
+	}
+
+	WriteBlockLoop( w, plan, survey.iMaxRun, survey.iMaxLiteral, bEntry == false );
+
+	// Assemble it, to measure it (and make sure it does assemble).
+	std::vector< uint8_t > memory( 65536 );
+
+	Z80Source source;
+	source.name = pName;
+	source.text = w.text;
+
+	Z80Program program;
+	if ( AssembleZ80( program, memory.data(), std::vector< Z80Source >( 1, source ) ) == false )
+	{
+		PrintError( "Generated decoder doesn't assemble: %s", program.error.c_str() );
+		return false;
+	}
+
+	info.iSize = program.iEnd - program.iStart;
+
+	FILE* fp;
+	int err = fopen_s( &fp, pName, "wb" );
+	if ( err != 0 || fp == nullptr )
+	{
+		PrintError( "Cannot open decoder file \"%s\"", pName );
+		return false;
+	}
+
+	fwrite( w.text.data(), 1, w.text.size(), fp );
+	fclose( fp );
+
+	return true;
+}
+
+//==============================================================================
@@ -0,0 +1,238 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+#include "utils.h"
+#include "rle.h"
+
+//------------------------------------------------------------------------------
+// Little-endian helpers
+//------------------------------------------------------------------------------
+
+static void PutLE( std::vector< uint8_t >& out, uint32_t value, int iBytes )
+{
+	for ( int i = 0; i < iBytes; ++i )
+	{
+		out.push_back( static_cast<uint8_t>( value >> ( i * 8 ) ) );
+	}
+}
+
+static uint32_t GetLE( const uint8_t* p, int iBytes )
+{
+	uint32_t value = 0;
+
+	for ( int i = iBytes - 1; i >= 0; --i )
+	{
+		value = ( value << 8 ) | p[ i ];
+	}
+
+	return value;
+}
+
+// Fill in the filter from a stored id and pitch. Returns false if they're invalid.
+static bool ReadFilter( RleParams& params, uint32_t filter, uint32_t pitch )
+{
+	params.filter = static_cast<RleFilter>( filter );
+	params.iFilterPitch = static_cast<int>( pitch );
+
+	if ( params.filter == FILTER_DELTA )
+	{
+		params.iFilterPitch = 1;
+	}
+	else if ( params.filter == FILTER_NONE )
+	{
+		params.iFilterPitch = 0;
+	}
+	else if ( params.filter != FILTER_XOR_ROW || params.iFilterPitch == 0 )
+	{
+		return false;
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Indexed Container
+//------------------------------------------------------------------------------
+
+int RleIndexPlaneBlocks( int iPlane, const RleParams& params, int iOutputSize )
+{
+	const int iPlaneSize = PlaneSize( iPlane, params.iPlanes, iOutputSize );
+	return ( iPlaneSize + params.iIndexBlock - 1 ) / params.iIndexBlock;
+}
+
+void WriteRleIndex( std::vector< uint8_t >& out, const RleParams& params, int iOutputSize, const std::vector< uint32_t >& offsets )
+{
+	out.push_back( 'R' );
+	out.push_back( 'L' );
+	out.push_back( 'E' );
+	out.push_back( 'X' );
+
+	PutLE( out, params.iPlanes, 1 );
+	PutLE( out, params.filter, 1 );
+	PutLE( out, params.filter == FILTER_XOR_ROW ? params.iFilterPitch : 0, 2 );
+	PutLE( out, params.iIndexBlock, 4 );
+	PutLE( out, iOutputSize, 4 );
+	PutLE( out, static_cast<uint32_t>( offsets.size() ), 4 );
+
+	for ( uint32_t offset : offsets )
+	{
+		PutLE( out, offset, 4 );
+	}
+}
+
+bool ReadRleIndex( RleIndex& index, const uint8_t* pInput, int iInputSize )
+{
+	if ( iInputSize < kRleIndexHeaderSize || memcmp( pInput, "RLEX", 4 ) != 0 )
+	{
+		return false;
+	}
+
+	RleParams& params = index.params;
+	DefaultRleParams( params );
+
+	params.iPlanes = pInput[ 4 ];
+	params.iIndexBlock = GetLE( pInput + 8, 4 );
+
+	const uint32_t outputSize = GetLE( pInput + 12, 4 );
+	const uint32_t entryCount = GetLE( pInput + 16, 4 );
+
+	if ( params.iPlanes == 0 || params.iIndexBlock <= 0 || outputSize > 0x7FFFFFFF )
+	{
+		return false;
+	}
+
+	if ( ReadFilter( params, pInput[ 5 ], GetLE( pInput + 6, 2 ) ) == false )
+	{
+		return false;
+	}
+
+	index.iOutputSize = static_cast<int>( outputSize );
+
+	// ... the table must have one entry per block, and fit in the file.
+	uint32_t expected = 0;
+	for ( int iPlane = 0; iPlane < params.iPlanes; ++iPlane )
+	{
+		expected += RleIndexPlaneBlocks( iPlane, params, index.iOutputSize );
+	}
+
+	if ( entryCount != expected || entryCount > static_cast<uint32_t>( iInputSize - kRleIndexHeaderSize ) / 4 )
+	{
+		return false;
+	}
+
+	index.iDataStart = kRleIndexHeaderSize + entryCount * 4;
+	index.offsets.resize( entryCount );
+
+	const uint32_t dataSize = iInputSize - index.iDataStart;
+
+	for ( uint32_t i = 0; i < entryCount; ++i )
+	{
+		index.offsets[ i ] = GetLE( pInput + kRleIndexHeaderSize + i * 4, 4 );
+
+		if ( index.offsets[ i ] >= dataSize || ( i > 0 && index.offsets[ i ] < index.offsets[ i - 1 ] ) )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Archive
+//------------------------------------------------------------------------------
+
+void WriteRleArchive( std::vector< uint8_t >& out, const std::vector< RleArchiveEntry >& entries )
+{
+	out.push_back( 'R' );
+	out.push_back( 'L' );
+	out.push_back( 'E' );
+	out.push_back( 'A' );
+
+	PutLE( out, static_cast<uint32_t>( entries.size() ), 4 );
+
+	for ( const RleArchiveEntry& entry : entries )
+	{
+		PutLE( out, entry.iOffset, 4 );
+		PutLE( out, entry.iOutputSize, 4 );
+		PutLE( out, entry.params.iPlanes, 1 );
+		PutLE( out, entry.params.filter, 1 );
+		PutLE( out, entry.params.filter == FILTER_XOR_ROW ? entry.params.iFilterPitch : 0, 2 );
+	}
+}
+
+bool ReadRleArchive( std::vector< RleArchiveEntry >& entries, const uint8_t* pInput, int iInputSize )
+{
+	if ( iInputSize < kRleArchiveHeaderSize || memcmp( pInput, "RLEA", 4 ) != 0 )
+	{
+		return false;
+	}
+
+	const uint32_t entryCount = GetLE( pInput + 4, 4 );
+
+	if ( entryCount > static_cast<uint32_t>( iInputSize - kRleArchiveHeaderSize ) / kRleArchiveEntrySize )
+	{
+		return false;
+	}
+
+	const uint32_t dataStart = kRleArchiveHeaderSize + entryCount * kRleArchiveEntrySize;
+
+	entries.resize( entryCount );
+
+	for ( uint32_t i = 0; i < entryCount; ++i )
+	{
+		const uint8_t* p = pInput + kRleArchiveHeaderSize + i * kRleArchiveEntrySize;
+		RleArchiveEntry& entry = entries[ i ];
+
+		DefaultRleParams( entry.params );
+
+		const uint32_t offset = GetLE( p, 4 );
+		const uint32_t outputSize = GetLE( p + 4, 4 );
+		entry.params.iPlanes = p[ 8 ];
+
+		// ... every stream holds at least a terminator.
+		if ( offset < dataStart || offset >= static_cast<uint32_t>( iInputSize ) || outputSize > 0x7FFFFFFF || entry.params.iPlanes == 0 )
+		{
+			return false;
+		}
+
+		if ( ReadFilter( entry.params, p[ 9 ], GetLE( p + 10, 2 ) ) == false )
+		{
+			return false;
+		}
+
+		entry.iOffset = static_cast<int>( offset );
+		entry.iOutputSize = static_cast<int>( outputSize );
+	}
+
+	return true;
+}
+
+//==============================================================================
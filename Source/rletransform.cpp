@@ -0,0 +1,913 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+#include "utils.h"
+#include "rle.h"
+
+#ifdef BINARYTOOLS_SSE2
+#include <emmintrin.h>
+#endif
+
+//------------------------------------------------------------------------------
+// Parameters
+//------------------------------------------------------------------------------
+
+void DefaultRleParams( RleParams& params )
+{
+	params.iPlanes = 1;
+	params.iWordSize = 1;
+	params.filter = FILTER_NONE;
+	params.iFilterPitch = 0;
+	params.scan = SCAN_ROWS;
+	params.iScanW = 0;
+	params.iScanH = 0;
+	params.iWidth = 0;
+	params.iIndexBlock = 0;
+	params.bNibbles = false;
+}
+
+bool ParseRleFilter( RleParams& params, const char* pArg )
+{
+	if ( _stricmp( pArg, "none" ) == 0 )
+	{
+		params.filter = FILTER_NONE;
+		params.iFilterPitch = 0;
+		return true;
+	}
+	else if ( _stricmp( pArg, "delta" ) == 0 )
+	{
+		params.filter = FILTER_DELTA;
+		params.iFilterPitch = 1;
+		return true;
+	}
+	else if ( _strnicmp( pArg, "xor-row:", 8 ) == 0 )
+	{
+		int iPitch = ParseValue( pArg + 8, 0x7FFFFFFF );
+		if ( iPitch < 1 )
+		{
+			return false;
+		}
+
+		params.filter = FILTER_XOR_ROW;
+		params.iFilterPitch = iPitch;
+		return true;
+	}
+
+	return false;
+}
+
+// Parse "<w>x<h>" with both values 1 or more.
+static bool ParseDimensions( const char* pArg, int& iW, int& iH )
+{
+	char* pEnd = nullptr;
+	iW = strtol( pArg, &pEnd, 10 );
+
+	if ( pEnd == pArg || ( *pEnd != 'x' && *pEnd != 'X' ) )
+	{
+		return false;
+	}
+
+	const char* pHeight = pEnd + 1;
+	iH = strtol( pHeight, &pEnd, 10 );
+
+	if ( pEnd == pHeight || *pEnd != 0 )
+	{
+		return false;
+	}
+
+	return ( iW > 0 && iH > 0 );
+}
+
+bool ParseRleScan( RleParams& params, const char* pArg )
+{
+	if ( _stricmp( pArg, "rows" ) == 0 )
+	{
+		params.scan = SCAN_ROWS;
+		return true;
+	}
+	else if ( _stricmp( pArg, "zigzag" ) == 0 )
+	{
+		params.scan = SCAN_ZIGZAG;
+		return true;
+	}
+	else if ( _strnicmp( pArg, "column:", 7 ) == 0 )
+	{
+		params.scan = SCAN_COLUMN;
+		return ParseDimensions( pArg + 7, params.iScanW, params.iScanH );
+	}
+	else if ( _strnicmp( pArg, "tile:", 5 ) == 0 )
+	{
+		params.scan = SCAN_TILE;
+		return ParseDimensions( pArg + 5, params.iScanW, params.iScanH );
+	}
+
+	return false;
+}
+
+const char* CheckRleParams( const RleParams& params )
+{
+	if ( params.scan == SCAN_TILE || params.scan == SCAN_ZIGZAG )
+	{
+		if ( params.iWidth <= 0 )
+		{
+			return "This -scan needs the row width in bytes. Use -width N.";
+		}
+
+		if ( params.scan == SCAN_TILE && ( params.iWidth % params.iScanW ) != 0 )
+		{
+			return "The -width must be a multiple of the tile width.";
+		}
+	}
+
+	if ( params.iIndexBlock > 0 )
+	{
+		// ... the seek table maps plane offsets straight to blocks, so the
+		// plane must be stored in its original order.
+		if ( params.scan != SCAN_ROWS )
+		{
+			return "-index can't be combined with -scan.";
+		}
+
+		if ( params.iFilterPitch > 0xFFFF || params.iPlanes > 0xFF )
+		{
+			return "-index supports up to 255 planes and a filter pitch up to 65535.";
+		}
+
+		// ... seek blocks are decoded with the byte format.
+		if ( params.bNibbles )
+		{
+			return "-index can't be combined with -nibble.";
+		}
+	}
+
+	return nullptr;
+}
+
+void FormatRleParams( char* pBuffer, size_t size, const RleParams& params )
+{
+	int count = snprintf( pBuffer, size, "-planes %d", params.iPlanes );
+
+	switch ( params.filter )
+	{
+
+	case FILTER_NONE:
+		break;
+
+	case FILTER_DELTA:
+		count += snprintf( pBuffer + count, size - count, " -filter delta" );
+		break;
+
+	case FILTER_XOR_ROW:
+		count += snprintf( pBuffer + count, size - count, " -filter xor-row:%d", params.iFilterPitch );
+		break;
+
+	}
+
+	switch ( params.scan )
+	{
+
+	case SCAN_ROWS:
+		break;
+
+	case SCAN_COLUMN:
+		count += snprintf( pBuffer + count, size - count, " -scan column:%dx%d", params.iScanW, params.iScanH );
+		break;
+
+	case SCAN_TILE:
+		count += snprintf( pBuffer + count, size - count, " -scan tile:%dx%d -width %d", params.iScanW, params.iScanH, params.iWidth );
+		break;
+
+	case SCAN_ZIGZAG:
+		count += snprintf( pBuffer + count, size - count, " -scan zigzag -width %d", params.iWidth );
+		break;
+
+	}
+
+	if ( params.iIndexBlock > 0 )
+	{
+		count += snprintf( pBuffer + count, size - count, " -index %d", params.iIndexBlock );
+	}
+
+	if ( params.bNibbles )
+	{
+		snprintf( pBuffer + count, size - count, " -nibble" );
+	}
+}
+
+bool ReadRleParamsFile( std::vector< std::string >& args, const char* pName )
+{
+	int err;
+	FILE* fp;
+
+	err = fopen_s( &fp, pName, "r" );
+	if ( err != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	char line[ 1024 ];
+	while ( fgets( line, sizeof( line ), fp ) )
+	{
+		// ... strip comments
+		char* pComment = strchr( line, ';' );
+		if ( pComment )
+		{
+			*pComment = 0;
+		}
+
+		// ... split on white space
+		const char* pDelim = " \t\r\n";
+		for ( char* pTok = strtok( line, pDelim ); pTok; pTok = strtok( nullptr, pDelim ) )
+		{
+			args.push_back( pTok );
+		}
+	}
+
+	fclose( fp );
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Planes
+//------------------------------------------------------------------------------
+
+// How many input bytes to de-interleave at a time. Small enough that the
+// source block plus the active output of every plane stays in cache.
+static const int kDeinterleaveBlockSize = 16384;
+
+// Number of bytes that belong to a given plane.
+int PlaneSize( int iPlane, int iPlanes, int iInputSize )
+{
+	if ( iPlane >= iInputSize )
+	{
+		return 0;
+	}
+
+	return ( iInputSize - iPlane + iPlanes - 1 ) / iPlanes;
+}
+
+#ifdef BINARYTOOLS_SSE2
+
+// Split 32 bytes (a:b) into the 16 even bytes and the 16 odd bytes.
+static inline void SplitEvenOdd( __m128i a, __m128i b, __m128i& even, __m128i& odd )
+{
+	const __m128i mask = _mm_set1_epi16( 0x00FF );
+
+	even = _mm_packus_epi16( _mm_and_si128( a, mask ), _mm_and_si128( b, mask ) );
+	odd = _mm_packus_epi16( _mm_srli_epi16( a, 8 ), _mm_srli_epi16( b, 8 ) );
+}
+
+// De-interleave a run of complete rows with SSE2 for 2, 4 or 8 planes.
+// Returns the number of rows processed; the caller finishes the remainder.
+static int DeinterleaveRowsSSE2( uint8_t** ppPlanes, const uint8_t* pInput, int iRowStart, int iRowEnd, int iPlanes )
+{
+	int iRow = iRowStart;
+
+	switch ( iPlanes )
+	{
+
+	case 2:
+
+		for ( ; iRow + 16 <= iRowEnd; iRow += 16 )
+		{
+			const __m128i* pSrc = reinterpret_cast<const __m128i*>( pInput + iRow * 2 );
+			__m128i p0, p1;
+
+			SplitEvenOdd( _mm_loadu_si128( pSrc + 0 ), _mm_loadu_si128( pSrc + 1 ), p0, p1 );
+
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( ppPlanes[ 0 ] + iRow ), p0 );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( ppPlanes[ 1 ] + iRow ), p1 );
+		}
+
+		break;
+
+	case 4:
+
+		for ( ; iRow + 16 <= iRowEnd; iRow += 16 )
+		{
+			const __m128i* pSrc = reinterpret_cast<const __m128i*>( pInput + iRow * 4 );
+			__m128i e0, o0, e1, o1;
+			__m128i p0, p1, p2, p3;
+
+			SplitEvenOdd( _mm_loadu_si128( pSrc + 0 ), _mm_loadu_si128( pSrc + 1 ), e0, o0 );
+			SplitEvenOdd( _mm_loadu_si128( pSrc + 2 ), _mm_loadu_si128( pSrc + 3 ), e1, o1 );
+
+			SplitEvenOdd( e0, e1, p0, p2 );
+			SplitEvenOdd( o0, o1, p1, p3 );
+
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( ppPlanes[ 0 ] + iRow ), p0 );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( ppPlanes[ 1 ] + iRow ), p1 );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( ppPlanes[ 2 ] + iRow ), p2 );
+			_mm_storeu_si128( reinterpret_cast<__m128i*>( ppPlanes[ 3 ] + iRow ), p3 );
+		}
+
+		break;
+
+	case 8:
+
+		for ( ; iRow + 16 <= iRowEnd; iRow += 16 )
+		{
+			const __m128i* pSrc = reinterpret_cast<const __m128i*>( pInput + iRow * 8 );
+			__m128i e[ 4 ], o[ 4 ];
+			__m128i ee0, eo0, ee1, eo1, oe0, oo0, oe1, oo1;
+			__m128i p[ 8 ];
+
+			// ... bit 0 of the plane index
+			for ( int i = 0; i < 4; ++i )
+			{
+				SplitEvenOdd( _mm_loadu_si128( pSrc + i * 2 ), _mm_loadu_si128( pSrc + i * 2 + 1 ), e[ i ], o[ i ] );
+			}
+
+			// ... bit 1
+			SplitEvenOdd( e[ 0 ], e[ 1 ], ee0, eo0 );
+			SplitEvenOdd( e[ 2 ], e[ 3 ], ee1, eo1 );
+			SplitEvenOdd( o[ 0 ], o[ 1 ], oe0, oo0 );
+			SplitEvenOdd( o[ 2 ], o[ 3 ], oe1, oo1 );
+
+			// ... bit 2
+			SplitEvenOdd( ee0, ee1, p[ 0 ], p[ 4 ] );
+			SplitEvenOdd( eo0, eo1, p[ 2 ], p[ 6 ] );
+			SplitEvenOdd( oe0, oe1, p[ 1 ], p[ 5 ] );
+			SplitEvenOdd( oo0, oo1, p[ 3 ], p[ 7 ] );
+
+			for ( int i = 0; i < 8; ++i )
+			{
+				_mm_storeu_si128( reinterpret_cast<__m128i*>( ppPlanes[ i ] + iRow ), p[ i ] );
+			}
+		}
+
+		break;
+
+	}; // switch ( iPlanes )
+
+	return iRow;
+}
+
+#endif // BINARYTOOLS_SSE2
+
+// Transpose interleaved input into contiguous planes, stored back to back in
+// pOutput (plane 0 first). Works through the input a cache-sized block at a
+// time so the strided reads for each plane hit memory that is already cached.
+void DeinterleavePlanes( uint8_t* pOutput, const uint8_t* pInput, int iInputSize, int iPlanes )
+{
+	if ( iPlanes == 1 )
+	{
+		memcpy( pOutput, pInput, iInputSize );
+		return;
+	}
+
+	std::vector< uint8_t* > planes( iPlanes );
+
+	uint8_t* pPlane = pOutput;
+	for ( int iPlane = 0; iPlane < iPlanes; ++iPlane )
+	{
+		planes[ iPlane ] = pPlane;
+		pPlane += PlaneSize( iPlane, iPlanes, iInputSize );
+	}
+
+	// Rows are groups of one byte from each plane. Only complete rows go through
+	// the block loop, any trailing partial row is handled afterwards.
+	const int iRows = iInputSize / iPlanes;
+	const int iBlockRows = ( kDeinterleaveBlockSize / iPlanes ) > 16 ? ( kDeinterleaveBlockSize / iPlanes ) : 16;
+
+	for ( int iBlock = 0; iBlock < iRows; iBlock += iBlockRows )
+	{
+		int iBlockEnd = iBlock + iBlockRows;
+		if ( iBlockEnd > iRows )
+		{
+			iBlockEnd = iRows;
+		}
+
+		int iRow = iBlock;
+
+#ifdef BINARYTOOLS_SSE2
+		iRow = DeinterleaveRowsSSE2( planes.data(), pInput, iBlock, iBlockEnd, iPlanes );
+#endif // BINARYTOOLS_SSE2
+
+		// Remaining rows, one plane at a time.
+		for ( int iPlane = 0; iPlane < iPlanes; ++iPlane )
+		{
+			uint8_t* pDst = planes[ iPlane ];
+			const uint8_t* pSrc = pInput + iPlane;
+
+			for ( int r = iRow; r < iBlockEnd; ++r )
+			{
+				pDst[ r ] = pSrc[ r * iPlanes ];
+			}
+		}
+	}
+
+	// Partial final row.
+	for ( int iCursor = iRows * iPlanes; iCursor < iInputSize; ++iCursor )
+	{
+		planes[ iCursor - iRows * iPlanes ][ iRows ] = pInput[ iCursor ];
+	}
+}
+
+#ifdef BINARYTOOLS_SSE2
+
+// Inverse of SplitEvenOdd: merge 16 even and 16 odd bytes into 32 bytes (a:b).
+static inline void MergeEvenOdd( __m128i even, __m128i odd, __m128i& a, __m128i& b )
+{
+	a = _mm_unpacklo_epi8( even, odd );
+	b = _mm_unpackhi_epi8( even, odd );
+}
+
+// Interleave a run of complete rows with SSE2 for 2, 4 or 8 planes.
+// Returns the number of rows processed; the caller finishes the remainder.
+static int InterleaveRowsSSE2( uint8_t* pOutput, const uint8_t* const* ppPlanes, int iRowStart, int iRowEnd, int iPlanes )
+{
+	int iRow = iRowStart;
+
+	switch ( iPlanes )
+	{
+
+	case 2:
+
+		for ( ; iRow + 16 <= iRowEnd; iRow += 16 )
+		{
+			__m128i* pDst = reinterpret_cast<__m128i*>( pOutput + iRow * 2 );
+			__m128i v0, v1;
+
+			MergeEvenOdd( _mm_loadu_si128( reinterpret_cast<const __m128i*>( ppPlanes[ 0 ] + iRow ) ),
+						  _mm_loadu_si128( reinterpret_cast<const __m128i*>( ppPlanes[ 1 ] + iRow ) ), v0, v1 );
+
+			_mm_storeu_si128( pDst + 0, v0 );
+			_mm_storeu_si128( pDst + 1, v1 );
+		}
+
+		break;
+
+	case 4:
+
+		for ( ; iRow + 16 <= iRowEnd; iRow += 16 )
+		{
+			__m128i* pDst = reinterpret_cast<__m128i*>( pOutput + iRow * 4 );
+			__m128i p[ 4 ];
+			__m128i e0, e1, o0, o1;
+			__m128i v[ 4 ];
+
+			for ( int i = 0; i < 4; ++i )
+			{
+				p[ i ] = _mm_loadu_si128( reinterpret_cast<const __m128i*>( ppPlanes[ i ] + iRow ) );
+			}
+
+			MergeEvenOdd( p[ 0 ], p[ 2 ], e0, e1 );
+			MergeEvenOdd( p[ 1 ], p[ 3 ], o0, o1 );
+
+			MergeEvenOdd( e0, o0, v[ 0 ], v[ 1 ] );
+			MergeEvenOdd( e1, o1, v[ 2 ], v[ 3 ] );
+
+			for ( int i = 0; i < 4; ++i )
+			{
+				_mm_storeu_si128( pDst + i, v[ i ] );
+			}
+		}
+
+		break;
+
+	case 8:
+
+		for ( ; iRow + 16 <= iRowEnd; iRow += 16 )
+		{
+			__m128i* pDst = reinterpret_cast<__m128i*>( pOutput + iRow * 8 );
+			__m128i p[ 8 ];
+			__m128i ee0, eo0, ee1, eo1, oe0, oo0, oe1, oo1;
+			__m128i e[ 4 ], o[ 4 ];
+
+			for ( int i = 0; i < 8; ++i )
+			{
+				p[ i ] = _mm_loadu_si128( reinterpret_cast<const __m128i*>( ppPlanes[ i ] + iRow ) );
+			}
+
+			// ... bit 2 of the plane index
+			MergeEvenOdd( p[ 0 ], p[ 4 ], ee0, ee1 );
+			MergeEvenOdd( p[ 2 ], p[ 6 ], eo0, eo1 );
+			MergeEvenOdd( p[ 1 ], p[ 5 ], oe0, oe1 );
+			MergeEvenOdd( p[ 3 ], p[ 7 ], oo0, oo1 );
+
+			// ... bit 1
+			MergeEvenOdd( ee0, eo0, e[ 0 ], e[ 1 ] );
+			MergeEvenOdd( ee1, eo1, e[ 2 ], e[ 3 ] );
+			MergeEvenOdd( oe0, oo0, o[ 0 ], o[ 1 ] );
+			MergeEvenOdd( oe1, oo1, o[ 2 ], o[ 3 ] );
+
+			// ... bit 0
+			for ( int i = 0; i < 4; ++i )
+			{
+				__m128i a, b;
+				MergeEvenOdd( e[ i ], o[ i ], a, b );
+
+				_mm_storeu_si128( pDst + i * 2, a );
+				_mm_storeu_si128( pDst + i * 2 + 1, b );
+			}
+		}
+
+		break;
+
+	}; // switch ( iPlanes )
+
+	return iRow;
+}
+
+#endif // BINARYTOOLS_SSE2
+
+void InterleavePlanes( uint8_t* pOutput, const uint8_t* pInput, int iOutputSize, int iPlanes )
+{
+	if ( iPlanes == 1 )
+	{
+		memcpy( pOutput, pInput, iOutputSize );
+		return;
+	}
+
+	std::vector< const uint8_t* > planes( iPlanes );
+
+	const uint8_t* pPlane = pInput;
+	for ( int iPlane = 0; iPlane < iPlanes; ++iPlane )
+	{
+		planes[ iPlane ] = pPlane;
+		pPlane += PlaneSize( iPlane, iPlanes, iOutputSize );
+	}
+
+	const int iRows = iOutputSize / iPlanes;
+	const int iBlockRows = ( kDeinterleaveBlockSize / iPlanes ) > 16 ? ( kDeinterleaveBlockSize / iPlanes ) : 16;
+
+	for ( int iBlock = 0; iBlock < iRows; iBlock += iBlockRows )
+	{
+		int iBlockEnd = iBlock + iBlockRows;
+		if ( iBlockEnd > iRows )
+		{
+			iBlockEnd = iRows;
+		}
+
+		int iRow = iBlock;
+
+#ifdef BINARYTOOLS_SSE2
+		iRow = InterleaveRowsSSE2( pOutput, planes.data(), iBlock, iBlockEnd, iPlanes );
+#endif // BINARYTOOLS_SSE2
+
+		// Remaining rows, one plane at a time.
+		for ( int iPlane = 0; iPlane < iPlanes; ++iPlane )
+		{
+			const uint8_t* pSrc = planes[ iPlane ];
+			uint8_t* pDst = pOutput + iPlane;
+
+			for ( int r = iRow; r < iBlockEnd; ++r )
+			{
+				pDst[ r * iPlanes ] = pSrc[ r ];
+			}
+		}
+	}
+
+	// Partial final row.
+	for ( int iCursor = iRows * iPlanes; iCursor < iOutputSize; ++iCursor )
+	{
+		pOutput[ iCursor ] = planes[ iCursor - iRows * iPlanes ][ iRows ];
+	}
+}
+
+//------------------------------------------------------------------------------
+// Filters
+//------------------------------------------------------------------------------
+
+void FilterPlane( uint8_t* pData, int iSize, const RleParams& params )
+{
+	if ( params.filter == FILTER_NONE )
+	{
+		return;
+	}
+
+	const bool bDelta = ( params.filter == FILTER_DELTA );
+	const int iPitch = params.iFilterPitch;
+
+	// Work backwards so every byte is combined with an unmodified predecessor.
+	int i = iSize;
+
+#ifdef BINARYTOOLS_SSE2
+	while ( i - 16 >= iPitch )
+	{
+		i -= 16;
+
+		__m128i cur = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pData + i ) );
+		__m128i prev = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pData + i - iPitch ) );
+
+		cur = bDelta ? _mm_sub_epi8( cur, prev ) : _mm_xor_si128( cur, prev );
+
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( pData + i ), cur );
+	}
+#endif // BINARYTOOLS_SSE2
+
+	while ( i > iPitch )
+	{
+		--i;
+
+		if ( bDelta )
+		{
+			pData[ i ] = pData[ i ] - pData[ i - iPitch ];
+		}
+		else
+		{
+			pData[ i ] = pData[ i ] ^ pData[ i - iPitch ];
+		}
+	}
+}
+
+void UnfilterPlane( uint8_t* pData, int iSize, const RleParams& params )
+{
+	int i = 0;
+
+	switch ( params.filter )
+	{
+
+	case FILTER_NONE:
+		break;
+
+	case FILTER_DELTA:
+
+		{
+			// Running sum.
+			uint8_t sum = 0;
+
+#ifdef BINARYTOOLS_SSE2
+			// Prefix sum of 16 bytes in four shift-and-add steps.
+			for ( ; i + 16 <= iSize; i += 16 )
+			{
+				__m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pData + i ) );
+
+				v = _mm_add_epi8( v, _mm_slli_si128( v, 1 ) );
+				v = _mm_add_epi8( v, _mm_slli_si128( v, 2 ) );
+				v = _mm_add_epi8( v, _mm_slli_si128( v, 4 ) );
+				v = _mm_add_epi8( v, _mm_slli_si128( v, 8 ) );
+				v = _mm_add_epi8( v, _mm_set1_epi8( static_cast<char>( sum ) ) );
+
+				_mm_storeu_si128( reinterpret_cast<__m128i*>( pData + i ), v );
+
+				sum = pData[ i + 15 ];
+			}
+#endif // BINARYTOOLS_SSE2
+
+			for ( ; i < iSize; ++i )
+			{
+				sum += pData[ i ];
+				pData[ i ] = sum;
+			}
+		}
+
+		break;
+
+	case FILTER_XOR_ROW:
+
+		{
+			const int iPitch = params.iFilterPitch;
+
+			i = iPitch;
+
+#ifdef BINARYTOOLS_SSE2
+			// A full row apart, 16 bytes at a time only read finished output.
+			if ( iPitch >= 16 )
+			{
+				for ( ; i + 16 <= iSize; i += 16 )
+				{
+					__m128i cur = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pData + i ) );
+					__m128i prev = _mm_loadu_si128( reinterpret_cast<const __m128i*>( pData + i - iPitch ) );
+
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( pData + i ), _mm_xor_si128( cur, prev ) );
+				}
+			}
+#endif // BINARYTOOLS_SSE2
+
+			for ( ; i < iSize; ++i )
+			{
+				pData[ i ] ^= pData[ i - iPitch ];
+			}
+		}
+
+		break;
+
+	}
+}
+
+//------------------------------------------------------------------------------
+// Scan Order
+//------------------------------------------------------------------------------
+
+// Square block size for the column transpose. 16 rows of 16 bytes touch only
+// 16 cache lines on each side.
+static const int kTransposeBlock = 16;
+
+// Convert one W x H page between row-major and column-major order.
+static void TransposePage( uint8_t* pDst, const uint8_t* pSrc, int iW, int iH, bool bInverse )
+{
+	for ( int y0 = 0; y0 < iH; y0 += kTransposeBlock )
+	{
+		const int yEnd = ( y0 + kTransposeBlock < iH ) ? y0 + kTransposeBlock : iH;
+
+		for ( int x0 = 0; x0 < iW; x0 += kTransposeBlock )
+		{
+			const int xEnd = ( x0 + kTransposeBlock < iW ) ? x0 + kTransposeBlock : iW;
+
+			for ( int y = y0; y < yEnd; ++y )
+			{
+				for ( int x = x0; x < xEnd; ++x )
+				{
+					if ( bInverse )
+					{
+						pDst[ y * iW + x ] = pSrc[ x * iH + y ];
+					}
+					else
+					{
+						pDst[ x * iH + y ] = pSrc[ y * iW + x ];
+					}
+				}
+			}
+		}
+	}
+}
+
+void ScanPlane( uint8_t* pDst, const uint8_t* pSrc, int iSize, const RleParams& params, bool bInverse )
+{
+	// Bytes that don't make a whole page, band or row are left where they are.
+	int iDone = 0;
+
+	switch ( params.scan )
+	{
+
+	case SCAN_ROWS:
+		break;
+
+	case SCAN_COLUMN:
+
+		{
+			const int iPageSize = params.iScanW * params.iScanH;
+
+			for ( ; iDone + iPageSize <= iSize; iDone += iPageSize )
+			{
+				TransposePage( pDst + iDone, pSrc + iDone, params.iScanW, params.iScanH, bInverse );
+			}
+		}
+
+		break;
+
+	case SCAN_TILE:
+
+		{
+			// Tiles are read a band of iScanH rows at a time, so only that band is
+			// live in the cache.
+			const int iTileW = params.iScanW;
+			const int iTileH = params.iScanH;
+			const int iBandSize = params.iWidth * iTileH;
+			const int iTilesPerBand = params.iWidth / iTileW;
+
+			for ( ; iDone + iBandSize <= iSize; iDone += iBandSize )
+			{
+				const uint8_t* pSrcBand = pSrc + iDone;
+				uint8_t* pDstBand = pDst + iDone;
+				int iTileCursor = 0;
+
+				for ( int t = 0; t < iTilesPerBand; ++t )
+				{
+					for ( int y = 0; y < iTileH; ++y )
+					{
+						const int iRowCursor = y * params.iWidth + t * iTileW;
+
+						if ( bInverse )
+						{
+							memcpy( pDstBand + iRowCursor, pSrcBand + iTileCursor, iTileW );
+						}
+						else
+						{
+							memcpy( pDstBand + iTileCursor, pSrcBand + iRowCursor, iTileW );
+						}
+
+						iTileCursor += iTileW;
+					}
+				}
+			}
+		}
+
+		break;
+
+	case SCAN_ZIGZAG:
+
+		{
+			// Reversing a row is its own inverse.
+			const int iWidth = params.iWidth;
+
+			for ( int iRow = 0; iDone + iWidth <= iSize; ++iRow, iDone += iWidth )
+			{
+				if ( iRow & 1 )
+				{
+					for ( int x = 0; x < iWidth; ++x )
+					{
+						pDst[ iDone + x ] = pSrc[ iDone + iWidth - 1 - x ];
+					}
+				}
+				else
+				{
+					memcpy( pDst + iDone, pSrc + iDone, iWidth );
+				}
+			}
+		}
+
+		break;
+
+	}
+
+	memcpy( pDst + iDone, pSrc + iDone, iSize - iDone );
+}
+
+//------------------------------------------------------------------------------
+// Pipeline
+//------------------------------------------------------------------------------
+
+void PrepareRlePlanes( std::vector< uint8_t >& planes, const uint8_t* pInput, int iInputSize, const RleParams& params )
+{
+	planes.resize( iInputSize );
+	DeinterleavePlanes( planes.data(), pInput, iInputSize, params.iPlanes );
+
+	std::vector< uint8_t > scratch;
+	uint8_t* pPlane = planes.data();
+
+	for ( int iPlane = 0; iPlane < params.iPlanes; ++iPlane )
+	{
+		const int iPlaneSize = PlaneSize( iPlane, params.iPlanes, iInputSize );
+
+		if ( params.scan != SCAN_ROWS )
+		{
+			scratch.resize( iPlaneSize );
+			ScanPlane( scratch.data(), pPlane, iPlaneSize, params, false );
+			memcpy( pPlane, scratch.data(), iPlaneSize );
+		}
+
+		// ... indexed output filters each seek block on its own.
+		const int iBlock = params.iIndexBlock > 0 ? params.iIndexBlock : iPlaneSize;
+
+		for ( int iDone = 0; iDone < iPlaneSize; iDone += iBlock )
+		{
+			const int iLeft = iPlaneSize - iDone;
+			FilterPlane( pPlane + iDone, iLeft < iBlock ? iLeft : iBlock, params );
+		}
+
+		pPlane += iPlaneSize;
+	}
+}
+
+void RestoreRlePlanes( uint8_t* pOutput, std::vector< uint8_t >& planes, int iOutputSize, const RleParams& params )
+{
+	std::vector< uint8_t > scratch;
+	uint8_t* pPlane = planes.data();
+
+	for ( int iPlane = 0; iPlane < params.iPlanes; ++iPlane )
+	{
+		const int iPlaneSize = PlaneSize( iPlane, params.iPlanes, iOutputSize );
+
+		const int iBlock = params.iIndexBlock > 0 ? params.iIndexBlock : iPlaneSize;
+
+		for ( int iDone = 0; iDone < iPlaneSize; iDone += iBlock )
+		{
+			const int iLeft = iPlaneSize - iDone;
+			UnfilterPlane( pPlane + iDone, iLeft < iBlock ? iLeft : iBlock, params );
+		}
+
+		if ( params.scan != SCAN_ROWS )
+		{
+			scratch.resize( iPlaneSize );
+			ScanPlane( scratch.data(), pPlane, iPlaneSize, params, true );
+			memcpy( pPlane, scratch.data(), iPlaneSize );
+		}
+
+		pPlane += iPlaneSize;
+	}
+
+	InterleavePlanes( pOutput, planes.data(), iOutputSize, params.iPlanes );
+}
+
+//==============================================================================
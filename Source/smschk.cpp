@@ -23,51 +23,70 @@ SOFTWARE.
 
 */
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
 
 #include "utils.h"
+#include "fileio.h"
+
+#ifdef BINARYTOOLS_SSE2
+#include <emmintrin.h>
+#endif
 
 //==============================================================================
 
 //
-// checksum function by Dandaman955. 
+// The BIOS checksum is a Z80 ADD/ADC loop over the ROM: a 16-bit sum of the
+// bytes. Based on the checksum function by Dandaman955, which emulated that
+// loop a byte at a time.
 // "Feel free to do what you want with the code, the source is on GitHub."
 // https://www.smspower.org/forums/16629-MasterSystemChecksumFixer#107180
 //
-static uint16_t checksum( unsigned char* pBuffer, uint16_t CC_Last, uint16_t ChecksumRange, int i )
+static uint16_t checksum( const uint8_t* pBuffer, uint16_t CC_Last, int iCount )
 {
-	unsigned char cs1 = ( CC_Last >> 8 ) & 0xFF;
-	unsigned char cs2 = CC_Last & 0xFF;
-	unsigned char cs3 = 0;  // Artificial carry flag for ADC emulation.
-	unsigned char e = 0;
-	unsigned char ov1 = 0;
-	unsigned char ov2 = 0;
-
-	do
-	{
-		e = cs2;				// LD A, E
-		ov1 = e;				// Set first overflow check flag.
-		e += pBuffer[ i ];		// ADD A, (HL)
-		ov2 = e;				// Set the second overflow check flag.
-		if ( ov1 > ov2 )		// Is the last value larger than the first (indicating overflow)?
-		{
-			cs3 = 1;			// If it is, set the carry for the adc instruction.
-		}
-		cs2 = e;				// LD E, A
-		e = cs1;				// LD A, D
-		e += cs3;				// ADC A, $00
-		cs3 = 0;				// Reset carry flag.
-		cs1 = e;				// LD, D, A
-		i++;					// INC HL
-		ChecksumRange--;		// DEC BC
-	}
-	while ( ChecksumRange );
-
-	CC_Last = ( cs1 << 8 ) & 0xFF00;
-	CC_Last |= cs2;
-	
-	return CC_Last;
+	uint32_t iSum = CC_Last;
+	int i = 0;
+
+#ifdef BINARYTOOLS_SSE2
+
+	// ... psadbw against zero sums each 8 bytes into a 64-bit lane.
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc0 = zero;
+	__m128i acc1 = zero;
+
+	for ( ; i + 64 <= iCount; i += 64 )
+	{
+		const __m128i* p = reinterpret_cast<const __m128i*>( pBuffer + i );
+
+		acc0 = _mm_add_epi64( acc0, _mm_sad_epu8( _mm_loadu_si128( p + 0 ), zero ) );
+		acc1 = _mm_add_epi64( acc1, _mm_sad_epu8( _mm_loadu_si128( p + 1 ), zero ) );
+		acc0 = _mm_add_epi64( acc0, _mm_sad_epu8( _mm_loadu_si128( p + 2 ), zero ) );
+		acc1 = _mm_add_epi64( acc1, _mm_sad_epu8( _mm_loadu_si128( p + 3 ), zero ) );
+	}
+
+	for ( ; i + 16 <= iCount; i += 16 )
+	{
+		acc0 = _mm_add_epi64( acc0, _mm_sad_epu8( _mm_loadu_si128( reinterpret_cast<const __m128i*>( pBuffer + i ) ), zero ) );
+	}
+
+	acc0 = _mm_add_epi64( acc0, acc1 );
+	acc0 = _mm_add_epi64( acc0, _mm_srli_si128( acc0, 8 ) );
+
+	// ... only the low 16 bits matter.
+	iSum += static_cast<uint32_t>( _mm_cvtsi128_si32( acc0 ) );
+
+#endif
+
+	for ( ; i < iCount; ++i )
+	{
+		iSum += pBuffer[ i ];
+	}
+
+	return static_cast<uint16_t>( iSum );
 }
 
 // Size options, for user friendly display.
@@ -76,66 +95,38 @@ static const char* ROMHeaderStr[ 16 ] =
 	"256KB", "512KB", "1MB", "???", "???", "???", "???", "???", "???", "???", "8KB", "16KB", "32KB", "48KB", "64KB", "128KB"
 };
 
-//==============================================================================
-
-//------------------------------------------------------------------------------
-// SMSChk
-//------------------------------------------------------------------------------
-int SMSChk( int argc, char** argv )
+// What was found in a ROM, and what its header should hold.
+struct SmsRomInfo
 {
-	if ( argc < 3 )
-	{
-		PrintHelp( "smschk" );
-		return 1;
-	}
+	int TMRStart;				// header offset
+	bool bHeaderDetected;		// "TMR SEGA" was found there
+	uint8_t oldHeader[ 16 ];	// the header as it is
+	uint8_t header[ 16 ];		// the header used for the checksum
+	unsigned char SizeCode;		// size code for the file size, or the header's if it isn't a standard size
+	uint16_t ComputedChecksum;
+	bool bHeaderInRange;		// the checksum sums the header too, so it can't match itself
+};
 
+// Find the header and compute the checksum, from a ROM in memory. When
+// signing, a missing header is added and the size code fixed before summing,
+// otherwise the header is used as it is. Returns an error, or nullptr.
+static const char* AnalyseSmsRom( SmsRomInfo& info, const uint8_t* buffer, int fsize, bool bSign )
+{
 	uint16_t TMRValues[ 3 ] = { 0x1FF0, 0x3FF0, 0x7FF0 };
 	uint8_t ChecksumRanges[ 9 ] = { 0x1F, 0x3F, 0x7F, 0xBF, 0x7F, 0x7F, 0x7F, 0x7F, 0x7F };
-	uint8_t ROMPages[ 4 ] = { 0x02, 0x06, 0x0E, 0x1E };
+	uint8_t ROMPages[ 5 ] = { 0x02, 0x06, 0x0E, 0x1E, 0x3E };
 	uint8_t TMR[ 10 ] = "TMR SEGA";
 	TMR[ 8 ] = 0xFF;
 	TMR[ 9 ] = 0xFF;
-	
-	unsigned char* buffer;
+
 	int i;
 	int j;
-	short TMRStart;
-	short TMRAutoGen = 0;
+	int TMRStart = 0;
+	int TMRAutoGen = 0;
 	bool bHeaderDetected = false;
 
-	int err;
-	FILE* fp_in;
-	FILE* fp_out;
-
-	const char* pRomFile = argv[ 2 ];
-
-	// ... input file
-	err = fopen_s( &fp_in, pRomFile, "rb" );
-	if ( err != 0 || fp_in == nullptr )
-	{
-		PrintError( "Cannot open ROM file \"%s\".", pRomFile );
-		return 1;
-	}
-
-	Info( "Loading ROM: \"%s\" ", pRomFile );
-
-	fseek( fp_in, 0, SEEK_END );
-	int fsize = ftell( fp_in );
-	rewind( fp_in );
-
-	printf( "(%d bytes)\n", fsize );
-
-	buffer = (unsigned char*)malloc( fsize );
-	if ( buffer == NULL )
-	{
-		PrintError( "Couldn't allocate memory for the file." );
-		return 1;
-	}
-
-	fread( buffer, sizeof( char ), fsize, fp_in );
-	fclose( fp_in );
-
-	Info( "Looking for \"TMR SEGA\" header ... " );
+	info.TMRStart = 0;
+	info.bHeaderInRange = false;
 
 	// Detect the TMR_SEGA header at locations 0x1FF0, 0x3FF0 or 0x7FF0.
 	for ( j = 0; j < 3; j++ )
@@ -143,7 +134,7 @@ int SMSChk( int argc, char** argv )
 		TMRStart = TMRValues[ j ];
 
 		// Small ROM?
-		if ( TMRStart > fsize )
+		if ( TMRStart + 16 > fsize )
 			break;
 
 		TMRAutoGen = TMRStart;
@@ -161,30 +152,38 @@ int SMSChk( int argc, char** argv )
 
 		if ( bHeaderDetected )
 		{
-			printf( "found at 0x%02X\n", TMRStart );
 			break;
 		}
 	}
 
+	info.bHeaderDetected = bHeaderDetected;
+
+	if ( TMRAutoGen == 0 )
+	{
+		return "The ROM is too small for a header.";
+	}
+
 	if ( bHeaderDetected == false )
 	{
-		if ( TMRAutoGen == 0 )
+		TMRStart = TMRAutoGen;
+	}
+
+	info.TMRStart = TMRStart;
+	memcpy( info.oldHeader, buffer + TMRStart, 16 );
+	memcpy( info.header, info.oldHeader, 16 );
+
+	uint8_t* header = info.header;
+
+	if ( bHeaderDetected == false )
+	{
+		if ( bSign == false )
 		{
-			printf( "not found\n" );
-			PrintError( "Couldn't create header." );
-			free( buffer );
-			return 1;
+			return "No \"TMR SEGA\" header.";
 		}
-		else
-		{
-			printf( "adding at 0x%02X\n", TMRAutoGen );
-
-			TMRStart = TMRAutoGen;
 
-			for ( i = 0; i < 10; i++ )
-			{
-				buffer[ TMRStart + i ] = TMR[ i ];
-			}
+		for ( i = 0; i < 10; i++ )
+		{
+			header[ i ] = TMR[ i ];
 		}
 	}
 
@@ -192,7 +191,7 @@ int SMSChk( int argc, char** argv )
 	unsigned char ROMHeader;
 	int fsize8KB = fsize / 8192;
 
-	ROMHeader = buffer[ TMRStart + 0x0F ] & 0x0F;
+	ROMHeader = header[ 0x0F ] & 0x0F;
 
 	if ( fsize8KB == 1 )
 		ROMHeader = 0xA; // 8KB
@@ -213,17 +212,48 @@ int SMSChk( int argc, char** argv )
 	else if ( fsize8KB == 128 )
 		ROMHeader = 0x2; // 1MB
 
-	buffer[ TMRStart + 0x0F ] = ( buffer[ TMRStart + 0x0F ] & 0xF0 ) | ROMHeader;
+	info.SizeCode = ROMHeader;
+
+	if ( bSign )
+	{
+		header[ 0x0F ] = ( header[ 0x0F ] & 0xF0 ) | ROMHeader;
+	}
 
 	//  printf( "Size code = 0x%X\n", ROMHeader );
 
-	ROMHeader = ( buffer[ TMRStart + 0x0F ] - 0x0A ) & 0x0F;
+	ROMHeader = ( header[ 0x0F ] - 0x0A ) & 0x0F;
+
+	if ( ROMHeader > 8 )
+	{
+		return "Unknown size code in the header.";
+	}
+
 	uint16_t ChecksumRange = ( ( ChecksumRanges[ ROMHeader ] << 8 ) & 0xFF00 ) | 0xF0;
 
+	// ... the size code can claim more than the file holds.
+	const int iChecksumEnd = ( ROMHeader > 3 ) ? 0x8000 + ROMPages[ ROMHeader - 4 ] * 0x4000 : ChecksumRange;
+	if ( iChecksumEnd > fsize )
+	{
+		return "The size code covers more than the file holds.";
+	}
+
 	//  printf( "Scan (0 - %d)... ", ChecksumRange );
 
+	// ... such as with a 48KB size code, or a header at 0x1FF0 or 0x3FF0. The
+	// stored checksum bytes are summed too, and in general no value of them
+	// sums to itself.
+	info.bHeaderInRange = TMRStart < ChecksumRange;
+
+	// ... the first range can include the header, so sum a copy with the
+	// header as it will be.
+	std::vector< uint8_t > first( buffer, buffer + ChecksumRange );
+	for ( i = 0; i < 16 && TMRStart + i < ChecksumRange; ++i )
+	{
+		first[ TMRStart + i ] = header[ i ];
+	}
+
 	uint16_t ComputedChecksum = 0;
-	ComputedChecksum = checksum( buffer, ComputedChecksum, ChecksumRange, 0 );
+	ComputedChecksum = checksum( first.data(), ComputedChecksum, ChecksumRange );
 	int ROMPage;
 
 	if ( ROMHeader > 3 )
@@ -233,7 +263,7 @@ int SMSChk( int argc, char** argv )
 
 		for ( ; ; )
 		{
-			ComputedChecksum = checksum( buffer, ComputedChecksum, 0x4000, i );
+			ComputedChecksum = checksum( buffer + i, ComputedChecksum, 0x4000 );
 			if ( ROMPage == 0 )
 			{
 				break;
@@ -243,41 +273,402 @@ int SMSChk( int argc, char** argv )
 		}
 	}
 
-	// Open the file for writing.
+	info.ComputedChecksum = ComputedChecksum;
+
+	return nullptr;
+}
+
+//==============================================================================
+
+//------------------------------------------------------------------------------
+// Verify
+//------------------------------------------------------------------------------
+
+// The result of checking one ROM with -verify.
+struct SmsVerifyResult
+{
+	std::string name;
+	const char* pError;			// couldn't be checked, or nullptr
+	SmsRomInfo info;
+	uint16_t StoredChecksum;
+	bool bChecksumOK;
+	bool bSizeCodeOK;
+};
+
+// Write a string as a JSON string literal.
+static void WriteJsonString( FILE* fp, const char* pStr )
+{
+	fputc( '"', fp );
+
+	for ( const char* p = pStr; *p; ++p )
+	{
+		if ( *p == '"' || *p == '\\' )
+		{
+			fprintf( fp, "\\%c", *p );
+		}
+		else if ( static_cast<unsigned char>( *p ) < 0x20 )
+		{
+			fprintf( fp, "\\u%04x", *p );
+		}
+		else
+		{
+			fputc( *p, fp );
+		}
+	}
+
+	fputc( '"', fp );
+}
+
+// Write every ROM that failed as a JSON array. A ROM whose only fault is a
+// checksum that can't match, with the header in the summed range, hasn't failed.
+static bool WriteVerifyJson( const char* pName, const std::vector< SmsVerifyResult >& results )
+{
+	FILE* fp;
+	int err = fopen_s( &fp, pName, "w" );
+	if ( err != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	fprintf( fp, "[" );
+
+	bool bFirst = true;
+	for ( const SmsVerifyResult& result : results )
+	{
+		if ( result.pError == nullptr && ( result.bChecksumOK || result.info.bHeaderInRange ) && result.bSizeCodeOK )
+		{
+			continue;
+		}
+
+		fprintf( fp, "%s\n  { \"file\": ", bFirst ? "" : "," );
+		WriteJsonString( fp, result.name.c_str() );
+
+		if ( result.pError )
+		{
+			fprintf( fp, ", \"error\": " );
+			WriteJsonString( fp, result.pError );
+		}
+		else
+		{
+			const SmsRomInfo& info = result.info;
+
+			fprintf( fp, ", \"checksum\": \"0x%04X\", \"stored\": \"0x%04X\", \"sizeCode\": \"0x%X\", \"expectedSizeCode\": \"0x%X\"",
+					 info.ComputedChecksum, result.StoredChecksum, info.header[ 0x0F ] & 0x0F, info.SizeCode );
+
+			if ( info.bHeaderInRange )
+			{
+				fprintf( fp, ", \"note\": \"header-in-range\"" );
+			}
+		}
+
+		fprintf( fp, " }" );
+		bFirst = false;
+	}
+
+	fprintf( fp, "%s]\n", bFirst ? "" : "\n" );
+
+	fclose( fp );
+	return true;
+}
+
+// Check many ROMs on every core without changing them, and report the ones
+// whose checksum or size code is wrong.
+static int SMSVerify( const std::vector< const char* >& paths, const char* pJsonName )
+{
+	std::vector< SmsVerifyResult > results;
+
+	// ... directories are searched for .sms files.
+	for ( const char* pPath : paths )
+	{
+		std::vector< std::string > files;
+
+		if ( IsDirectory( pPath ) )
+		{
+			if ( ListFiles( files, pPath, ".sms" ) == false )
+			{
+				PrintError( "Cannot read directory \"%s\".", pPath );
+				return 1;
+			}
+		}
+		else
+		{
+			files.push_back( pPath );
+		}
+
+		for ( const std::string& file : files )
+		{
+			SmsVerifyResult result;
+			result.name = file;
+			result.pError = nullptr;
+			results.push_back( result );
+		}
+	}
+
+	const int iCount = static_cast<int>( results.size() );
+
+	Info( "Verifying %d ROMs ... ", iCount );
+
+	ParallelFor( iCount, [ & ]( int i )
+	{
+		SmsVerifyResult& result = results[ i ];
+
+		MappedFile rom;
+		if ( MapFile( &rom, result.name.c_str() ) == false )
+		{
+			result.pError = "Cannot open ROM file.";
+			return;
+		}
+
+		// ... sizes are checked as int, and no ROM is near this large.
+		if ( rom.iSize > INT_MAX )
+		{
+			result.pError = "The file is too large to be a ROM.";
+		}
+		else
+		{
+			result.pError = AnalyseSmsRom( result.info, rom.pData, static_cast<int>( rom.iSize ), false );
+		}
+
+		UnmapFile( &rom );
+
+		if ( result.pError == nullptr )
+		{
+			const SmsRomInfo& info = result.info;
+
+			result.StoredChecksum = static_cast<uint16_t>( info.header[ 0xA ] | ( info.header[ 0xB ] << 8 ) );
+			result.bChecksumOK = ( result.StoredChecksum == info.ComputedChecksum );
+			result.bSizeCodeOK = ( ( info.header[ 0x0F ] & 0x0F ) == info.SizeCode );
+		}
+	} );
+
+	int iMismatched = 0;
+	int iUnverifiable = 0;
+	int iErrors = 0;
+
+	for ( const SmsVerifyResult& result : results )
+	{
+		if ( result.pError )
+		{
+			++iErrors;
+		}
+		else if ( ( result.bChecksumOK == false && result.info.bHeaderInRange == false ) || result.bSizeCodeOK == false )
+		{
+			++iMismatched;
+		}
+		else if ( result.bChecksumOK == false )
+		{
+			// ... signing can't give these a checksum that matches, so they
+			// aren't counted as failures.
+			++iUnverifiable;
+		}
+	}
+
+	printf( "%d OK, %d mismatched, %d can't be verified, %d errors\n",
+			iCount - iMismatched - iUnverifiable - iErrors, iMismatched, iUnverifiable, iErrors );
+
+	for ( const SmsVerifyResult& result : results )
+	{
+		const SmsRomInfo& info = result.info;
+
+		if ( result.pError )
+		{
+			printf( "  %s: %s\n", result.name.c_str(), result.pError );
+			continue;
+		}
+
+		if ( result.bChecksumOK == false && info.bHeaderInRange )
+		{
+			printf( "  %s: checksum is 0x%04X, header says 0x%04X (the header at 0x%04X is inside the checksummed range)\n",
+					result.name.c_str(), info.ComputedChecksum, result.StoredChecksum, info.TMRStart );
+		}
+		else if ( result.bChecksumOK == false )
+		{
+			printf( "  %s: checksum is 0x%04X, header says 0x%04X\n", result.name.c_str(), info.ComputedChecksum, result.StoredChecksum );
+		}
+
+		if ( result.bSizeCodeOK == false )
+		{
+			printf( "  %s: size code is 0x%X (%s), file is %s\n", result.name.c_str(), info.header[ 0x0F ] & 0x0F,
+					ROMHeaderStr[ info.header[ 0x0F ] & 0x0F ], ROMHeaderStr[ info.SizeCode ] );
+		}
+	}
+
+	if ( pJsonName && WriteVerifyJson( pJsonName, results ) == false )
+	{
+		PrintError( "Cannot write report file \"%s\".", pJsonName );
+		return 1;
+	}
 
-	ROMHeader = buffer[ TMRStart + 0x0F ] & 0x0F;
-	Info( "Checksum = 0x%04X; Size Code = 0x%X (%s)\n", ComputedChecksum, ROMHeader, ROMHeaderStr[ ROMHeader ] );
+	return ( iMismatched || iErrors ) ? 1 : 0;
+}
+
+//------------------------------------------------------------------------------
+// SMSChk
+//------------------------------------------------------------------------------
+int SMSChk( int argc, char** argv )
+{
+	std::vector< const char* > files;
+	const char* pJsonName = nullptr;
+
+	enum eOption
+	{
+		NONE,
+		OPT_JSON,
+	};
+
+	eOption specialNextArg = NONE;
+
+	// defaults.
+	bool bOptVerify = false;
+
+	// parse arguments (after the tool name)
+	for ( int i = 2; i < argc; ++i )
+	{
+		const char* pArg = argv[ i ];
+
+		if ( specialNextArg != NONE )
+		{
+			switch ( specialNextArg )
+			{
+
+			case OPT_JSON:
+				pJsonName = pArg;
+				break;
+
+			}
+
+			specialNextArg = NONE;
+		}
+		else if ( *pArg == '-' )
+		{
+			if ( _stricmp( pArg, "-verify" ) == 0 )
+			{
+				bOptVerify = true;
+			}
+			else if ( _stricmp( pArg, "-json" ) == 0 )
+			{
+				specialNextArg = OPT_JSON;
+			}
+			else
+			{
+				// error.
+				PrintHelp( "smschk" );
+				return 1;
+			}
+		}
+		else
+		{
+			files.push_back( pArg );
+		}
+	}
+
+	if ( files.empty() || specialNextArg != NONE || ( bOptVerify == false && ( files.size() != 1 || pJsonName ) ) )
+	{
+		PrintHelp( "smschk" );
+		return 1;
+	}
+
+	if ( bOptVerify )
+	{
+		return SMSVerify( files, pJsonName );
+	}
+
+	const char* pRomFile = files[ 0 ];
+
+	// ... input file, mapped read-only. Only the header is written back.
+	MappedFile rom;
+	if ( MapFile( &rom, pRomFile ) == false )
+	{
+		PrintError( "Cannot open ROM file \"%s\".", pRomFile );
+		return 1;
+	}
+
+	if ( rom.iSize > INT_MAX )
+	{
+		UnmapFile( &rom );
+		PrintError( "\"%s\" is too large to be a ROM.", pRomFile );
+		return 1;
+	}
+
+	Info( "Loading ROM: \"%s\" ", pRomFile );
+	printf( "(%d bytes)\n", static_cast<int>( rom.iSize ) );
+
+	Info( "Looking for \"TMR SEGA\" header ... " );
+
+	SmsRomInfo info;
+	const char* pError = AnalyseSmsRom( info, rom.pData, static_cast<int>( rom.iSize ), true );
+
+	UnmapFile( &rom );
+
+	if ( info.bHeaderDetected )
+	{
+		printf( "found at 0x%02X\n", info.TMRStart );
+	}
+	else if ( pError && info.TMRStart == 0 )
+	{
+		printf( "not found\n" );
+		PrintError( "Couldn't create header." );
+		return 1;
+	}
+	else
+	{
+		printf( "adding at 0x%02X\n", info.TMRStart );
+	}
+
+	if ( pError )
+	{
+		PrintError( "%s", pError );
+		return 1;
+	}
+
+	uint8_t* header = info.header;
+
+	unsigned char ROMHeader = header[ 0x0F ] & 0x0F;
+	Info( "Checksum = 0x%04X; Size Code = 0x%X (%s)\n", info.ComputedChecksum, ROMHeader, ROMHeaderStr[ ROMHeader ] );
+
+	if ( info.bHeaderInRange )
+	{
+		Info( "The header at 0x%04X is inside the checksummed range, so the checksum sums itself and won't verify.\n", info.TMRStart );
+	}
 
 	unsigned char Region;
-	Region = buffer[ TMRStart + 0x0F ] >> 4;
+	Region = header[ 0x0F ] >> 4;
 	if ( Region != 3 /*SMS Japan*/ && Region != 4 /*SMS Export*/ )
 	{
 		// Only the export SMS BIOS actually checks this, so we use that code.
 		Info( "Changing region to \"SMS Export\"\n" );
-		buffer[ TMRStart + 0xF ] = ROMHeader | 0x40;
+		header[ 0xF ] = ROMHeader | 0x40;
 	}
 
-	// ... output file
-	err = fopen_s( &fp_out, pRomFile, "wb" );
-	if ( err != 0 || fp_in == nullptr )
+	// Updating the new checksum.
+
+	header[ 0xA ] = info.ComputedChecksum & 0xFF;
+	header[ 0xB ] = ( info.ComputedChecksum >> 8 ) & 0xFF;
+
+	if ( memcmp( header, info.oldHeader, 16 ) == 0 )
+	{
+		Info( "\"%s\" is already signed.\n", pRomFile );
+		return 0;
+	}
+
+	// ... write back just the header, in place.
+	RawFile fp_out;
+	if ( OpenOutputFile( &fp_out, pRomFile, false ) == false )
 	{
 		PrintError( "Cannot open output file \"%s\".", pRomFile );
-		free( buffer );
 		return 1;
 	}
 
 	Info( "Writing \"%s\" ... ", pRomFile );
 
-	// Updating the new checksum.
-
-	buffer[ TMRStart + 0xA ] = ComputedChecksum & 0xFF;
-	buffer[ TMRStart + 0xB ] = ( ComputedChecksum >> 8 ) & 0xFF;
-	fwrite( buffer, 1, fsize, fp_out );
+	const bool bOK = WriteFileData( &fp_out, info.TMRStart, header, 16 );
+	CloseRawFile( &fp_out );
 
-	// Program-closing goodies.
-
-	free( buffer );
-	fclose( fp_out );
+	if ( bOK == false )
+	{
+		printf( "FAILED\n" );
+		return 1;
+	}
 
 	printf( "OK\n" );
 
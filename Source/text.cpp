@@ -0,0 +1,321 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+
+#include "utils.h"
+#include "fileio.h"
+#include "text.h"
+
+//------------------------------------------------------------------------------
+// Byte Pair Encoding
+//------------------------------------------------------------------------------
+
+// A pair must appear this often to pay for its two dictionary bytes.
+static const int kTextMinPairCount = 3;
+
+// Count every pair of neighbouring codes. In a run like "aaa" the pairs
+// overlap, and only every other one can be replaced, so only those count.
+static void CountPairs( std::vector< int >& counts, const std::vector< uint8_t >& text )
+{
+	counts.assign( 65536, 0 );
+
+	const int n = static_cast<int>( text.size() );
+	int iLastKey = -1;
+
+	for ( int i = 0; i + 1 < n; ++i )
+	{
+		const int iKey = ( text[ i ] << 8 ) | text[ i + 1 ];
+
+		if ( iKey == iLastKey && text[ i ] == text[ i + 1 ] )
+		{
+			// ... overlaps the pair just counted.
+			iLastKey = -1;
+			continue;
+		}
+
+		++counts[ iKey ];
+		iLastKey = iKey;
+	}
+}
+
+bool EncodeTextBuffer( std::vector< uint8_t >& output, TextInfo& info, const uint8_t* pInput, int iInputSize, int iMaxPairs )
+{
+	bool used[ 256 ] = { false };
+
+	for ( int i = 0; i < iInputSize; ++i )
+	{
+		used[ pInput[ i ] ] = true;
+	}
+
+	if ( used[ 0 ] )
+	{
+		return false;
+	}
+
+	// ... pair codes count down from the top of the longest run of values the
+	// text leaves free. Ties go to the higher run, so ASCII uses 255 down.
+	int iTop = 0;
+	int iFree = 0;
+	int iRun = 0;
+
+	for ( int c = 1; c < 256; ++c )
+	{
+		iRun = used[ c ] ? 0 : iRun + 1;
+
+		if ( iRun > 0 && iRun >= iFree )
+		{
+			iFree = iRun;
+			iTop = c;
+		}
+	}
+
+	info.iFree = iFree;
+
+	if ( iMaxPairs > iFree )
+	{
+		iMaxPairs = iFree;
+	}
+
+	std::vector< uint8_t > text( pInput, pInput + iInputSize );
+	std::vector< int > counts;
+
+	// The pair made k-th gets code iTop - k.
+	std::vector< uint8_t > pairs;
+	std::vector< int > depth( 256, 0 );
+
+	info.iPairs = 0;
+	info.iDepth = 0;
+
+	while ( info.iPairs < iMaxPairs )
+	{
+		CountPairs( counts, text );
+
+		int iBest = 0;
+		for ( int iKey = 1; iKey < 65536; ++iKey )
+		{
+			if ( counts[ iKey ] > counts[ iBest ] )
+			{
+				iBest = iKey;
+			}
+		}
+
+		if ( counts[ iBest ] < kTextMinPairCount )
+		{
+			break;
+		}
+
+		const uint8_t a = static_cast<uint8_t>( iBest >> 8 );
+		const uint8_t b = static_cast<uint8_t>( iBest & 0xFF );
+		const uint8_t code = static_cast<uint8_t>( iTop - info.iPairs );
+
+		// Replace, left to right, so overlapping pairs go the same way as they
+		// were counted.
+		const int n = static_cast<int>( text.size() );
+		int j = 0;
+
+		for ( int i = 0; i < n; )
+		{
+			if ( i + 1 < n && text[ i ] == a && text[ i + 1 ] == b )
+			{
+				text[ j++ ] = code;
+				i += 2;
+			}
+			else
+			{
+				text[ j++ ] = text[ i++ ];
+			}
+		}
+
+		text.resize( j );
+
+		pairs.push_back( a );
+		pairs.push_back( b );
+
+		depth[ code ] = 1 + ( ( depth[ a ] > depth[ b ] ) ? depth[ a ] : depth[ b ] );
+		if ( depth[ code ] > info.iDepth )
+		{
+			info.iDepth = depth[ code ];
+		}
+
+		++info.iPairs;
+	}
+
+	// ... the dictionary is stored lowest code first, so newest pair first.
+	output.push_back( static_cast<uint8_t>( info.iPairs ) );
+	output.push_back( static_cast<uint8_t>( iTop - info.iPairs + 1 ) );
+
+	for ( int k = info.iPairs - 1; k >= 0; --k )
+	{
+		output.push_back( pairs[ k * 2 ] );
+		output.push_back( pairs[ k * 2 + 1 ] );
+	}
+
+	output.insert( output.end(), text.begin(), text.end() );
+	output.push_back( 0 );
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Text
+//------------------------------------------------------------------------------
+int Text( int argc, char** argv )
+{
+	const char* pInputName = nullptr;
+	const char* pOutputName = nullptr;
+
+	enum eOption
+	{
+		NONE,
+		OPT_MAX_PAIRS,
+	};
+
+	eOption specialNextArg = NONE;
+
+	// defaults.
+	bool bOptAppend = false;
+	int iMaxPairs = kTextMaxPairs;
+
+	// parse arguments (after the tool name)
+	for ( int i = 2; i < argc; ++i )
+	{
+		const char* pArg = argv[ i ];
+
+		if ( specialNextArg != NONE )
+		{
+			switch ( specialNextArg )
+			{
+
+			case OPT_MAX_PAIRS:
+
+				iMaxPairs = ParseValue( pArg, kTextMaxPairs );
+
+				if ( iMaxPairs < 0 )
+				{
+					// error.
+					PrintError( "Invalid -max-pairs parameter \"%s\".", pArg );
+					return 1;
+				}
+
+				break;
+
+			}
+
+			specialNextArg = NONE;
+		}
+		else if ( *pArg == '-' )
+		{
+			if ( _stricmp( pArg, "-max-pairs" ) == 0 )
+			{
+				specialNextArg = OPT_MAX_PAIRS;
+			}
+			else if ( _stricmp( pArg, "-append" ) == 0 )
+			{
+				bOptAppend = true;
+			}
+			else
+			{
+				// error.
+				PrintHelp( "text" );
+				return 1;
+			}
+		}
+		else if ( pInputName == nullptr )
+		{
+			pInputName = pArg;
+		}
+		else if ( pOutputName == nullptr )
+		{
+			pOutputName = pArg;
+		}
+		else
+		{
+			// error.
+			PrintHelp( "text" );
+			return 1;
+		}
+	}
+
+	if ( pInputName == nullptr || pOutputName == nullptr || specialNextArg != NONE )
+	{
+		PrintHelp( "text" );
+		return 1;
+	}
+
+	MappedFile input;
+	if ( MapFile( &input, pInputName ) == false )
+	{
+		PrintError( "Cannot open input file \"%s\"", pInputName );
+		return 1;
+	}
+
+	const int iInputSize = static_cast<int>( input.iSize );
+
+	Info( "Compressing \"%s\" ... ", pInputName );
+
+	std::vector< uint8_t > encoded;
+	TextInfo info;
+
+	if ( EncodeTextBuffer( encoded, info, input.pData, iInputSize, iMaxPairs ) == false )
+	{
+		printf( "FAILED\n" );
+		PrintError( "The input contains a 00 byte, which marks the end of the text." );
+		UnmapFile( &input );
+		return 1;
+	}
+
+	UnmapFile( &input );
+
+	// ... output file
+	FILE* fp_out;
+	int err = fopen_s( &fp_out, pOutputName, bOptAppend ? "ab" : "wb" );
+	if ( err != 0 || fp_out == nullptr )
+	{
+		printf( "FAILED\n" );
+		PrintError( "Cannot open output file \"%s\"", pOutputName );
+		return 1;
+	}
+
+	fwrite( encoded.data(), 1, encoded.size(), fp_out );
+	fclose( fp_out );
+
+	printf( "OK (%d -> %d bytes)\n", iInputSize, static_cast<int>( encoded.size() ) );
+
+	// ... each level of nesting costs the decoder 4 bytes of stack.
+	Info( "%d pairs, nested up to %d deep\n", info.iPairs, info.iDepth );
+
+	if ( info.iFree == 0 )
+	{
+		Info( "The input uses every byte value, so none are free for pairs and the text is stored uncompressed.\n" );
+	}
+
+	return 0;
+}
+
+//==============================================================================
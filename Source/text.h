@@ -0,0 +1,59 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Text Format
+//------------------------------------------------------------------------------
+//
+// Written by the 'text' tool and read by Extras/text_decompress.z80. Each
+// frequent pair of bytes is replaced by a single byte value the text doesn't
+// use, over and over, so pairs can hold other pairs (byte pair encoding).
+//
+//   +0   u8    pair count P
+//   +1   u8    first pair code F. Codes F to F+P-1 are pairs.
+//   +2   P x 2 bytes: the two codes each pair stands for, code F first
+//   ...  the packed text, ending with 00
+//
+// The input must not contain 00 bytes, nor any byte used as a pair code.
+
+static const int kTextMaxPairs = 255;
+
+struct TextInfo
+{
+	int iPairs;			// pair codes used
+	int iDepth;			// deepest nesting of pairs within pairs
+	int iFree;			// unused byte values available as pair codes
+};
+
+// Compress a buffer, appending to output. Returns false if the input contains
+// a 00 byte.
+bool EncodeTextBuffer( std::vector< uint8_t >& output, TextInfo& info, const uint8_t* pInput, int iInputSize, int iMaxPairs );
+
+//==============================================================================
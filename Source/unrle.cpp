@@ -0,0 +1,737 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "fileio.h"
+#include "rle.h"
+
+// Decode one plane of 8-bit RLE data, appending to the output. Returns the number of
+// input bytes consumed (including the terminator), or -1 if the input runs out first.
+static int DecodePlane8( std::vector< uint8_t >& output, const uint8_t* pInput, int iInputSize )
+{
+	int iCursor = 0;
+
+	for ( ; ; )
+	{
+		if ( iCursor >= iInputSize )
+		{
+			return -1;
+		}
+
+		uint8_t ctrl = pInput[ iCursor++ ];
+
+		if ( ctrl == 0 )
+		{
+			// end of plane.
+			return iCursor;
+		}
+		else if ( ctrl & 0x80 )
+		{
+			// Uniform data.
+			if ( iCursor >= iInputSize )
+			{
+				return -1;
+			}
+
+			output.insert( output.end(), ctrl & 0x7F, pInput[ iCursor++ ] );
+		}
+		else
+		{
+			// Noisy data.
+			if ( iCursor + ctrl > iInputSize )
+			{
+				return -1;
+			}
+
+			output.insert( output.end(), pInput + iCursor, pInput + iCursor + ctrl );
+			iCursor += ctrl;
+		}
+	}
+}
+
+// Decode one plane of nibble RLE data (see rle.h), appending to the output. Returns
+// the number of input bytes consumed, or -1 if the data is damaged.
+static int DecodePlane4( std::vector< uint8_t >& output, const uint8_t* pInput, int iInputSize )
+{
+	int iCursor = 0;
+	int iHalf = -1;		// high nibble waiting for its partner
+
+	auto putNibble = [ & ]( int v )
+	{
+		if ( iHalf < 0 )
+		{
+			iHalf = v;
+		}
+		else
+		{
+			output.push_back( static_cast<uint8_t>( ( iHalf << 4 ) | v ) );
+			iHalf = -1;
+		}
+	};
+
+	for ( ; ; )
+	{
+		if ( iCursor >= iInputSize )
+		{
+			return -1;
+		}
+
+		uint8_t ctrl = pInput[ iCursor++ ];
+
+		if ( ctrl == 0 )
+		{
+			// end of plane, which must hold whole bytes.
+			return ( iHalf < 0 ) ? iCursor : -1;
+		}
+		else if ( ctrl & 0x80 )
+		{
+			// Uniform data.
+			int iLength = ( ctrl & 7 ) + 2;
+
+			if ( ( ctrl & 7 ) == 7 )
+			{
+				if ( iCursor >= iInputSize )
+				{
+					return -1;
+				}
+
+				iLength = pInput[ iCursor++ ] + kRleNibbleShortRun + 1;
+			}
+
+			for ( int i = 0; i < iLength; ++i )
+			{
+				putNibble( ( ctrl >> 3 ) & 0x0F );
+			}
+		}
+		else
+		{
+			// Noisy data, packed.
+			if ( iCursor + ( ctrl + 1 ) / 2 > iInputSize )
+			{
+				return -1;
+			}
+
+			for ( int i = 0; i < ctrl; ++i )
+			{
+				const uint8_t packed = pInput[ iCursor + i / 2 ];
+				putNibble( ( i & 1 ) ? ( packed & 0x0F ) : ( packed >> 4 ) );
+			}
+
+			iCursor += ( ctrl + 1 ) / 2;
+		}
+	}
+}
+
+// Decode exactly one seek block of an indexed container. Returns false if the
+// input runs out or a run crosses the end of the block.
+static bool DecodeBlock8( uint8_t* pOutput, int iCount, const uint8_t* pInput, int iInputSize )
+{
+	int iCursor = 0;
+	int iDone = 0;
+
+	while ( iDone < iCount )
+	{
+		if ( iCursor >= iInputSize )
+		{
+			return false;
+		}
+
+		uint8_t ctrl = pInput[ iCursor++ ];
+		int iLength = ctrl & 0x7F;
+
+		if ( iLength == 0 || iDone + iLength > iCount )
+		{
+			return false;
+		}
+
+		if ( ctrl & 0x80 )
+		{
+			// Uniform data.
+			if ( iCursor >= iInputSize )
+			{
+				return false;
+			}
+
+			memset( pOutput + iDone, pInput[ iCursor++ ], iLength );
+		}
+		else
+		{
+			// Noisy data.
+			if ( iCursor + iLength > iInputSize )
+			{
+				return false;
+			}
+
+			memcpy( pOutput + iDone, pInput + iCursor, iLength );
+			iCursor += iLength;
+		}
+
+		iDone += iLength;
+	}
+
+	return true;
+}
+
+// Decode bytes [iStart, iStart + iLength) of an indexed container. Only the seek
+// blocks that overlap the range are read, so the cost follows the range size.
+static bool DecodeRange( uint8_t* pOutput, int iStart, int iLength, const RleIndex& index, const uint8_t* pInput, int iInputSize )
+{
+	const RleParams& params = index.params;
+	const int iPlanes = params.iPlanes;
+	const int iBlock = params.iIndexBlock;
+	const int iEnd = iStart + iLength;
+
+	const uint8_t* pData = pInput + index.iDataStart;
+	const int iDataSize = iInputSize - index.iDataStart;
+
+	std::vector< uint8_t > block;
+	int iFirstEntry = 0;
+
+	for ( int iPlane = 0; iPlane < iPlanes; ++iPlane )
+	{
+		const int iPlaneSize = PlaneSize( iPlane, iPlanes, index.iOutputSize );
+
+		// ... bytes [iLo, iHi) of this plane land in the range.
+		const int iLo = iStart > iPlane ? ( iStart - iPlane + iPlanes - 1 ) / iPlanes : 0;
+		const int iHi = iEnd > iPlane ? ( iEnd - iPlane + iPlanes - 1 ) / iPlanes : 0;
+
+		for ( int iBlockIndex = iLo / iBlock; iLo < iHi && iBlockIndex <= ( iHi - 1 ) / iBlock; ++iBlockIndex )
+		{
+			const int iBlockStart = iBlockIndex * iBlock;
+			const int iBlockSize = ( iPlaneSize - iBlockStart < iBlock ) ? ( iPlaneSize - iBlockStart ) : iBlock;
+			const uint32_t offset = index.offsets[ iFirstEntry + iBlockIndex ];
+
+			block.resize( iBlockSize );
+
+			if ( DecodeBlock8( block.data(), iBlockSize, pData + offset, iDataSize - offset ) == false )
+			{
+				return false;
+			}
+
+			UnfilterPlane( block.data(), iBlockSize, params );
+
+			// ... scatter the wanted bytes back to their interleaved positions.
+			const int iFrom = iLo > iBlockStart ? iLo : iBlockStart;
+			const int iTo = iHi < iBlockStart + iBlockSize ? iHi : iBlockStart + iBlockSize;
+
+			for ( int i = iFrom; i < iTo; ++i )
+			{
+				pOutput[ i * iPlanes + iPlane - iStart ] = block[ i - iBlockStart ];
+			}
+		}
+
+		iFirstEntry += RleIndexPlaneBlocks( iPlane, params, index.iOutputSize );
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// UnRLE
+//------------------------------------------------------------------------------
+int UnRLE( int argc, char** argv )
+{
+	std::string inputName;
+	std::string outputName;
+
+	enum eOption
+	{
+		NONE,
+		OPT_PLANES,
+		OPT_FILTER,
+		OPT_SCAN,
+		OPT_WIDTH,
+		OPT_INDEX,
+		OPT_OFFSET,
+		OPT_LENGTH,
+		OPT_PARAMS,
+		OPT_ENTRY,
+	};
+
+	eOption specialNextArg = NONE;
+
+	// defaults.
+	RleParams params;
+	DefaultRleParams( params );
+
+	int iRangeStart = -1;
+	int iRangeLength = -1;
+	int iEntry = -1;
+	bool bOptRaw = false;
+
+	// ... -params files are expanded in place, so gather the arguments first.
+	std::vector< std::string > args;
+	for ( int i = 2; i < argc; ++i )
+	{
+		args.push_back( argv[ i ] );
+	}
+
+	// parse arguments (after the tool name)
+	for ( size_t i = 0; i < args.size(); ++i )
+	{
+		const char* pArg = args[ i ].c_str();
+
+		if ( specialNextArg != NONE )
+		{
+			switch ( specialNextArg )
+			{
+
+			case OPT_PLANES:
+
+				{
+					int iValue;
+					char* pEnd = nullptr;
+					iValue = strtol( pArg, &pEnd, 10 );
+
+					if ( iValue > 0 && *pEnd == 0 )
+					{
+						params.iPlanes = iValue;
+					}
+					else
+					{
+						// error.
+						PrintError( "Invalid -planes parameter \"%s\".", pArg );
+						return 1;
+					}
+				}
+
+				break;
+
+			case OPT_FILTER:
+
+				if ( ParseRleFilter( params, pArg ) == false )
+				{
+					// error.
+					PrintError( "Invalid -filter \"%s\". Use delta or xor-row:<pitch>.", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_SCAN:
+
+				if ( ParseRleScan( params, pArg ) == false )
+				{
+					// error.
+					PrintError( "Invalid -scan \"%s\". Use column:<w>x<h>, tile:<tw>x<th> or zigzag.", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_WIDTH:
+
+				params.iWidth = ParseValue( pArg, 0x7FFFFFFF );
+
+				if ( params.iWidth < 1 )
+				{
+					// error.
+					PrintError( "Invalid -width parameter \"%s\".", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_INDEX:
+
+				// ... only here so .params files can be read back. The container
+				// header says how it was indexed.
+				if ( ParseValue( pArg, 0x7FFFFFFF ) < 1 )
+				{
+					// error.
+					PrintError( "Invalid -index parameter \"%s\".", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_OFFSET:
+
+				iRangeStart = ParseValue( pArg, 0x7FFFFFFF );
+
+				if ( iRangeStart < 0 )
+				{
+					// error.
+					PrintError( "Invalid -offset parameter \"%s\".", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_LENGTH:
+
+				iRangeLength = ParseValue( pArg, 0x7FFFFFFF );
+
+				if ( iRangeLength < 0 )
+				{
+					// error.
+					PrintError( "Invalid -length parameter \"%s\".", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_PARAMS:
+
+				{
+					std::vector< std::string > fileArgs;
+
+					if ( ReadRleParamsFile( fileArgs, pArg ) == false )
+					{
+						// error.
+						PrintError( "Cannot open params file \"%s\".", pArg );
+						return 1;
+					}
+
+					// ... process them next. Later command line options still win.
+					args.insert( args.begin() + i + 1, fileArgs.begin(), fileArgs.end() );
+				}
+
+				break;
+
+			case OPT_ENTRY:
+
+				iEntry = ParseValue( pArg, 0x7FFFFFFF );
+
+				if ( iEntry < 0 )
+				{
+					// error.
+					PrintError( "Invalid -entry parameter \"%s\".", pArg );
+					return 1;
+				}
+
+				break;
+
+			}
+
+			specialNextArg = NONE;
+		}
+		else if ( *pArg == '-' )
+		{
+			if ( _stricmp( pArg, "-planes" ) == 0 )
+			{
+				specialNextArg = OPT_PLANES;
+			}
+			else if ( _stricmp( pArg, "-filter" ) == 0 )
+			{
+				specialNextArg = OPT_FILTER;
+			}
+			else if ( _stricmp( pArg, "-scan" ) == 0 )
+			{
+				specialNextArg = OPT_SCAN;
+			}
+			else if ( _stricmp( pArg, "-width" ) == 0 )
+			{
+				specialNextArg = OPT_WIDTH;
+			}
+			else if ( _stricmp( pArg, "-index" ) == 0 )
+			{
+				specialNextArg = OPT_INDEX;
+			}
+			else if ( _stricmp( pArg, "-offset" ) == 0 )
+			{
+				specialNextArg = OPT_OFFSET;
+			}
+			else if ( _stricmp( pArg, "-length" ) == 0 )
+			{
+				specialNextArg = OPT_LENGTH;
+			}
+			else if ( _stricmp( pArg, "-params" ) == 0 )
+			{
+				specialNextArg = OPT_PARAMS;
+			}
+			else if ( _stricmp( pArg, "-entry" ) == 0 )
+			{
+				specialNextArg = OPT_ENTRY;
+			}
+			else if ( _stricmp( pArg, "-nibble" ) == 0 )
+			{
+				params.bNibbles = true;
+			}
+			else if ( _stricmp( pArg, "-raw" ) == 0 )
+			{
+				bOptRaw = true;
+			}
+			else
+			{
+				// error.
+				PrintHelp( "unrle" );
+				return 1;
+			}
+		}
+		else if ( inputName.empty() )
+		{
+			inputName = pArg;
+		}
+		else if ( outputName.empty() )
+		{
+			outputName = pArg;
+		}
+		else
+		{
+			// error.
+			PrintHelp( "unrle" );
+			return 1;
+		}
+	}
+
+	if ( inputName.empty() || outputName.empty() || specialNextArg != NONE )
+	{
+		PrintHelp( "unrle" );
+		return 1;
+	}
+
+	const char* pParamsError = CheckRleParams( params );
+	if ( pParamsError )
+	{
+		PrintError( "%s", pParamsError );
+		return 1;
+	}
+
+	const char* pInputName = inputName.c_str();
+	const char* pOutputName = outputName.c_str();
+
+	int err;
+	FILE* fp_out;
+
+	MappedFile input;
+	if ( MapFile( &input, pInputName ) == false )
+	{
+		PrintError( "Cannot open input file \"%s\"", pInputName );
+		return 1;
+	}
+
+	// ... sizes are handled as int.
+	if ( input.iSize > 0x7FFFFFFF )
+	{
+		PrintError( "Input file \"%s\" is too large.", pInputName );
+		UnmapFile( &input );
+		return 1;
+	}
+
+	const int iInputSize = static_cast<int>( input.iSize );
+
+	// An indexed container describes itself. A plain stream can start with the
+	// same bytes, so -raw skips looking.
+	RleIndex index;
+	const bool bIndexed = ( bOptRaw == false ) && ReadRleIndex( index, input.pData, iInputSize );
+
+	// ... so does each entry of an archive.
+	std::vector< RleArchiveEntry > entries;
+	const bool bArchive = ( bOptRaw == false ) && ( bIndexed == false ) && ReadRleArchive( entries, input.pData, iInputSize );
+
+	if ( bIndexed )
+	{
+		params = index.params;
+	}
+	else if ( iRangeStart >= 0 || iRangeLength >= 0 )
+	{
+		PrintError( "-offset and -length need an indexed input. Encode it with 'rle -index N'." );
+		UnmapFile( &input );
+		return 1;
+	}
+
+	if ( bArchive )
+	{
+		if ( iEntry < 0 || iEntry >= static_cast<int>( entries.size() ) )
+		{
+			PrintError( "\"%s\" is an archive. Choose an entry from 0 to %d with -entry N.", pInputName, static_cast<int>( entries.size() ) - 1 );
+			UnmapFile( &input );
+			return 1;
+		}
+
+		params = entries[ iEntry ].params;
+	}
+	else if ( iEntry >= 0 )
+	{
+		PrintError( "-entry needs an archive. Make one with 'rle -archive'." );
+		UnmapFile( &input );
+		return 1;
+	}
+
+	Info( "Decoding \"%s\"", pInputName );
+
+	if ( params.iPlanes > 1 )
+	{
+		printf( " (%d planes)", params.iPlanes );
+	}
+
+	if ( params.bNibbles )
+	{
+		printf( " (nibbles)" );
+	}
+
+	if ( bIndexed )
+	{
+		printf( " (indexed)" );
+	}
+
+	if ( bArchive )
+	{
+		printf( " (entry %d)", iEntry );
+	}
+
+	printf( " ... " );
+
+	std::vector< uint8_t > output;
+	int iCursor = bIndexed ? index.iDataStart : 0;
+
+	// ... an archive entry is measured from its own start.
+	const int iEntryStart = bArchive ? entries[ iEntry ].iOffset : 0;
+
+	if ( bArchive )
+	{
+		iCursor = iEntryStart;
+	}
+
+	if ( iRangeStart >= 0 || iRangeLength >= 0 )
+	{
+		// Decode part of the file.
+		if ( iRangeStart < 0 )
+		{
+			iRangeStart = 0;
+		}
+
+		if ( iRangeLength < 0 )
+		{
+			iRangeLength = iRangeStart < index.iOutputSize ? index.iOutputSize - iRangeStart : 0;
+		}
+
+		if ( iRangeStart > index.iOutputSize || iRangeLength > index.iOutputSize - iRangeStart )
+		{
+			printf( "FAILED\n" );
+			PrintError( "The range is outside the %d decoded bytes.", index.iOutputSize );
+			UnmapFile( &input );
+			return 1;
+		}
+
+		output.resize( iRangeLength );
+
+		if ( DecodeRange( output.data(), iRangeStart, iRangeLength, index, input.pData, iInputSize ) == false )
+		{
+			printf( "FAILED\n" );
+			PrintError( "Damaged block found in the range." );
+			UnmapFile( &input );
+			return 1;
+		}
+
+		UnmapFile( &input );
+	}
+	else
+	{
+		// Decode every plane back to back.
+		std::vector< uint8_t > planeData;
+		std::vector< int > planeSizes;
+
+		for ( int iPlane = 0; iPlane < params.iPlanes; ++iPlane )
+		{
+			size_t start = planeData.size();
+
+			int iUsed = params.bNibbles ? DecodePlane4( planeData, input.pData + iCursor, iInputSize - iCursor )
+										: DecodePlane8( planeData, input.pData + iCursor, iInputSize - iCursor );
+			if ( iUsed < 0 )
+			{
+				printf( "FAILED\n" );
+				PrintError( "Unexpected end of data in plane %d.", iPlane );
+				UnmapFile( &input );
+				return 1;
+			}
+
+			iCursor += iUsed;
+			planeSizes.push_back( static_cast<int>( planeData.size() - start ) );
+		}
+
+		UnmapFile( &input );
+
+		// Check the planes fit together.
+		const int iOutputSize = static_cast<int>( planeData.size() );
+
+		for ( int iPlane = 0; iPlane < params.iPlanes; ++iPlane )
+		{
+			if ( planeSizes[ iPlane ] != PlaneSize( iPlane, params.iPlanes, iOutputSize ) )
+			{
+				printf( "FAILED\n" );
+				PrintError( "Plane %d has %d bytes, expected %d. Wrong -planes?", iPlane, planeSizes[ iPlane ], PlaneSize( iPlane, params.iPlanes, iOutputSize ) );
+				return 1;
+			}
+		}
+
+		if ( bIndexed && iOutputSize != index.iOutputSize )
+		{
+			printf( "FAILED\n" );
+			PrintError( "Decoded %d bytes, but the index expects %d.", iOutputSize, index.iOutputSize );
+			return 1;
+		}
+
+		if ( bArchive && iOutputSize != entries[ iEntry ].iOutputSize )
+		{
+			printf( "FAILED\n" );
+			PrintError( "Decoded %d bytes, but the archive expects %d.", iOutputSize, entries[ iEntry ].iOutputSize );
+			return 1;
+		}
+
+		// Undo the filter and scan order on each plane, then interleave.
+		output.resize( iOutputSize );
+		RestoreRlePlanes( output.data(), planeData, iOutputSize, params );
+	}
+
+	// ... output file
+	err = fopen_s( &fp_out, pOutputName, "wb" );
+	if ( err != 0 || fp_out == nullptr )
+	{
+		printf( "FAILED\n" );
+		PrintError( "Cannot open output file \"%s\"", pOutputName );
+		return 1;
+	}
+
+	fwrite( output.data(), 1, output.size(), fp_out );
+	fclose( fp_out );
+
+	const int iOutputSize = static_cast<int>( output.size() );
+
+	if ( iRangeStart >= 0 )
+	{
+		printf( "OK (%d bytes from offset %d)\n", iOutputSize, iRangeStart );
+	}
+	else
+	{
+		printf( "OK (%d -> %d bytes)\n", iCursor - iEntryStart, iOutputSize );
+	}
+
+	if ( iRangeStart < 0 && bArchive == false && iCursor < iInputSize )
+	{
+		Info( "Ignored %d bytes after the last plane.\n", iInputSize - iCursor );
+	}
+
+	return 0;
+}
+
+//==============================================================================
@@ -23,12 +23,16 @@ SOFTWARE.
 
 */
 
+#include <cctype>
 #include <cstdio>
 #include <cstdlib>
 #include <errno.h>
 #include <cstring>
 #include <cstdint>
 #include <stdarg.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include "utils.h"
 
@@ -116,12 +120,12 @@ int64_t ParseSizeWithSuffix( const char* pStr )
 	if ( iHexOffset )
 	{
 		// Convert from hex.
-		iSize = strtol( pStr + iHexOffset, &pNumberEnd, 16 );
+		iSize = strtoll( pStr + iHexOffset, &pNumberEnd, 16 );
 	}
 	else
 	{
 		// Convert from decimal
-		iSize = strtol( pStr, &pNumberEnd, 10 );
+		iSize = strtoll( pStr, &pNumberEnd, 10 );
 	}
 
 	if ( errno == ERANGE || pStr == pNumberEnd || iSize < 0 )
@@ -153,7 +157,7 @@ int64_t ParseSizeWithSuffix( const char* pStr )
 		{
 			// Convert from hex.
 			errno = 0;
-			iSize = strtol( pStr + iHexOffset, &pNumberEnd, 16 );
+			iSize = strtoll( pStr + iHexOffset, &pNumberEnd, 16 );
 
 			if ( errno == ERANGE || pStr == pNumberEnd )
 			{
@@ -188,12 +192,12 @@ int ParseValue( const char* pStr, int iLimit )
 	if ( iHexOffset )
 	{
 		// Convert from hex.
-		iSize = strtol( pStr + iHexOffset, &pNumberEnd, 16 );
+		iSize = strtoll( pStr + iHexOffset, &pNumberEnd, 16 );
 	}
 	else
 	{
 		// Convert from decimal
-		iSize = strtol( pStr, &pNumberEnd, 10 );
+		iSize = strtoll( pStr, &pNumberEnd, 10 );
 	}
 
 	if ( errno == ERANGE || pStr == pNumberEnd || iSize < 0 )
@@ -213,7 +217,7 @@ int ParseValue( const char* pStr, int iLimit )
 		{
 			// Convert from hex.
 			errno = 0;
-			iSize = strtol( pStr + iHexOffset, &pNumberEnd, 16 );
+			iSize = strtoll( pStr + iHexOffset, &pNumberEnd, 16 );
 
 			if ( errno == ERANGE || pStr == pNumberEnd )
 			{
@@ -235,6 +239,93 @@ int ParseValue( const char* pStr, int iLimit )
 	return static_cast<int>( iSize );
 }
 
+//------------------------------------------------------------------------------
+// ParallelFor
+//------------------------------------------------------------------------------
+void ParallelFor( int iCount, const std::function< void( int ) >& fn )
+{
+	int iThreads = static_cast<int>( std::thread::hardware_concurrency() );
+	if ( iThreads > iCount )
+	{
+		iThreads = iCount;
+	}
+
+	// Nothing to gain from a pool?
+	if ( iThreads <= 1 )
+	{
+		for ( int i = 0; i < iCount; ++i )
+		{
+			fn( i );
+		}
+		return;
+	}
+
+	// Each worker pulls the next index until the work runs out.
+	std::atomic< int > next( 0 );
+
+	auto worker = [ & ]()
+	{
+		for ( ; ; )
+		{
+			int i = next++;
+			if ( i >= iCount )
+			{
+				break;
+			}
+
+			fn( i );
+		}
+	};
+
+	std::vector< std::thread > threads;
+	for ( int i = 1; i < iThreads; ++i )
+	{
+		threads.emplace_back( worker );
+	}
+
+	// ... this thread helps too.
+	worker();
+
+	for ( std::thread& thread : threads )
+	{
+		thread.join();
+	}
+}
+
+//------------------------------------------------------------------------------
+// FileLabel
+//------------------------------------------------------------------------------
+std::string FileLabel( const char* pPrefix, const char* pPath )
+{
+	const char* pBase = pPath;
+	for ( const char* p = pPath; *p; ++p )
+	{
+		if ( *p == '/' || *p == '\\' || *p == ':' )
+		{
+			pBase = p + 1;
+		}
+	}
+
+	std::string label = pPrefix;
+	for ( const char* p = pBase; *p && *p != '.'; ++p )
+	{
+		label += isalnum( static_cast<unsigned char>( *p ) ) ? *p : '_';
+	}
+
+	return label;
+}
+
+//------------------------------------------------------------------------------
+// IsCFileName
+//------------------------------------------------------------------------------
+bool IsCFileName( const char* pName )
+{
+	const char* pExt = strrchr( pName, '.' );
+
+	return pExt && ( _stricmp( pExt, ".h" ) == 0 || _stricmp( pExt, ".hpp" ) == 0 ||
+					 _stricmp( pExt, ".c" ) == 0 || _stricmp( pExt, ".cpp" ) == 0 );
+}
+
 //------------------------------------------------------------------------------
 // TestParsingSizes
 //------------------------------------------------------------------------------
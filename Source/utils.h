@@ -26,6 +26,43 @@ SOFTWARE.
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <string>
+
+// SSE2 is part of the x64 baseline, so it's always safe to use there.
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#define BINARYTOOLS_SSE2
+#endif
+
+// The tools are written against the MSVC runtime. Map the few secure/legacy
+// names we use onto their POSIX equivalents elsewhere.
+#ifndef _WIN32
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <strings.h>
+
+#define _stricmp strcasecmp
+#define _strcmpi strcasecmp
+#define _strnicmp strncasecmp
+#define vsprintf_s vsnprintf
+
+inline int fopen_s( FILE** ppFile, const char* pName, const char* pMode )
+{
+	*ppFile = fopen( pName, pMode );
+	return ( *ppFile == nullptr ) ? errno : 0;
+}
+
+inline char* gets_s( char* pBuffer, size_t size )
+{
+	char* pStr = fgets( pBuffer, static_cast<int>( size ), stdin );
+	if ( pStr )
+	{
+		pStr[ strcspn( pStr, "\r\n" ) ] = 0;
+	}
+	return pStr;
+}
+#endif // _WIN32
 
 //------------------------------------------------------------------------------
 // Utility Functions
@@ -52,6 +89,17 @@ int64_t ParseSizeWithSuffix( const char* pStr );
 // Returns -1 on invalid number.
 int ParseValue( const char* pStr, int iLimit );
 
+// Run fn( i ) for every i in [0, iCount) using a pool of worker threads, one
+// per hardware thread. Returns when all calls have completed.
+void ParallelFor( int iCount, const std::function< void( int ) >& fn );
+
+// Name for a file's data in generated source: pPrefix and the file name up to
+// the first '.', e.g. ( "RLE_", "gfx/title.rle" ) -> RLE_title.
+std::string FileLabel( const char* pPrefix, const char* pPath );
+
+// True if a file name ends with a C or C++ extension.
+bool IsCFileName( const char* pName );
+
 // Testing for ParseSizeWithSuffix
 void TestParsingSizes();
 
@@ -0,0 +1,793 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include "utils.h"
+#include "z80.h"
+
+// Flag bits.
+static const uint8_t FLAG_C = 0x01;
+static const uint8_t FLAG_N = 0x02;
+static const uint8_t FLAG_PV = 0x04;
+static const uint8_t FLAG_H = 0x10;
+static const uint8_t FLAG_Z = 0x40;
+static const uint8_t FLAG_S = 0x80;
+
+// S and Z flags for a result.
+static uint8_t FlagsSZ( uint8_t v )
+{
+	return ( v & FLAG_S ) | ( v ? 0 : FLAG_Z );
+}
+
+// S, Z and parity flags for a result.
+static uint8_t FlagsSZP( uint8_t v )
+{
+	uint8_t parity = v;
+	parity ^= parity >> 4;
+	parity ^= parity >> 2;
+	parity ^= parity >> 1;
+
+	return FlagsSZ( v ) | ( ( parity & 1 ) ? 0 : FLAG_PV );
+}
+
+//------------------------------------------------------------------------------
+// Helpers
+//------------------------------------------------------------------------------
+
+void Z80::Reset()
+{
+	memset( r, 0, sizeof( r ) );
+	memset( alt, 0, sizeof( alt ) );
+	sp = 0;
+	pc = 0;
+	iCycles = 0;
+}
+
+uint16_t Z80::Fetch16()
+{
+	uint16_t v = Read16( pc );
+	pc += 2;
+	return v;
+}
+
+uint16_t Z80::Read16( uint16_t addr ) const
+{
+	return mem[ addr ] | ( mem[ static_cast<uint16_t>( addr + 1 ) ] << 8 );
+}
+
+void Z80::Write16( uint16_t addr, uint16_t v )
+{
+	mem[ addr ] = v & 0xFF;
+	mem[ static_cast<uint16_t>( addr + 1 ) ] = v >> 8;
+}
+
+void Z80::Push( uint16_t v )
+{
+	sp -= 2;
+	Write16( sp, v );
+}
+
+uint16_t Z80::Pop()
+{
+	uint16_t v = Read16( sp );
+	sp += 2;
+	return v;
+}
+
+uint16_t Z80::GetPair( int i ) const
+{
+	switch ( i )
+	{
+	case 0: return BC();
+	case 1: return DE();
+	case 2: return HL();
+	default: return sp;
+	}
+}
+
+void Z80::SetPair( int i, uint16_t v )
+{
+	switch ( i )
+	{
+	case 0: SetBC( v ); break;
+	case 1: SetDE( v ); break;
+	case 2: SetHL( v ); break;
+	default: sp = v; break;
+	}
+}
+
+bool Z80::Condition( int cc ) const
+{
+	const uint8_t f = r[ Z80_F ];
+
+	switch ( cc )
+	{
+	case 0: return ( f & FLAG_Z ) == 0;		// NZ
+	case 1: return ( f & FLAG_Z ) != 0;		// Z
+	case 2: return ( f & FLAG_C ) == 0;		// NC
+	case 3: return ( f & FLAG_C ) != 0;		// C
+	case 4: return ( f & FLAG_PV ) == 0;	// PO
+	case 5: return ( f & FLAG_PV ) != 0;	// PE
+	case 6: return ( f & FLAG_S ) == 0;		// P
+	default: return ( f & FLAG_S ) != 0;	// M
+	}
+}
+
+// 8-bit arithmetic and logic: add, adc, sub, sbc, and, xor, or, cp.
+void Z80::Alu( int op, uint8_t v )
+{
+	const uint8_t a = r[ Z80_A ];
+	const int carry = ( ( op == 1 || op == 3 ) && ( r[ Z80_F ] & FLAG_C ) ) ? 1 : 0;
+	int res;
+
+	switch ( op )
+	{
+
+	case 0:
+	case 1:
+		res = a + v + carry;
+		r[ Z80_F ] = FlagsSZ( res & 0xFF ) | ( ( a ^ v ^ res ) & FLAG_H ) |
+					 ( ( ( a ^ ~v ) & ( a ^ res ) & 0x80 ) ? FLAG_PV : 0 ) | ( res > 0xFF ? FLAG_C : 0 );
+		r[ Z80_A ] = res & 0xFF;
+		break;
+
+	case 2:
+	case 3:
+	case 7:
+		res = a - v - carry;
+		r[ Z80_F ] = FlagsSZ( res & 0xFF ) | FLAG_N | ( ( a ^ v ^ res ) & FLAG_H ) |
+					 ( ( ( a ^ v ) & ( a ^ res ) & 0x80 ) ? FLAG_PV : 0 ) | ( res < 0 ? FLAG_C : 0 );
+
+		if ( op != 7 )
+		{
+			r[ Z80_A ] = res & 0xFF;
+		}
+		break;
+
+	case 4:
+		r[ Z80_A ] = a & v;
+		r[ Z80_F ] = FlagsSZP( r[ Z80_A ] ) | FLAG_H;
+		break;
+
+	case 5:
+		r[ Z80_A ] = a ^ v;
+		r[ Z80_F ] = FlagsSZP( r[ Z80_A ] );
+		break;
+
+	case 6:
+		r[ Z80_A ] = a | v;
+		r[ Z80_F ] = FlagsSZP( r[ Z80_A ] );
+		break;
+
+	}
+}
+
+uint8_t Z80::Inc( uint8_t v )
+{
+	const uint8_t res = v + 1;
+	r[ Z80_F ] = ( r[ Z80_F ] & FLAG_C ) | FlagsSZ( res ) | ( ( v & 0xF ) == 0xF ? FLAG_H : 0 ) | ( v == 0x7F ? FLAG_PV : 0 );
+	return res;
+}
+
+uint8_t Z80::Dec( uint8_t v )
+{
+	const uint8_t res = v - 1;
+	r[ Z80_F ] = ( r[ Z80_F ] & FLAG_C ) | FLAG_N | FlagsSZ( res ) | ( ( v & 0xF ) == 0 ? FLAG_H : 0 ) | ( v == 0x80 ? FLAG_PV : 0 );
+	return res;
+}
+
+//------------------------------------------------------------------------------
+// Instructions
+//------------------------------------------------------------------------------
+
+Z80Status Z80::Step()
+{
+	const uint8_t op = Fetch();
+
+	// ld r,r' (0x76 is halt)
+	if ( op >= 0x40 && op < 0x80 )
+	{
+		if ( op == 0x76 )
+		{
+			--pc;
+			iCycles += 4;
+			return Z80_HALT;
+		}
+
+		const int dst = ( op >> 3 ) & 7;
+		const int src = op & 7;
+
+		if ( src == 6 )
+		{
+			r[ dst ] = mem[ HL() ];
+			iCycles += 7;
+		}
+		else if ( dst == 6 )
+		{
+			mem[ HL() ] = r[ src ];
+			iCycles += 7;
+		}
+		else
+		{
+			r[ dst ] = r[ src ];
+			iCycles += 4;
+		}
+
+		return Z80_OK;
+	}
+
+	// alu a,r
+	if ( op >= 0x80 && op < 0xC0 )
+	{
+		const int src = op & 7;
+
+		Alu( ( op >> 3 ) & 7, src == 6 ? mem[ HL() ] : r[ src ] );
+		iCycles += ( src == 6 ) ? 7 : 4;
+
+		return Z80_OK;
+	}
+
+	const int y = ( op >> 3 ) & 7;	// register or condition in bits 3-5
+	const int p = ( op >> 4 ) & 3;	// register pair in bits 4-5
+
+	switch ( op )
+	{
+
+	case 0x00: // nop
+		iCycles += 4;
+		break;
+
+	case 0x01: case 0x11: case 0x21: case 0x31: // ld rr,nn
+		SetPair( p, Fetch16() );
+		iCycles += 10;
+		break;
+
+	case 0x02: // ld (bc),a
+		mem[ BC() ] = r[ Z80_A ];
+		iCycles += 7;
+		break;
+
+	case 0x12: // ld (de),a
+		mem[ DE() ] = r[ Z80_A ];
+		iCycles += 7;
+		break;
+
+	case 0x0A: // ld a,(bc)
+		r[ Z80_A ] = mem[ BC() ];
+		iCycles += 7;
+		break;
+
+	case 0x1A: // ld a,(de)
+		r[ Z80_A ] = mem[ DE() ];
+		iCycles += 7;
+		break;
+
+	case 0x03: case 0x13: case 0x23: case 0x33: // inc rr
+		SetPair( p, GetPair( p ) + 1 );
+		iCycles += 6;
+		break;
+
+	case 0x0B: case 0x1B: case 0x2B: case 0x3B: // dec rr
+		SetPair( p, GetPair( p ) - 1 );
+		iCycles += 6;
+		break;
+
+	case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x34: case 0x3C: // inc r
+		if ( y == 6 )
+		{
+			mem[ HL() ] = Inc( mem[ HL() ] );
+			iCycles += 11;
+		}
+		else
+		{
+			r[ y ] = Inc( r[ y ] );
+			iCycles += 4;
+		}
+		break;
+
+	case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x35: case 0x3D: // dec r
+		if ( y == 6 )
+		{
+			mem[ HL() ] = Dec( mem[ HL() ] );
+			iCycles += 11;
+		}
+		else
+		{
+			r[ y ] = Dec( r[ y ] );
+			iCycles += 4;
+		}
+		break;
+
+	case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x36: case 0x3E: // ld r,n
+		if ( y == 6 )
+		{
+			mem[ HL() ] = Fetch();
+			iCycles += 10;
+		}
+		else
+		{
+			r[ y ] = Fetch();
+			iCycles += 7;
+		}
+		break;
+
+	case 0x07: // rlca
+		{
+			const uint8_t a = r[ Z80_A ];
+			r[ Z80_A ] = ( a << 1 ) | ( a >> 7 );
+			r[ Z80_F ] = ( r[ Z80_F ] & ( FLAG_S | FLAG_Z | FLAG_PV ) ) | ( a >> 7 );
+			iCycles += 4;
+		}
+		break;
+
+	case 0x0F: // rrca
+		{
+			const uint8_t a = r[ Z80_A ];
+			r[ Z80_A ] = ( a >> 1 ) | ( a << 7 );
+			r[ Z80_F ] = ( r[ Z80_F ] & ( FLAG_S | FLAG_Z | FLAG_PV ) ) | ( a & 1 );
+			iCycles += 4;
+		}
+		break;
+
+	case 0x17: // rla
+		{
+			const uint8_t a = r[ Z80_A ];
+			r[ Z80_A ] = ( a << 1 ) | ( r[ Z80_F ] & FLAG_C );
+			r[ Z80_F ] = ( r[ Z80_F ] & ( FLAG_S | FLAG_Z | FLAG_PV ) ) | ( a >> 7 );
+			iCycles += 4;
+		}
+		break;
+
+	case 0x1F: // rra
+		{
+			const uint8_t a = r[ Z80_A ];
+			r[ Z80_A ] = ( a >> 1 ) | ( ( r[ Z80_F ] & FLAG_C ) << 7 );
+			r[ Z80_F ] = ( r[ Z80_F ] & ( FLAG_S | FLAG_Z | FLAG_PV ) ) | ( a & 1 );
+			iCycles += 4;
+		}
+		break;
+
+	case 0x08: // ex af,af'
+		{
+			uint8_t a = r[ Z80_A ], f = r[ Z80_F ];
+			r[ Z80_A ] = alt[ Z80_A ];
+			r[ Z80_F ] = alt[ Z80_F ];
+			alt[ Z80_A ] = a;
+			alt[ Z80_F ] = f;
+			iCycles += 4;
+		}
+		break;
+
+	case 0xD9: // exx
+		for ( int i = Z80_B; i <= Z80_L; ++i )
+		{
+			uint8_t v = r[ i ];
+			r[ i ] = alt[ i ];
+			alt[ i ] = v;
+		}
+		iCycles += 4;
+		break;
+
+	case 0x09: case 0x19: case 0x29: case 0x39: // add hl,rr
+		{
+			const uint16_t hl = HL();
+			const uint16_t rr = GetPair( p );
+			const int res = hl + rr;
+
+			r[ Z80_F ] = ( r[ Z80_F ] & ( FLAG_S | FLAG_Z | FLAG_PV ) ) | ( ( ( hl ^ rr ^ res ) >> 8 ) & FLAG_H ) | ( res > 0xFFFF ? FLAG_C : 0 );
+			SetHL( res & 0xFFFF );
+			iCycles += 11;
+		}
+		break;
+
+	case 0x10: // djnz e
+		{
+			const int8_t e = static_cast<int8_t>( Fetch() );
+
+			if ( --r[ Z80_B ] )
+			{
+				pc += e;
+				iCycles += 13;
+			}
+			else
+			{
+				iCycles += 8;
+			}
+		}
+		break;
+
+	case 0x18: // jr e
+		{
+			const int8_t e = static_cast<int8_t>( Fetch() );
+			pc += e;
+			iCycles += 12;
+		}
+		break;
+
+	case 0x20: case 0x28: case 0x30: case 0x38: // jr cc,e
+		{
+			const int8_t e = static_cast<int8_t>( Fetch() );
+
+			if ( Condition( y - 4 ) )
+			{
+				pc += e;
+				iCycles += 12;
+			}
+			else
+			{
+				iCycles += 7;
+			}
+		}
+		break;
+
+	case 0x22: // ld (nn),hl
+		Write16( Fetch16(), HL() );
+		iCycles += 16;
+		break;
+
+	case 0x2A: // ld hl,(nn)
+		SetHL( Read16( Fetch16() ) );
+		iCycles += 16;
+		break;
+
+	case 0x32: // ld (nn),a
+		mem[ Fetch16() ] = r[ Z80_A ];
+		iCycles += 13;
+		break;
+
+	case 0x3A: // ld a,(nn)
+		r[ Z80_A ] = mem[ Fetch16() ];
+		iCycles += 13;
+		break;
+
+	case 0x2F: // cpl
+		r[ Z80_A ] = ~r[ Z80_A ];
+		r[ Z80_F ] |= FLAG_H | FLAG_N;
+		iCycles += 4;
+		break;
+
+	case 0x37: // scf
+		r[ Z80_F ] = ( r[ Z80_F ] & ( FLAG_S | FLAG_Z | FLAG_PV ) ) | FLAG_C;
+		iCycles += 4;
+		break;
+
+	case 0x3F: // ccf
+		r[ Z80_F ] = ( r[ Z80_F ] & ( FLAG_S | FLAG_Z | FLAG_PV ) ) | ( ( r[ Z80_F ] & FLAG_C ) ? FLAG_H : FLAG_C );
+		iCycles += 4;
+		break;
+
+	case 0xC0: case 0xC8: case 0xD0: case 0xD8: case 0xE0: case 0xE8: case 0xF0: case 0xF8: // ret cc
+		if ( Condition( y ) )
+		{
+			pc = Pop();
+			iCycles += 11;
+		}
+		else
+		{
+			iCycles += 5;
+		}
+		break;
+
+	case 0xC9: // ret
+		pc = Pop();
+		iCycles += 10;
+		break;
+
+	case 0xC2: case 0xCA: case 0xD2: case 0xDA: case 0xE2: case 0xEA: case 0xF2: case 0xFA: // jp cc,nn
+		{
+			const uint16_t nn = Fetch16();
+
+			if ( Condition( y ) )
+			{
+				pc = nn;
+			}
+
+			iCycles += 10;
+		}
+		break;
+
+	case 0xC3: // jp nn
+		pc = Fetch16();
+		iCycles += 10;
+		break;
+
+	case 0xE9: // jp (hl)
+		pc = HL();
+		iCycles += 4;
+		break;
+
+	case 0xC4: case 0xCC: case 0xD4: case 0xDC: case 0xE4: case 0xEC: case 0xF4: case 0xFC: // call cc,nn
+		{
+			const uint16_t nn = Fetch16();
+
+			if ( Condition( y ) )
+			{
+				Push( pc );
+				pc = nn;
+				iCycles += 17;
+			}
+			else
+			{
+				iCycles += 10;
+			}
+		}
+		break;
+
+	case 0xCD: // call nn
+		{
+			const uint16_t nn = Fetch16();
+			Push( pc );
+			pc = nn;
+			iCycles += 17;
+		}
+		break;
+
+	case 0xC1: case 0xD1: case 0xE1: // pop rr
+		SetPair( p, Pop() );
+		iCycles += 10;
+		break;
+
+	case 0xF1: // pop af
+		{
+			const uint16_t v = Pop();
+			r[ Z80_A ] = v >> 8;
+			r[ Z80_F ] = v & 0xFF;
+			iCycles += 10;
+		}
+		break;
+
+	case 0xC5: case 0xD5: case 0xE5: // push rr
+		Push( GetPair( p ) );
+		iCycles += 11;
+		break;
+
+	case 0xF5: // push af
+		Push( ( r[ Z80_A ] << 8 ) | r[ Z80_F ] );
+		iCycles += 11;
+		break;
+
+	case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // alu a,n
+		Alu( y, Fetch() );
+		iCycles += 7;
+		break;
+
+	case 0xEB: // ex de,hl
+		{
+			const uint16_t de = DE();
+			SetDE( HL() );
+			SetHL( de );
+			iCycles += 4;
+		}
+		break;
+
+	case 0xE3: // ex (sp),hl
+		{
+			const uint16_t v = Read16( sp );
+			Write16( sp, HL() );
+			SetHL( v );
+			iCycles += 19;
+		}
+		break;
+
+	case 0xF9: // ld sp,hl
+		sp = HL();
+		iCycles += 6;
+		break;
+
+	case 0xF3: // di
+	case 0xFB: // ei
+		iCycles += 4;
+		break;
+
+	case 0xCB:
+		return StepCB();
+
+	case 0xED:
+		return StepED();
+
+	default:
+		--pc;
+		return Z80_BAD_OPCODE;
+
+	}
+
+	return Z80_OK;
+}
+
+// Rotates, shifts and bit instructions.
+Z80Status Z80::StepCB()
+{
+	const uint8_t op = Fetch();
+	const int reg = op & 7;
+	const int y = ( op >> 3 ) & 7;
+
+	uint8_t v = ( reg == 6 ) ? mem[ HL() ] : r[ reg ];
+
+	switch ( op >> 6 )
+	{
+
+	case 0: // rlc, rrc, rl, rr, sla, sra, sll, srl
+		{
+			uint8_t carry;
+
+			switch ( y )
+			{
+			case 0: carry = v >> 7; v = ( v << 1 ) | carry; break;
+			case 1: carry = v & 1; v = ( v >> 1 ) | ( carry << 7 ); break;
+			case 2: carry = v >> 7; v = ( v << 1 ) | ( r[ Z80_F ] & FLAG_C ); break;
+			case 3: carry = v & 1; v = ( v >> 1 ) | ( ( r[ Z80_F ] & FLAG_C ) << 7 ); break;
+			case 4: carry = v >> 7; v = v << 1; break;
+			case 5: carry = v & 1; v = ( v >> 1 ) | ( v & 0x80 ); break;
+			case 6: carry = v >> 7; v = ( v << 1 ) | 1; break;
+			default: carry = v & 1; v = v >> 1; break;
+			}
+
+			r[ Z80_F ] = FlagsSZP( v ) | carry;
+		}
+		break;
+
+	case 1: // bit
+		r[ Z80_F ] = ( r[ Z80_F ] & FLAG_C ) | FLAG_H | ( ( v & ( 1 << y ) ) ? ( v & ( 1 << y ) & FLAG_S ) : ( FLAG_Z | FLAG_PV ) );
+		iCycles += ( reg == 6 ) ? 12 : 8;
+		return Z80_OK;
+
+	case 2: // res
+		v &= ~( 1 << y );
+		break;
+
+	case 3: // set
+		v |= ( 1 << y );
+		break;
+
+	}
+
+	if ( reg == 6 )
+	{
+		mem[ HL() ] = v;
+		iCycles += 15;
+	}
+	else
+	{
+		r[ reg ] = v;
+		iCycles += 8;
+	}
+
+	return Z80_OK;
+}
+
+// Block copies and 16-bit arithmetic.
+Z80Status Z80::StepED()
+{
+	const uint8_t op = Fetch();
+	const int p = ( op >> 4 ) & 3;
+
+	switch ( op )
+	{
+
+	case 0x42: case 0x52: case 0x62: case 0x72: // sbc hl,rr
+	case 0x4A: case 0x5A: case 0x6A: case 0x7A: // adc hl,rr
+		{
+			const int hl = HL();
+			const int rr = GetPair( p );
+			const int carry = ( r[ Z80_F ] & FLAG_C ) ? 1 : 0;
+			const bool bSub = ( op & 0x08 ) == 0;
+			const int res = bSub ? ( hl - rr - carry ) : ( hl + rr + carry );
+			const bool bOverflow = bSub ? ( ( ( hl ^ rr ) & ( hl ^ res ) & 0x8000 ) != 0 ) : ( ( ( hl ^ ~rr ) & ( hl ^ res ) & 0x8000 ) != 0 );
+
+			r[ Z80_F ] = ( ( res >> 8 ) & FLAG_S ) | ( ( res & 0xFFFF ) ? 0 : FLAG_Z ) | ( ( ( hl ^ rr ^ res ) >> 8 ) & FLAG_H ) |
+						 ( bOverflow ? FLAG_PV : 0 ) | ( bSub ? FLAG_N : 0 ) | ( ( res < 0 || res > 0xFFFF ) ? FLAG_C : 0 );
+			SetHL( res & 0xFFFF );
+			iCycles += 15;
+		}
+		break;
+
+	case 0x43: case 0x53: case 0x63: case 0x73: // ld (nn),rr
+		Write16( Fetch16(), GetPair( p ) );
+		iCycles += 20;
+		break;
+
+	case 0x4B: case 0x5B: case 0x6B: case 0x7B: // ld rr,(nn)
+		SetPair( p, Read16( Fetch16() ) );
+		iCycles += 20;
+		break;
+
+	case 0x44: // neg
+		{
+			const uint8_t a = r[ Z80_A ];
+			r[ Z80_A ] = 0;
+			Alu( 2, a );
+			iCycles += 8;
+		}
+		break;
+
+	case 0xA0: // ldi
+	case 0xA8: // ldd
+	case 0xB0: // ldir
+	case 0xB8: // lddr
+		{
+			const int step = ( op & 0x08 ) ? -1 : 1;
+
+			mem[ DE() ] = mem[ HL() ];
+			SetHL( HL() + step );
+			SetDE( DE() + step );
+			SetBC( BC() - 1 );
+
+			r[ Z80_F ] = ( r[ Z80_F ] & ( FLAG_S | FLAG_Z | FLAG_C ) ) | ( BC() ? FLAG_PV : 0 );
+
+			if ( ( op & 0x10 ) && BC() )
+			{
+				// ... repeat.
+				pc -= 2;
+				iCycles += 21;
+			}
+			else
+			{
+				iCycles += 16;
+			}
+		}
+		break;
+
+	default:
+		pc -= 2;
+		return Z80_BAD_OPCODE;
+
+	}
+
+	return Z80_OK;
+}
+
+//------------------------------------------------------------------------------
+// Call
+//------------------------------------------------------------------------------
+
+Z80Status Z80::Call( uint16_t addr, uint64_t iMaxCycles )
+{
+	sp = 0;
+	Push( kZ80ReturnAddress );
+	pc = addr;
+
+	const uint64_t iLimit = iCycles + iMaxCycles;
+
+	while ( pc != kZ80ReturnAddress )
+	{
+		if ( iCycles >= iLimit )
+		{
+			return Z80_TIMEOUT;
+		}
+
+		Z80Status status = Step();
+		if ( status != Z80_OK )
+		{
+			return status;
+		}
+	}
+
+	return Z80_OK;
+}
+
+//==============================================================================
@@ -0,0 +1,139 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Z80 Emulator
+//------------------------------------------------------------------------------
+//
+// A small Z80 core with exact T-state timing, covering enough of the
+// instruction set to run and time the routines in Extras/ (and the decoders
+// written by 'rle -emit-decoder'). The unprefixed, CB and ED instructions are
+// supported; IX, IY, I/O and interrupts are not.
+
+enum Z80Status
+{
+	Z80_OK,
+	Z80_HALT,				// executed HALT
+	Z80_BAD_OPCODE,			// instruction not supported by this core
+	Z80_TIMEOUT,			// Call() ran out of cycles
+};
+
+// Register indices, in the order used by the instruction encoding. Slot 6
+// (the encoding for "(hl)") holds F.
+enum
+{
+	Z80_B, Z80_C, Z80_D, Z80_E, Z80_H, Z80_L, Z80_F, Z80_A
+};
+
+// Address Call() returns to. Memory from here up is kept for the stack.
+static const int kZ80ReturnAddress = 0xFF00;
+
+struct Z80
+{
+	uint8_t mem[ 65536 ];
+	uint8_t r[ 8 ];
+	uint8_t alt[ 8 ];		// shadow registers for EX AF,AF' and EXX
+	uint16_t sp;
+	uint16_t pc;
+	uint64_t iCycles;
+
+	// Clear registers and cycle count. Memory is left alone.
+	void Reset();
+
+	uint16_t BC() const { return ( r[ Z80_B ] << 8 ) | r[ Z80_C ]; }
+	uint16_t DE() const { return ( r[ Z80_D ] << 8 ) | r[ Z80_E ]; }
+	uint16_t HL() const { return ( r[ Z80_H ] << 8 ) | r[ Z80_L ]; }
+
+	void SetBC( uint16_t v ) { r[ Z80_B ] = v >> 8; r[ Z80_C ] = v & 0xFF; }
+	void SetDE( uint16_t v ) { r[ Z80_D ] = v >> 8; r[ Z80_E ] = v & 0xFF; }
+	void SetHL( uint16_t v ) { r[ Z80_H ] = v >> 8; r[ Z80_L ] = v & 0xFF; }
+
+	// Execute one instruction.
+	Z80Status Step();
+
+	// Call the routine at addr (from a return address at the top of memory) and
+	// run until it returns, or until iMaxCycles have passed.
+	Z80Status Call( uint16_t addr, uint64_t iMaxCycles );
+
+	// ... internals.
+
+	uint8_t Fetch() { return mem[ pc++ ]; }
+	uint16_t Fetch16();
+	uint16_t Read16( uint16_t addr ) const;
+	void Write16( uint16_t addr, uint16_t v );
+	void Push( uint16_t v );
+	uint16_t Pop();
+
+	uint16_t GetPair( int i ) const;		// BC, DE, HL, SP
+	void SetPair( int i, uint16_t v );
+
+	bool Condition( int cc ) const;
+
+	void Alu( int op, uint8_t v );
+	uint8_t Inc( uint8_t v );
+	uint8_t Dec( uint8_t v );
+
+	Z80Status StepCB();
+	Z80Status StepED();
+};
+
+//------------------------------------------------------------------------------
+// Z80 Assembler
+//------------------------------------------------------------------------------
+//
+// Assembles the subset of vasm "oldstyle" syntax used in Extras/: labels in the
+// first column (colon optional), org, db, dw, dsb and equ directives, and the
+// instructions the emulator supports. Expressions can use + - * / << >> & |
+// and brackets on numbers written as 123, $7B, 0x7B, 7Bh or %01111011, and
+// labels. '$' on its own is the current address.
+
+struct Z80Source
+{
+	std::string name;
+	std::string text;
+};
+
+struct Z80Program
+{
+	std::map< std::string, int > labels;
+	int iStart;				// lowest address written
+	int iEnd;				// one past the highest address written
+	std::string error;		// "file(line): message" on failure
+};
+
+// Assemble the sources, one after the other, into memory.
+bool AssembleZ80( Z80Program& program, uint8_t* pMemory, const std::vector< Z80Source >& sources );
+
+// Read a source file for AssembleZ80.
+bool ReadZ80Source( Z80Source& source, const char* pName );
+
+//==============================================================================
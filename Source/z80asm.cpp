@@ -0,0 +1,1279 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "z80.h"
+
+//------------------------------------------------------------------------------
+// Assembler State
+//------------------------------------------------------------------------------
+
+struct AsmContext
+{
+	Z80Program* pProgram;
+	uint8_t* pMemory;
+	int iPass;					// 1 = collect labels, 2 = write code
+	int iPC;
+	bool bUnresolved;			// an expression used a label not yet defined
+	std::string error;
+};
+
+// Operand kinds.
+enum AsmOperandKind
+{
+	ASM_R8,			// b c d e h l (hl) a - value is the register index
+	ASM_RR,			// bc de hl sp - value is the pair index
+	ASM_AF,
+	ASM_AF_ALT,
+	ASM_IND_BC,
+	ASM_IND_DE,
+	ASM_IND_SP,
+	ASM_IND_NN,		// (expression)
+	ASM_NN,			// expression
+	ASM_CONDITION,	// nz z nc po pe p m ('c' is parsed as the register)
+};
+
+struct AsmOperand
+{
+	AsmOperandKind kind;
+	int iValue;
+	std::string text;	// lower case, for condition codes
+};
+
+static std::string Trim( const std::string& s )
+{
+	size_t start = s.find_first_not_of( " \t\r\n" );
+	if ( start == std::string::npos )
+	{
+		return std::string();
+	}
+
+	size_t end = s.find_last_not_of( " \t\r\n" );
+	return s.substr( start, end - start + 1 );
+}
+
+static std::string Lower( const std::string& s )
+{
+	std::string out = s;
+	for ( char& ch : out )
+	{
+		ch = static_cast<char>( tolower( static_cast<unsigned char>( ch ) ) );
+	}
+
+	return out;
+}
+
+static bool IsSymbolStart( char ch )
+{
+	return isalpha( static_cast<unsigned char>( ch ) ) || ch == '_' || ch == '.';
+}
+
+static bool IsSymbolChar( char ch )
+{
+	return isalnum( static_cast<unsigned char>( ch ) ) || ch == '_' || ch == '.';
+}
+
+// A character literal such as 'A' (and not the quote in af').
+static bool IsCharLiteral( const std::string& s, size_t i )
+{
+	return s[ i ] == '\'' && i + 2 < s.size() && s[ i + 2 ] == '\'';
+}
+
+static void Emit( AsmContext& ctx, int value )
+{
+	if ( ctx.iPass == 2 )
+	{
+		const int addr = ctx.iPC & 0xFFFF;
+		ctx.pMemory[ addr ] = static_cast<uint8_t>( value );
+
+		if ( addr < ctx.pProgram->iStart )
+		{
+			ctx.pProgram->iStart = addr;
+		}
+
+		if ( addr + 1 > ctx.pProgram->iEnd )
+		{
+			ctx.pProgram->iEnd = addr + 1;
+		}
+	}
+
+	++ctx.iPC;
+}
+
+static void Emit16( AsmContext& ctx, int value )
+{
+	Emit( ctx, value & 0xFF );
+	Emit( ctx, ( value >> 8 ) & 0xFF );
+}
+
+//------------------------------------------------------------------------------
+// Expressions
+//------------------------------------------------------------------------------
+
+static bool ParseExpression( AsmContext& ctx, const char*& p, int& value );
+
+static void SkipSpace( const char*& p )
+{
+	while ( *p == ' ' || *p == '\t' )
+	{
+		++p;
+	}
+}
+
+static bool ParseNumber( AsmContext& ctx, const char*& p, int& value )
+{
+	const char* pStart = p;
+	int iBase = 10;
+
+	if ( *p == '$' )
+	{
+		++p;
+		iBase = 16;
+	}
+	else if ( *p == '%' )
+	{
+		++p;
+		iBase = 2;
+	}
+	else if ( p[ 0 ] == '0' && ( p[ 1 ] == 'x' || p[ 1 ] == 'X' ) )
+	{
+		p += 2;
+		iBase = 16;
+	}
+
+	const char* pDigits = p;
+	while ( isalnum( static_cast<unsigned char>( *p ) ) )
+	{
+		++p;
+	}
+
+	std::string digits( pDigits, p );
+
+	// ... trailing h for hex.
+	if ( iBase == 10 && digits.size() > 1 && ( digits.back() == 'h' || digits.back() == 'H' ) )
+	{
+		digits.pop_back();
+		iBase = 16;
+	}
+
+	char* pEnd = nullptr;
+	value = static_cast<int>( strtol( digits.c_str(), &pEnd, iBase ) );
+
+	if ( digits.empty() || *pEnd != 0 )
+	{
+		ctx.error = "Bad number \"" + std::string( pStart, p ) + "\"";
+		return false;
+	}
+
+	return true;
+}
+
+static bool ParseFactor( AsmContext& ctx, const char*& p, int& value )
+{
+	SkipSpace( p );
+
+	if ( *p == '-' || *p == '+' )
+	{
+		const char sign = *p++;
+
+		if ( ParseFactor( ctx, p, value ) == false )
+		{
+			return false;
+		}
+
+		if ( sign == '-' )
+		{
+			value = -value;
+		}
+
+		return true;
+	}
+
+	if ( *p == '(' )
+	{
+		++p;
+
+		if ( ParseExpression( ctx, p, value ) == false )
+		{
+			return false;
+		}
+
+		SkipSpace( p );
+		if ( *p != ')' )
+		{
+			ctx.error = "Missing ')'";
+			return false;
+		}
+
+		++p;
+		return true;
+	}
+
+	if ( *p == '\'' && p[ 1 ] && p[ 2 ] == '\'' )
+	{
+		value = static_cast<uint8_t>( p[ 1 ] );
+		p += 3;
+		return true;
+	}
+
+	// ... '$' on its own is the current address.
+	if ( *p == '$' && isxdigit( static_cast<unsigned char>( p[ 1 ] ) ) == 0 )
+	{
+		++p;
+		value = ctx.iPC;
+		return true;
+	}
+
+	if ( isdigit( static_cast<unsigned char>( *p ) ) || *p == '$' || *p == '%' )
+	{
+		return ParseNumber( ctx, p, value );
+	}
+
+	if ( IsSymbolStart( *p ) )
+	{
+		const char* pStart = p;
+		while ( IsSymbolChar( *p ) )
+		{
+			++p;
+		}
+
+		std::string name( pStart, p );
+		auto it = ctx.pProgram->labels.find( name );
+
+		if ( it != ctx.pProgram->labels.end() )
+		{
+			value = it->second;
+		}
+		else if ( ctx.iPass == 1 )
+		{
+			// ... may be defined later.
+			value = 0;
+			ctx.bUnresolved = true;
+		}
+		else
+		{
+			ctx.error = "Undefined label \"" + name + "\"";
+			return false;
+		}
+
+		return true;
+	}
+
+	ctx.error = "Bad expression";
+	return false;
+}
+
+static bool ParseProduct( AsmContext& ctx, const char*& p, int& value )
+{
+	if ( ParseFactor( ctx, p, value ) == false )
+	{
+		return false;
+	}
+
+	for ( ; ; )
+	{
+		SkipSpace( p );
+
+		const char op = *p;
+		if ( op != '*' && op != '/' )
+		{
+			return true;
+		}
+
+		++p;
+
+		int rhs;
+		if ( ParseFactor( ctx, p, rhs ) == false )
+		{
+			return false;
+		}
+
+		if ( op == '*' )
+		{
+			value *= rhs;
+		}
+		else if ( rhs != 0 )
+		{
+			value /= rhs;
+		}
+		else if ( ctx.iPass == 2 )
+		{
+			ctx.error = "Division by zero";
+			return false;
+		}
+	}
+}
+
+static bool ParseSum( AsmContext& ctx, const char*& p, int& value )
+{
+	if ( ParseProduct( ctx, p, value ) == false )
+	{
+		return false;
+	}
+
+	for ( ; ; )
+	{
+		SkipSpace( p );
+
+		const char op = *p;
+		if ( op != '+' && op != '-' )
+		{
+			return true;
+		}
+
+		++p;
+
+		int rhs;
+		if ( ParseProduct( ctx, p, rhs ) == false )
+		{
+			return false;
+		}
+
+		value = ( op == '+' ) ? value + rhs : value - rhs;
+	}
+}
+
+static bool ParseShift( AsmContext& ctx, const char*& p, int& value )
+{
+	if ( ParseSum( ctx, p, value ) == false )
+	{
+		return false;
+	}
+
+	for ( ; ; )
+	{
+		SkipSpace( p );
+
+		const bool bLeft = ( p[ 0 ] == '<' && p[ 1 ] == '<' );
+		if ( bLeft == false && ( p[ 0 ] != '>' || p[ 1 ] != '>' ) )
+		{
+			return true;
+		}
+
+		p += 2;
+
+		int rhs;
+		if ( ParseSum( ctx, p, rhs ) == false )
+		{
+			return false;
+		}
+
+		value = bLeft ? ( value << rhs ) : ( value >> rhs );
+	}
+}
+
+static bool ParseAnd( AsmContext& ctx, const char*& p, int& value )
+{
+	if ( ParseShift( ctx, p, value ) == false )
+	{
+		return false;
+	}
+
+	for ( ; ; )
+	{
+		SkipSpace( p );
+
+		if ( *p != '&' )
+		{
+			return true;
+		}
+
+		++p;
+
+		int rhs;
+		if ( ParseShift( ctx, p, rhs ) == false )
+		{
+			return false;
+		}
+
+		value &= rhs;
+	}
+}
+
+static bool ParseExpression( AsmContext& ctx, const char*& p, int& value )
+{
+	if ( ParseAnd( ctx, p, value ) == false )
+	{
+		return false;
+	}
+
+	for ( ; ; )
+	{
+		SkipSpace( p );
+
+		if ( *p != '|' )
+		{
+			return true;
+		}
+
+		++p;
+
+		int rhs;
+		if ( ParseAnd( ctx, p, rhs ) == false )
+		{
+			return false;
+		}
+
+		value |= rhs;
+	}
+}
+
+static bool Evaluate( AsmContext& ctx, const std::string& expr, int& value )
+{
+	const char* p = expr.c_str();
+
+	if ( ParseExpression( ctx, p, value ) == false )
+	{
+		return false;
+	}
+
+	SkipSpace( p );
+	if ( *p != 0 )
+	{
+		ctx.error = "Unexpected \"" + std::string( p ) + "\"";
+		return false;
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// Operands
+//------------------------------------------------------------------------------
+
+// Split on commas that aren't inside quotes.
+static std::vector< std::string > SplitOperands( const std::string& s )
+{
+	std::vector< std::string > out;
+	std::string current;
+	bool bInString = false;
+
+	for ( size_t i = 0; i < s.size(); ++i )
+	{
+		if ( bInString == false && IsCharLiteral( s, i ) )
+		{
+			current += s.substr( i, 3 );
+			i += 2;
+			continue;
+		}
+
+		if ( s[ i ] == '"' )
+		{
+			bInString = !bInString;
+		}
+
+		if ( s[ i ] == ',' && bInString == false )
+		{
+			out.push_back( Trim( current ) );
+			current.clear();
+		}
+		else
+		{
+			current += s[ i ];
+		}
+	}
+
+	if ( Trim( current ).empty() == false || out.empty() == false )
+	{
+		out.push_back( Trim( current ) );
+	}
+
+	return out;
+}
+
+// Is the whole operand wrapped in one pair of brackets?
+static bool IsIndirect( const std::string& s )
+{
+	if ( s.size() < 2 || s.front() != '(' || s.back() != ')' )
+	{
+		return false;
+	}
+
+	int iDepth = 0;
+	for ( size_t i = 0; i < s.size(); ++i )
+	{
+		if ( s[ i ] == '(' )
+		{
+			++iDepth;
+		}
+		else if ( s[ i ] == ')' && --iDepth == 0 && i != s.size() - 1 )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool ParseOperand( AsmContext& ctx, const std::string& text, AsmOperand& op )
+{
+	static const char* kRegisters8[] = { "b", "c", "d", "e", "h", "l", "(hl)", "a" };
+	static const char* kPairs[] = { "bc", "de", "hl", "sp" };
+
+	std::string lower;
+	for ( char ch : Lower( text ) )
+	{
+		if ( ch != ' ' && ch != '\t' )
+		{
+			lower += ch;
+		}
+	}
+
+	op.text = lower;
+	op.iValue = 0;
+
+	for ( int i = 0; i < 8; ++i )
+	{
+		if ( lower == kRegisters8[ i ] )
+		{
+			op.kind = ASM_R8;
+			op.iValue = i;
+			return true;
+		}
+	}
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		if ( lower == kPairs[ i ] )
+		{
+			op.kind = ASM_RR;
+			op.iValue = i;
+			return true;
+		}
+	}
+
+	if ( lower == "af" )
+	{
+		op.kind = ASM_AF;
+		return true;
+	}
+	else if ( lower == "af'" )
+	{
+		op.kind = ASM_AF_ALT;
+		return true;
+	}
+	else if ( lower == "(bc)" )
+	{
+		op.kind = ASM_IND_BC;
+		return true;
+	}
+	else if ( lower == "(de)" )
+	{
+		op.kind = ASM_IND_DE;
+		return true;
+	}
+	else if ( lower == "(sp)" )
+	{
+		op.kind = ASM_IND_SP;
+		return true;
+	}
+
+	if ( lower == "nz" || lower == "z" || lower == "nc" || lower == "po" || lower == "pe" || lower == "p" || lower == "m" )
+	{
+		op.kind = ASM_CONDITION;
+		return true;
+	}
+
+	std::string trimmed = Trim( text );
+
+	if ( IsIndirect( trimmed ) )
+	{
+		op.kind = ASM_IND_NN;
+		return Evaluate( ctx, trimmed.substr( 1, trimmed.size() - 2 ), op.iValue );
+	}
+
+	op.kind = ASM_NN;
+	return Evaluate( ctx, trimmed, op.iValue );
+}
+
+// Condition code index, or -1. 'c' is a condition here, not the register.
+static int ConditionCode( const AsmOperand& op, int iMax )
+{
+	static const char* kConditions[] = { "nz", "z", "nc", "c", "po", "pe", "p", "m" };
+
+	for ( int i = 0; i < iMax; ++i )
+	{
+		if ( op.text == kConditions[ i ] )
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+//------------------------------------------------------------------------------
+// Instructions
+//------------------------------------------------------------------------------
+
+static bool AssembleInstruction( AsmContext& ctx, const std::string& mnemonic, const std::vector< AsmOperand >& ops )
+{
+	static const char* kAlu[] = { "add", "adc", "sub", "sbc", "and", "xor", "or", "cp" };
+	static const char* kShifts[] = { "rlc", "rrc", "rl", "rr", "sla", "sra", "sll", "srl" };
+
+	struct Simple
+	{
+		const char* pName;
+		int iPrefix;
+		int iOpcode;
+	};
+
+	static const Simple kSimple[] =
+	{
+		{ "nop", 0, 0x00 }, { "halt", 0, 0x76 }, { "di", 0, 0xF3 }, { "ei", 0, 0xFB },
+		{ "rlca", 0, 0x07 }, { "rrca", 0, 0x0F }, { "rla", 0, 0x17 }, { "rra", 0, 0x1F },
+		{ "cpl", 0, 0x2F }, { "scf", 0, 0x37 }, { "ccf", 0, 0x3F }, { "exx", 0, 0xD9 },
+		{ "neg", 0xED, 0x44 }, { "ldi", 0xED, 0xA0 }, { "ldir", 0xED, 0xB0 },
+		{ "ldd", 0xED, 0xA8 }, { "lddr", 0xED, 0xB8 },
+	};
+
+	const size_t count = ops.size();
+	const AsmOperand* a = count > 0 ? &ops[ 0 ] : nullptr;
+	const AsmOperand* b = count > 1 ? &ops[ 1 ] : nullptr;
+
+	for ( const Simple& simple : kSimple )
+	{
+		if ( mnemonic == simple.pName && count == 0 )
+		{
+			if ( simple.iPrefix )
+			{
+				Emit( ctx, simple.iPrefix );
+			}
+
+			Emit( ctx, simple.iOpcode );
+			return true;
+		}
+	}
+
+	if ( mnemonic == "ld" && count == 2 )
+	{
+		if ( a->kind == ASM_R8 && b->kind == ASM_R8 && ( a->iValue != 6 || b->iValue != 6 ) )
+		{
+			Emit( ctx, 0x40 | ( a->iValue << 3 ) | b->iValue );
+			return true;
+		}
+		else if ( a->kind == ASM_R8 && b->kind == ASM_NN )
+		{
+			Emit( ctx, 0x06 | ( a->iValue << 3 ) );
+			Emit( ctx, b->iValue );
+			return true;
+		}
+		else if ( a->kind == ASM_R8 && a->iValue == 7 && ( b->kind == ASM_IND_BC || b->kind == ASM_IND_DE ) )
+		{
+			Emit( ctx, b->kind == ASM_IND_BC ? 0x0A : 0x1A );
+			return true;
+		}
+		else if ( ( a->kind == ASM_IND_BC || a->kind == ASM_IND_DE ) && b->kind == ASM_R8 && b->iValue == 7 )
+		{
+			Emit( ctx, a->kind == ASM_IND_BC ? 0x02 : 0x12 );
+			return true;
+		}
+		else if ( a->kind == ASM_R8 && a->iValue == 7 && b->kind == ASM_IND_NN )
+		{
+			Emit( ctx, 0x3A );
+			Emit16( ctx, b->iValue );
+			return true;
+		}
+		else if ( a->kind == ASM_IND_NN && b->kind == ASM_R8 && b->iValue == 7 )
+		{
+			Emit( ctx, 0x32 );
+			Emit16( ctx, a->iValue );
+			return true;
+		}
+		else if ( a->kind == ASM_RR && b->kind == ASM_NN )
+		{
+			Emit( ctx, 0x01 | ( a->iValue << 4 ) );
+			Emit16( ctx, b->iValue );
+			return true;
+		}
+		else if ( a->kind == ASM_RR && b->kind == ASM_IND_NN )
+		{
+			if ( a->iValue == 2 )
+			{
+				Emit( ctx, 0x2A );
+			}
+			else
+			{
+				Emit( ctx, 0xED );
+				Emit( ctx, 0x4B | ( a->iValue << 4 ) );
+			}
+
+			Emit16( ctx, b->iValue );
+			return true;
+		}
+		else if ( a->kind == ASM_IND_NN && b->kind == ASM_RR )
+		{
+			if ( b->iValue == 2 )
+			{
+				Emit( ctx, 0x22 );
+			}
+			else
+			{
+				Emit( ctx, 0xED );
+				Emit( ctx, 0x43 | ( b->iValue << 4 ) );
+			}
+
+			Emit16( ctx, a->iValue );
+			return true;
+		}
+		else if ( a->kind == ASM_RR && a->iValue == 3 && b->kind == ASM_RR && b->iValue == 2 )
+		{
+			Emit( ctx, 0xF9 );
+			return true;
+		}
+	}
+	else if ( ( mnemonic == "push" || mnemonic == "pop" ) && count == 1 )
+	{
+		const int base = ( mnemonic == "push" ) ? 0xC5 : 0xC1;
+
+		if ( a->kind == ASM_RR && a->iValue != 3 )
+		{
+			Emit( ctx, base | ( a->iValue << 4 ) );
+			return true;
+		}
+		else if ( a->kind == ASM_AF )
+		{
+			Emit( ctx, base | 0x30 );
+			return true;
+		}
+	}
+	else if ( ( mnemonic == "inc" || mnemonic == "dec" ) && count == 1 )
+	{
+		const bool bInc = ( mnemonic == "inc" );
+
+		if ( a->kind == ASM_R8 )
+		{
+			Emit( ctx, ( bInc ? 0x04 : 0x05 ) | ( a->iValue << 3 ) );
+			return true;
+		}
+		else if ( a->kind == ASM_RR )
+		{
+			Emit( ctx, ( bInc ? 0x03 : 0x0B ) | ( a->iValue << 4 ) );
+			return true;
+		}
+	}
+	else if ( mnemonic == "jp" )
+	{
+		if ( count == 1 && a->kind == ASM_R8 && a->iValue == 6 )
+		{
+			Emit( ctx, 0xE9 );
+			return true;
+		}
+		else if ( count == 1 && a->kind == ASM_NN )
+		{
+			Emit( ctx, 0xC3 );
+			Emit16( ctx, a->iValue );
+			return true;
+		}
+		else if ( count == 2 && ConditionCode( *a, 8 ) >= 0 && b->kind == ASM_NN )
+		{
+			Emit( ctx, 0xC2 | ( ConditionCode( *a, 8 ) << 3 ) );
+			Emit16( ctx, b->iValue );
+			return true;
+		}
+	}
+	else if ( mnemonic == "call" )
+	{
+		if ( count == 1 && a->kind == ASM_NN )
+		{
+			Emit( ctx, 0xCD );
+			Emit16( ctx, a->iValue );
+			return true;
+		}
+		else if ( count == 2 && ConditionCode( *a, 8 ) >= 0 && b->kind == ASM_NN )
+		{
+			Emit( ctx, 0xC4 | ( ConditionCode( *a, 8 ) << 3 ) );
+			Emit16( ctx, b->iValue );
+			return true;
+		}
+	}
+	else if ( mnemonic == "ret" )
+	{
+		if ( count == 0 )
+		{
+			Emit( ctx, 0xC9 );
+			return true;
+		}
+		else if ( count == 1 && ConditionCode( *a, 8 ) >= 0 )
+		{
+			Emit( ctx, 0xC0 | ( ConditionCode( *a, 8 ) << 3 ) );
+			return true;
+		}
+	}
+	else if ( mnemonic == "jr" || mnemonic == "djnz" )
+	{
+		int iOpcode = -1;
+		const AsmOperand* pTarget = nullptr;
+
+		if ( mnemonic == "djnz" && count == 1 )
+		{
+			iOpcode = 0x10;
+			pTarget = a;
+		}
+		else if ( count == 1 )
+		{
+			iOpcode = 0x18;
+			pTarget = a;
+		}
+		else if ( count == 2 && ConditionCode( *a, 4 ) >= 0 )
+		{
+			iOpcode = 0x20 | ( ConditionCode( *a, 4 ) << 3 );
+			pTarget = b;
+		}
+
+		if ( pTarget && pTarget->kind == ASM_NN )
+		{
+			const int iOffset = pTarget->iValue - ( ctx.iPC + 2 );
+
+			if ( ctx.iPass == 2 && ( iOffset < -128 || iOffset > 127 ) )
+			{
+				ctx.error = "Relative jump out of range";
+				return false;
+			}
+
+			Emit( ctx, iOpcode );
+			Emit( ctx, iOffset & 0xFF );
+			return true;
+		}
+	}
+	else if ( mnemonic == "ex" && count == 2 )
+	{
+		if ( a->kind == ASM_RR && a->iValue == 1 && b->kind == ASM_RR && b->iValue == 2 )
+		{
+			Emit( ctx, 0xEB );
+			return true;
+		}
+		else if ( a->kind == ASM_AF && b->kind == ASM_AF_ALT )
+		{
+			Emit( ctx, 0x08 );
+			return true;
+		}
+		else if ( a->kind == ASM_IND_SP && b->kind == ASM_RR && b->iValue == 2 )
+		{
+			Emit( ctx, 0xE3 );
+			return true;
+		}
+	}
+	else if ( ( mnemonic == "bit" || mnemonic == "res" || mnemonic == "set" ) && count == 2 )
+	{
+		if ( a->kind == ASM_NN && a->iValue >= 0 && a->iValue < 8 && b->kind == ASM_R8 )
+		{
+			const int base = ( mnemonic == "bit" ) ? 0x40 : ( mnemonic == "res" ) ? 0x80 : 0xC0;
+
+			Emit( ctx, 0xCB );
+			Emit( ctx, base | ( a->iValue << 3 ) | b->iValue );
+			return true;
+		}
+	}
+
+	// add hl,rr / adc hl,rr / sbc hl,rr
+	if ( ( mnemonic == "add" || mnemonic == "adc" || mnemonic == "sbc" ) && count == 2 &&
+		 a->kind == ASM_RR && a->iValue == 2 && b->kind == ASM_RR )
+	{
+		if ( mnemonic == "add" )
+		{
+			Emit( ctx, 0x09 | ( b->iValue << 4 ) );
+		}
+		else
+		{
+			Emit( ctx, 0xED );
+			Emit( ctx, ( mnemonic == "adc" ? 0x4A : 0x42 ) | ( b->iValue << 4 ) );
+		}
+
+		return true;
+	}
+
+	// 8-bit arithmetic, with or without the "a," prefix.
+	for ( int i = 0; i < 8; ++i )
+	{
+		if ( mnemonic != kAlu[ i ] )
+		{
+			continue;
+		}
+
+		const AsmOperand* pSrc = nullptr;
+
+		if ( count == 1 )
+		{
+			pSrc = a;
+		}
+		else if ( count == 2 && a->kind == ASM_R8 && a->iValue == 7 )
+		{
+			pSrc = b;
+		}
+
+		if ( pSrc && pSrc->kind == ASM_R8 )
+		{
+			Emit( ctx, 0x80 | ( i << 3 ) | pSrc->iValue );
+			return true;
+		}
+		else if ( pSrc && pSrc->kind == ASM_NN )
+		{
+			Emit( ctx, 0xC6 | ( i << 3 ) );
+			Emit( ctx, pSrc->iValue );
+			return true;
+		}
+	}
+
+	// Rotates and shifts.
+	for ( int i = 0; i < 8; ++i )
+	{
+		if ( mnemonic == kShifts[ i ] && count == 1 && a->kind == ASM_R8 )
+		{
+			Emit( ctx, 0xCB );
+			Emit( ctx, ( i << 3 ) | a->iValue );
+			return true;
+		}
+	}
+
+	ctx.error = "Unsupported instruction \"" + mnemonic + "\"";
+	for ( size_t i = 0; i < count; ++i )
+	{
+		ctx.error += ( i ? "," : " " ) + ops[ i ].text;
+	}
+
+	return false;
+}
+
+//------------------------------------------------------------------------------
+// Lines
+//------------------------------------------------------------------------------
+
+// Strip a ';' comment, ignoring any inside quotes.
+static std::string StripComment( const std::string& line )
+{
+	bool bInString = false;
+
+	for ( size_t i = 0; i < line.size(); ++i )
+	{
+		if ( bInString == false && IsCharLiteral( line, i ) )
+		{
+			i += 2;
+		}
+		else if ( line[ i ] == '"' )
+		{
+			bInString = !bInString;
+		}
+		else if ( line[ i ] == ';' && bInString == false )
+		{
+			return line.substr( 0, i );
+		}
+	}
+
+	return line;
+}
+
+static bool DefineLabel( AsmContext& ctx, const std::string& name, int value )
+{
+	std::map< std::string, int >& labels = ctx.pProgram->labels;
+	auto it = labels.find( name );
+
+	if ( ctx.iPass == 1 )
+	{
+		if ( it != labels.end() )
+		{
+			ctx.error = "Label \"" + name + "\" is already defined";
+			return false;
+		}
+
+		labels[ name ] = value;
+	}
+	else if ( it == labels.end() || it->second != value )
+	{
+		ctx.error = "Label \"" + name + "\" moved between passes";
+		return false;
+	}
+
+	return true;
+}
+
+// Evaluate an expression that must be known in the first pass (org, dsb, equ).
+static bool EvaluateNow( AsmContext& ctx, const std::string& expr, int& value )
+{
+	ctx.bUnresolved = false;
+
+	if ( Evaluate( ctx, expr, value ) == false )
+	{
+		return false;
+	}
+
+	if ( ctx.bUnresolved )
+	{
+		ctx.error = "Labels in \"" + expr + "\" must be defined before use";
+		return false;
+	}
+
+	return true;
+}
+
+static bool AssembleLine( AsmContext& ctx, const std::string& rawLine )
+{
+	std::string line = StripComment( rawLine );
+
+	if ( Trim( line ).empty() )
+	{
+		return true;
+	}
+
+	// A label starts in the first column, with or without a colon. A colon also
+	// marks a label after leading white space.
+	std::string label;
+	size_t cursor = 0;
+
+	if ( IsSymbolStart( line[ 0 ] ) )
+	{
+		while ( cursor < line.size() && IsSymbolChar( line[ cursor ] ) )
+		{
+			++cursor;
+		}
+
+		label = line.substr( 0, cursor );
+
+		if ( cursor < line.size() && line[ cursor ] == ':' )
+		{
+			++cursor;
+		}
+	}
+	else
+	{
+		size_t start = line.find_first_not_of( " \t" );
+		size_t end = start;
+
+		while ( end < line.size() && IsSymbolChar( line[ end ] ) )
+		{
+			++end;
+		}
+
+		if ( end < line.size() && line[ end ] == ':' && end > start )
+		{
+			label = line.substr( start, end - start );
+			cursor = end + 1;
+		}
+	}
+
+	std::string rest = Trim( line.substr( cursor ) );
+
+	// Split the mnemonic from its operands.
+	size_t split = rest.find_first_of( " \t" );
+	std::string mnemonic = Lower( rest.substr( 0, split ) );
+	std::string operands = ( split == std::string::npos ) ? std::string() : Trim( rest.substr( split ) );
+
+	// ... equ gives the label a value instead of the address.
+	if ( mnemonic == "equ" )
+	{
+		int value;
+
+		if ( label.empty() )
+		{
+			ctx.error = "equ needs a label";
+			return false;
+		}
+
+		return EvaluateNow( ctx, operands, value ) && DefineLabel( ctx, label, value );
+	}
+
+	if ( label.empty() == false && DefineLabel( ctx, label, ctx.iPC ) == false )
+	{
+		return false;
+	}
+
+	if ( mnemonic.empty() )
+	{
+		return true;
+	}
+
+	std::vector< std::string > args = SplitOperands( operands );
+
+	if ( mnemonic == "org" )
+	{
+		if ( args.size() != 1 || EvaluateNow( ctx, args[ 0 ], ctx.iPC ) == false )
+		{
+			ctx.error = ctx.error.empty() ? "org needs an address" : ctx.error;
+			return false;
+		}
+
+		return true;
+	}
+	else if ( mnemonic == "db" || mnemonic == "defb" || mnemonic == "byte" || mnemonic == "dc.b" )
+	{
+		for ( const std::string& arg : args )
+		{
+			if ( arg.size() >= 2 && arg.front() == '"' && arg.back() == '"' )
+			{
+				for ( size_t i = 1; i + 1 < arg.size(); ++i )
+				{
+					Emit( ctx, static_cast<uint8_t>( arg[ i ] ) );
+				}
+			}
+			else
+			{
+				int value;
+				if ( Evaluate( ctx, arg, value ) == false )
+				{
+					return false;
+				}
+
+				Emit( ctx, value );
+			}
+		}
+
+		return true;
+	}
+	else if ( mnemonic == "dw" || mnemonic == "defw" || mnemonic == "word" || mnemonic == "dc.w" )
+	{
+		for ( const std::string& arg : args )
+		{
+			int value;
+			if ( Evaluate( ctx, arg, value ) == false )
+			{
+				return false;
+			}
+
+			Emit16( ctx, value );
+		}
+
+		return true;
+	}
+	else if ( mnemonic == "dsb" || mnemonic == "ds" || mnemonic == "defs" || mnemonic == "ds.b" )
+	{
+		int iCount;
+		int iFill = 0;
+
+		if ( args.empty() || args.size() > 2 || EvaluateNow( ctx, args[ 0 ], iCount ) == false ||
+			 ( args.size() == 2 && Evaluate( ctx, args[ 1 ], iFill ) == false ) )
+		{
+			ctx.error = ctx.error.empty() ? "dsb needs a count" : ctx.error;
+			return false;
+		}
+
+		for ( int i = 0; i < iCount; ++i )
+		{
+			Emit( ctx, iFill );
+		}
+
+		return true;
+	}
+
+	std::vector< AsmOperand > ops( args.size() );
+	for ( size_t i = 0; i < args.size(); ++i )
+	{
+		if ( ParseOperand( ctx, args[ i ], ops[ i ] ) == false )
+		{
+			return false;
+		}
+	}
+
+	return AssembleInstruction( ctx, mnemonic, ops );
+}
+
+//------------------------------------------------------------------------------
+// Interface
+//------------------------------------------------------------------------------
+
+bool AssembleZ80( Z80Program& program, uint8_t* pMemory, const std::vector< Z80Source >& sources )
+{
+	program.labels.clear();
+	program.iStart = 0x10000;
+	program.iEnd = 0;
+	program.error.clear();
+
+	AsmContext ctx;
+	ctx.pProgram = &program;
+	ctx.pMemory = pMemory;
+
+	for ( ctx.iPass = 1; ctx.iPass <= 2; ++ctx.iPass )
+	{
+		ctx.iPC = 0;
+
+		for ( const Z80Source& source : sources )
+		{
+			size_t start = 0;
+			int iLine = 1;
+
+			while ( start <= source.text.size() )
+			{
+				size_t end = source.text.find( '\n', start );
+				if ( end == std::string::npos )
+				{
+					end = source.text.size();
+				}
+
+				ctx.error.clear();
+
+				if ( AssembleLine( ctx, source.text.substr( start, end - start ) ) == false )
+				{
+					char where[ 32 ];
+					snprintf( where, sizeof( where ), "(%d): ", iLine );
+					program.error = source.name + where + ctx.error;
+					return false;
+				}
+
+				start = end + 1;
+				++iLine;
+			}
+		}
+	}
+
+	if ( program.iEnd == 0 )
+	{
+		program.iStart = 0;
+	}
+
+	return true;
+}
+
+bool ReadZ80Source( Z80Source& source, const char* pName )
+{
+	FILE* fp;
+	int err = fopen_s( &fp, pName, "rb" );
+	if ( err != 0 || fp == nullptr )
+	{
+		return false;
+	}
+
+	source.name = pName;
+	source.text.clear();
+
+	char buffer[ 4096 ];
+	size_t count;
+
+	while ( ( count = fread( buffer, 1, sizeof( buffer ), fp ) ) > 0 )
+	{
+		source.text.append( buffer, count );
+	}
+
+	fclose( fp );
+
+	return true;
+}
+
+//==============================================================================
@@ -0,0 +1,576 @@
+
+/*
+
+Copyright (c) 2021-2022 David Walters
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "fileio.h"
+#include "rle.h"
+#include "lz.h"
+#include "text.h"
+#include "z80.h"
+
+// Value written to free memory before each run, so stray writes show up.
+static const uint8_t kFillByte = 0xE5;
+
+// Cycle budget for each call: generous for any sane decoder, but stops a
+// broken one looping forever.
+static const int64_t kCyclesPerByte = 1000;
+static const int64_t kCyclesMinimum = 1000000;
+
+struct BenchRegion
+{
+	int iStart;
+	int iEnd;
+};
+
+// Find room for the output and the compressed data in the memory the program
+// doesn't use. Returns false if they don't fit. When they share a region the
+// data goes first, so an overrun lands in free memory rather than the input.
+static bool PlaceBuffers( int& iOutputAddr, int& iDataAddr, const Z80Program& program, int iOutputSize, int iDataSize )
+{
+	const BenchRegion regions[ 2 ] =
+	{
+		{ 0, program.iStart },
+		{ program.iEnd, kZ80ReturnAddress },
+	};
+
+	for ( const BenchRegion& out : regions )
+	{
+		for ( const BenchRegion& data : regions )
+		{
+			if ( &out == &data )
+			{
+				if ( iOutputSize + iDataSize <= out.iEnd - out.iStart )
+				{
+					iDataAddr = out.iStart;
+					iOutputAddr = out.iStart + iDataSize;
+					return true;
+				}
+			}
+			else if ( iOutputSize <= out.iEnd - out.iStart && iDataSize <= data.iEnd - data.iStart )
+			{
+				iOutputAddr = out.iStart;
+				iDataAddr = data.iStart;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+static const char* StatusName( Z80Status status )
+{
+	switch ( status )
+	{
+	case Z80_HALT:			return "executed HALT";
+	case Z80_BAD_OPCODE:	return "hit an unsupported instruction";
+	case Z80_TIMEOUT:		return "didn't return";
+	default:				return "failed";
+	}
+}
+
+// Which tool compresses the files.
+enum BenchCodec
+{
+	BENCH_RLE,
+	BENCH_LZ,
+	BENCH_TEXT,
+};
+
+// Encode one file, decode it on the emulator and check the result. Returns false on failure.
+// With bWhole the entry decodes every plane in one call and leaves the original file.
+// With BENCH_LZ or BENCH_TEXT the file is compressed by that tool instead, and decoded whole.
+// With bInPlace the data is loaded at the end of the output buffer, plus the
+// margin that 'rle -inplace' reports.
+static bool BenchFile( const char* pName, const Z80& image, const Z80Program& program, const RleParams& params,
+					   int iEntry, int iUnfilter, bool bWhole, BenchCodec codec, bool bInPlace )
+{
+	MappedFile input;
+	if ( MapFile( &input, pName ) == false )
+	{
+		PrintError( "Cannot open input file \"%s\"", pName );
+		return false;
+	}
+
+	const int iInputSize = static_cast<int>( input.iSize );
+
+	std::vector< uint8_t > rle;
+	if ( codec == BENCH_LZ )
+	{
+		if ( EncodeLzBuffer( rle, input.pData, iInputSize ) == false )
+		{
+			PrintError( "\"%s\" can't be compressed with lz.", pName );
+			UnmapFile( &input );
+			return false;
+		}
+	}
+	else if ( codec == BENCH_TEXT )
+	{
+		TextInfo info;
+		if ( EncodeTextBuffer( rle, info, input.pData, iInputSize, kTextMaxPairs ) == false )
+		{
+			PrintError( "\"%s\" can't be compressed with text.", pName );
+			UnmapFile( &input );
+			return false;
+		}
+	}
+	else
+	{
+		EncodeRleBuffer( rle, params, input.pData, iInputSize );
+	}
+
+	// ... what the decoder should leave behind: filtered planes, unless the
+	// unfilter routine is run too.
+	RleParams expectParams = params;
+	if ( iUnfilter >= 0 )
+	{
+		expectParams.filter = FILTER_NONE;
+	}
+
+	std::vector< uint8_t > expected;
+	if ( bWhole )
+	{
+		expected.assign( input.pData, input.pData + iInputSize );
+	}
+	else
+	{
+		PrepareRlePlanes( expected, input.pData, iInputSize, expectParams );
+	}
+
+	UnmapFile( &input );
+
+	const int iDataSize = static_cast<int>( rle.size() );
+
+	int iOutputAddr;
+	int iDataAddr;
+	int iMargin = 0;
+	bool bPlaced;
+
+	if ( bInPlace )
+	{
+		// ... one buffer, with the data at the end.
+		iMargin = RleInPlaceMargin( rle.data(), iDataSize, iInputSize );
+		bPlaced = PlaceBuffers( iOutputAddr, iDataAddr, program, iInputSize + iMargin, 0 );
+		iDataAddr = iOutputAddr + iInputSize + iMargin - iDataSize;
+	}
+	else
+	{
+		bPlaced = PlaceBuffers( iOutputAddr, iDataAddr, program, iInputSize, iDataSize );
+	}
+
+	if ( bPlaced == false )
+	{
+		PrintError( "\"%s\" doesn't fit in memory (%d bytes + %d compressed) around the program at $%04X-$%04X.",
+					pName, iInputSize, iDataSize, program.iStart, program.iEnd - 1 );
+		return false;
+	}
+
+	Z80* pCpu = new Z80( image );
+	Z80& cpu = *pCpu;
+
+	memcpy( cpu.mem + iDataAddr, rle.data(), iDataSize );
+
+	const std::vector< uint8_t > before( cpu.mem, cpu.mem + 65536 );
+
+	const int64_t iMaxCycles = kCyclesMinimum + kCyclesPerByte * ( iInputSize + iDataSize );
+
+	int64_t iDecodeCycles = 0;
+	int64_t iUnfilterCycles = 0;
+	int iPlaneAddr = iOutputAddr;
+	bool bOK = true;
+
+	cpu.Reset();
+	cpu.SetHL( static_cast<uint16_t>( iDataAddr ) );
+
+	if ( bWhole )
+	{
+		cpu.SetDE( static_cast<uint16_t>( iOutputAddr ) );
+
+		Z80Status status = cpu.Call( static_cast<uint16_t>( iEntry ), iMaxCycles * params.iPlanes );
+		iDecodeCycles = cpu.iCycles;
+
+		if ( status != Z80_OK )
+		{
+			PrintError( "\"%s\": decoder %s at $%04X.", pName, StatusName( status ), cpu.pc );
+			bOK = false;
+		}
+	}
+
+	for ( int iPlane = 0; iPlane < params.iPlanes && bOK && bWhole == false; ++iPlane )
+	{
+		const int iPlaneSize = PlaneSize( iPlane, params.iPlanes, iInputSize );
+
+		// ... HL carries on from the previous plane.
+		cpu.SetDE( static_cast<uint16_t>( iPlaneAddr ) );
+
+		uint64_t iStartCycles = cpu.iCycles;
+		Z80Status status = cpu.Call( static_cast<uint16_t>( iEntry ), iMaxCycles );
+		iDecodeCycles += cpu.iCycles - iStartCycles;
+
+		if ( status != Z80_OK )
+		{
+			PrintError( "\"%s\": decoder %s at $%04X in plane %d.", pName, StatusName( status ), cpu.pc, iPlane );
+			bOK = false;
+			break;
+		}
+
+		if ( iUnfilter >= 0 )
+		{
+			const uint16_t hl = cpu.HL();
+
+			cpu.SetHL( static_cast<uint16_t>( iPlaneAddr ) );
+			cpu.SetBC( static_cast<uint16_t>( iPlaneSize ) );
+			cpu.SetDE( static_cast<uint16_t>( params.iFilterPitch ) );
+
+			iStartCycles = cpu.iCycles;
+			status = cpu.Call( static_cast<uint16_t>( iUnfilter ), iMaxCycles );
+			iUnfilterCycles += cpu.iCycles - iStartCycles;
+
+			if ( status != Z80_OK )
+			{
+				PrintError( "\"%s\": unfilter %s at $%04X in plane %d.", pName, StatusName( status ), cpu.pc, iPlane );
+				bOK = false;
+				break;
+			}
+
+			cpu.SetHL( hl );
+		}
+
+		iPlaneAddr += iPlaneSize;
+	}
+
+	if ( bOK && cpu.HL() != ( ( iDataAddr + iDataSize ) & 0xFFFF ) )
+	{
+		PrintError( "\"%s\": decoder stopped reading at $%04X, expected $%04X.", pName, cpu.HL(), iDataAddr + iDataSize );
+		bOK = false;
+	}
+
+	if ( bOK && memcmp( cpu.mem + iOutputAddr, expected.data(), iInputSize ) != 0 )
+	{
+		int iOffset = 0;
+		while ( cpu.mem[ iOutputAddr + iOffset ] == expected[ iOffset ] )
+		{
+			++iOffset;
+		}
+
+		PrintError( "\"%s\": output differs at offset %d ($%02X, expected $%02X).",
+					pName, iOffset, cpu.mem[ iOutputAddr + iOffset ], expected[ iOffset ] );
+		bOK = false;
+	}
+
+	// ... nothing outside the output (and the stack) may change.
+	for ( int iAddr = 0; iAddr < kZ80ReturnAddress && bOK; ++iAddr )
+	{
+		const bool bOutput = ( iAddr >= iOutputAddr && iAddr < iOutputAddr + iInputSize );
+
+		if ( bOutput == false && cpu.mem[ iAddr ] != before[ iAddr ] )
+		{
+			PrintError( "\"%s\": decoder wrote outside the output, at $%04X.", pName, iAddr );
+			bOK = false;
+		}
+	}
+
+	delete pCpu;
+
+	if ( bOK == false )
+	{
+		return false;
+	}
+
+	const double fPerByte = iInputSize ? static_cast<double>( iDecodeCycles ) / iInputSize : 0.0;
+
+	printf( "%s: %d -> %d bytes, %lld T-states (%.2f T/byte)",
+			pName, iInputSize, iDataSize, static_cast<long long>( iDecodeCycles ), fPerByte );
+
+	// ... the cycle model only covers rle.
+	if ( codec == BENCH_RLE )
+	{
+		printf( ", model %lld", static_cast<long long>( RleDecodeCycles( rle.data(), iDataSize ) ) );
+	}
+
+	if ( iUnfilter >= 0 )
+	{
+		printf( ", unfilter %lld T-states", static_cast<long long>( iUnfilterCycles ) );
+	}
+
+	if ( bInPlace )
+	{
+		printf( ", in place with %d byte margin", iMargin );
+	}
+
+	printf( "\n" );
+
+	return true;
+}
+
+int Z80Bench( int argc, char** argv )
+{
+	std::vector< const char* > inputs;
+	std::vector< Z80Source > sources;
+	const char* pEntryName = nullptr;
+
+	enum eOption
+	{
+		NONE,
+		OPT_ASM,
+		OPT_ENTRY,
+		OPT_PLANES,
+		OPT_FILTER,
+	};
+
+	eOption specialNextArg = NONE;
+
+	// defaults.
+	bool bOptWhole = false;
+	BenchCodec codec = BENCH_RLE;
+	bool bOptInPlace = false;
+	RleParams params;
+	DefaultRleParams( params );
+
+	// parse arguments (after the tool name)
+	for ( int i = 2; i < argc; ++i )
+	{
+		const char* pArg = argv[ i ];
+
+		if ( specialNextArg != NONE )
+		{
+			switch ( specialNextArg )
+			{
+
+			case OPT_ASM:
+
+				{
+					Z80Source source;
+
+					if ( ReadZ80Source( source, pArg ) == false )
+					{
+						// error.
+						PrintError( "Cannot open source file \"%s\".", pArg );
+						return 1;
+					}
+
+					sources.push_back( source );
+				}
+
+				break;
+
+			case OPT_ENTRY:
+
+				pEntryName = pArg;
+				break;
+
+			case OPT_PLANES:
+
+				params.iPlanes = ParseValue( pArg, 255 );
+
+				if ( params.iPlanes < 1 )
+				{
+					// error.
+					PrintError( "Invalid -planes parameter \"%s\".", pArg );
+					return 1;
+				}
+
+				break;
+
+			case OPT_FILTER:
+
+				if ( ParseRleFilter( params, pArg ) == false )
+				{
+					// error.
+					PrintError( "Invalid -filter \"%s\". Use delta or xor-row:<pitch>.", pArg );
+					return 1;
+				}
+
+				break;
+
+			}
+
+			specialNextArg = NONE;
+		}
+		else if ( *pArg == '-' )
+		{
+			if ( _stricmp( pArg, "-asm" ) == 0 )
+			{
+				specialNextArg = OPT_ASM;
+			}
+			else if ( _stricmp( pArg, "-entry" ) == 0 )
+			{
+				specialNextArg = OPT_ENTRY;
+			}
+			else if ( _stricmp( pArg, "-planes" ) == 0 )
+			{
+				specialNextArg = OPT_PLANES;
+			}
+			else if ( _stricmp( pArg, "-filter" ) == 0 )
+			{
+				specialNextArg = OPT_FILTER;
+			}
+			else if ( _stricmp( pArg, "-whole" ) == 0 )
+			{
+				bOptWhole = true;
+			}
+			else if ( _stricmp( pArg, "-lz" ) == 0 )
+			{
+				codec = BENCH_LZ;
+			}
+			else if ( _stricmp( pArg, "-text" ) == 0 )
+			{
+				codec = BENCH_TEXT;
+			}
+			else if ( _stricmp( pArg, "-inplace" ) == 0 )
+			{
+				bOptInPlace = true;
+			}
+			else
+			{
+				// error.
+				PrintHelp( "z80bench" );
+				return 1;
+			}
+		}
+		else
+		{
+			inputs.push_back( pArg );
+		}
+	}
+
+	if ( inputs.empty() || sources.empty() || specialNextArg != NONE )
+	{
+		PrintHelp( "z80bench" );
+		return 1;
+	}
+
+	if ( codec != BENCH_RLE )
+	{
+		if ( params.iPlanes != 1 || params.filter != FILTER_NONE )
+		{
+			PrintError( "-planes and -filter can't be used with -lz or -text." );
+			return 1;
+		}
+
+		// ... one call decodes everything.
+		bOptWhole = true;
+	}
+
+	// ... the margin models RLEDecompress writing one plane after another.
+	if ( bOptInPlace && bOptWhole )
+	{
+		PrintError( "-inplace can't be combined with -lz, -text or -whole." );
+		return 1;
+	}
+
+	if ( pEntryName == nullptr )
+	{
+		switch ( codec )
+		{
+		case BENCH_RLE:		pEntryName = "RLEDecompress";	break;
+		case BENCH_LZ:		pEntryName = "LZDecompress";	break;
+		case BENCH_TEXT:	pEntryName = "TextDecompress";	break;
+		}
+	}
+
+	const char* pParamsError = CheckRleParams( params );
+	if ( pParamsError )
+	{
+		PrintError( "%s", pParamsError );
+		return 1;
+	}
+
+	// Assemble into a clean machine.
+	Z80* pImage = new Z80;
+	memset( pImage->mem, kFillByte, sizeof( pImage->mem ) );
+	pImage->Reset();
+
+	Z80Program program;
+	if ( AssembleZ80( program, pImage->mem, sources ) == false )
+	{
+		PrintError( "%s", program.error.c_str() );
+		delete pImage;
+		return 1;
+	}
+
+	if ( program.iEnd > kZ80ReturnAddress )
+	{
+		PrintError( "The program must end below $%04X.", kZ80ReturnAddress );
+		delete pImage;
+		return 1;
+	}
+
+	auto entry = program.labels.find( pEntryName );
+	if ( entry == program.labels.end() )
+	{
+		PrintError( "Entry point \"%s\" not found.", pEntryName );
+		delete pImage;
+		return 1;
+	}
+
+	// ... the inverse filter comes from rle_unfilter.z80, unless the entry
+	// does the whole job.
+	int iUnfilter = -1;
+	if ( params.filter != FILTER_NONE && bOptWhole == false )
+	{
+		const char* pUnfilterName = ( params.filter == FILTER_DELTA ) ? "RLEUnfilterDelta" : "RLEUnfilterXorRow";
+		auto unfilter = program.labels.find( pUnfilterName );
+
+		if ( unfilter == program.labels.end() )
+		{
+			PrintError( "-filter needs \"%s\" (see Extras/rle_unfilter.z80).", pUnfilterName );
+			delete pImage;
+			return 1;
+		}
+
+		iUnfilter = unfilter->second;
+	}
+
+	Info( "Assembled $%04X-$%04X, %s at $%04X.\n", program.iStart, program.iEnd - 1, pEntryName, entry->second );
+
+	int iFailed = 0;
+
+	for ( const char* pName : inputs )
+	{
+		if ( BenchFile( pName, *pImage, program, params, entry->second, iUnfilter, bOptWhole, codec, bOptInPlace ) == false )
+		{
+			++iFailed;
+		}
+	}
+
+	delete pImage;
+
+	if ( iFailed )
+	{
+		printf( "FAILED: %d of %d file(s).\n", iFailed, static_cast<int>( inputs.size() ) );
+		return 1;
+	}
+
+	return 0;
+}
+
+//==============================================================================